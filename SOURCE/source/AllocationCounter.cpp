@@ -0,0 +1,106 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+namespace
+{
+	std::atomic<uint64_t> g_AllocationCount{ 0 };
+}
+
+namespace dae
+{
+	uint64_t AllocationCounter::GetAllocationCount()
+	{
+		return g_AllocationCount.load(std::memory_order_relaxed);
+	}
+}
+
+#ifdef ALLOCATION_COUNTER_ENABLED
+//The array and nothrow versions forward to these by default.
+//Over-aligned types (the SIMD blocks, the per worker data) go through the align_val_t versions, which do not forward to the plain ones
+void* operator new(std::size_t size)
+{
+	g_AllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+	if (void* pMemory = std::malloc(size == 0 ? 1 : size))
+		return pMemory;
+
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* pMemory) noexcept
+{
+	std::free(pMemory);
+}
+
+void operator delete(void* pMemory, std::size_t) noexcept
+{
+	std::free(pMemory);
+}
+
+namespace
+{
+	void* AllocateAligned(std::size_t size, std::align_val_t alignment)
+	{
+		g_AllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+		const std::size_t alignmentSize{ static_cast<std::size_t>(alignment) };
+#ifdef _MSC_VER
+		void* pMemory{ _aligned_malloc(size == 0 ? 1 : size, alignmentSize) };
+#else
+		//aligned_alloc wants the size to be a multiple of the alignment
+		void* pMemory{ std::aligned_alloc(alignmentSize, ((size == 0 ? 1 : size) + alignmentSize - 1) / alignmentSize * alignmentSize) };
+#endif
+
+		if (pMemory)
+			return pMemory;
+
+		throw std::bad_alloc{};
+	}
+
+	void FreeAligned(void* pMemory) noexcept
+	{
+#ifdef _MSC_VER
+		_aligned_free(pMemory);
+#else
+		std::free(pMemory);
+#endif
+	}
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	return AllocateAligned(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+	return AllocateAligned(size, alignment);
+}
+
+void operator delete(void* pMemory, std::align_val_t) noexcept
+{
+	FreeAligned(pMemory);
+}
+
+void operator delete(void* pMemory, std::size_t, std::align_val_t) noexcept
+{
+	FreeAligned(pMemory);
+}
+
+void operator delete[](void* pMemory, std::align_val_t) noexcept
+{
+	FreeAligned(pMemory);
+}
+
+void operator delete[](void* pMemory, std::size_t, std::align_val_t) noexcept
+{
+	FreeAligned(pMemory);
+}
+#endif
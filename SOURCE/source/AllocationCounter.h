@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+
+//Debug builds, and builds that define COUNT_ALLOCATIONS for batch and benchmark runs, replace the global operator new to count every heap allocation,
+//so hot paths that are meant to be allocation free can assert on it and the batch mode can fail when a frame allocates.
+//Release builds keep the default operator new, the OBJ parser and the cache writer allocate from every thread.
+#if defined(_DEBUG) || defined(COUNT_ALLOCATIONS)
+#define ALLOCATION_COUNTER_ENABLED
+#endif
+
+namespace dae
+{
+	namespace AllocationCounter
+	{
+		//Always 0 when the counter is not enabled
+		uint64_t GetAllocationCount();
+
+		constexpr bool IsEnabled()
+		{
+#ifdef ALLOCATION_COUNTER_ENABLED
+			return true;
+#else
+			return false;
+#endif
+		}
+	}
+}
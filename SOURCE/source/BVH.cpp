@@ -0,0 +1,333 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace dae
+{
+#pragma region AABB
+	void AABB::Grow(const Vector3& point)
+	{
+		min = { std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z) };
+		max = { std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z) };
+	}
+
+	void AABB::Grow(const AABB& bounds)
+	{
+		min = { std::min(min.x, bounds.min.x), std::min(min.y, bounds.min.y), std::min(min.z, bounds.min.z) };
+		max = { std::max(max.x, bounds.max.x), std::max(max.y, bounds.max.y), std::max(max.z, bounds.max.z) };
+	}
+
+	Vector3 AABB::GetCenter() const
+	{
+		return (min + max) * 0.5f;
+	}
+
+	float AABB::GetSurfaceArea() const
+	{
+		const Vector3 extent{ max - min };
+		return 2.0f * ((extent.x * extent.y) + (extent.y * extent.z) + (extent.z * extent.x));
+	}
+
+	AABB AABB::Transformed(const Matrix& transform) const
+	{
+		AABB transformedBounds{};
+
+		for (int corner{ 0 }; corner < 8; ++corner)
+		{
+			const Vector3 point{
+				(corner & 1) ? max.x : min.x,
+				(corner & 2) ? max.y : min.y,
+				(corner & 4) ? max.z : min.z };
+
+			transformedBounds.Grow(transform.TransformPoint(point));
+		}
+
+		return transformedBounds;
+	}
+#pragma endregion
+
+#pragma region BVH
+	void BVH::Build(const std::vector<AABB>& primitiveBounds)
+	{
+		Clear();
+
+		const uint32_t primitiveCount{ uint32_t(primitiveBounds.size()) };
+		if (primitiveCount == 0)
+			return;
+
+		//Clear keeps the capacity, so rebuilding a hierarchy of the same size does not allocate
+		m_Centroids.clear();
+		m_Centroids.reserve(primitiveCount);
+
+		m_PrimitiveIndices.reserve(primitiveCount);
+
+		for (uint32_t i{ 0 }; i < primitiveCount; ++i)
+		{
+			m_Centroids.emplace_back(primitiveBounds[i].GetCenter());
+			m_PrimitiveIndices.emplace_back(i);
+		}
+
+		//A binary tree with N leaves never needs more than 2N - 1 nodes
+		m_Nodes.reserve((2 * primitiveCount) - 1);
+
+		BVHNode& root{ m_Nodes.emplace_back() };
+		root.leftFirst = 0;
+		root.primitiveCount = primitiveCount;
+
+		UpdateNodeBounds(0, primitiveBounds);
+		Subdivide(0, 0, primitiveBounds, m_Centroids);
+
+		m_BuildCost = CalculateSAHCost();
+	}
+
+	bool BVH::Restore(std::span<const BVHNode> nodes, std::span<const uint32_t> primitiveIndices, uint32_t primitiveCount)
+	{
+		Clear();
+
+		if (nodes.empty() != (primitiveCount == 0) || primitiveIndices.size() != primitiveCount)
+			return false;
+
+		for (const uint32_t primitiveIndex : primitiveIndices)
+		{
+			if (primitiveIndex >= primitiveCount)
+				return false;
+		}
+
+		//Children always come after their parent, which also rules out cycles and means every parent is checked before its children,
+		//so the depths are final by the time a node is reached. Deeper trees than a build makes would overflow the traversal stacks
+		std::vector<uint32_t> depths(nodes.size(), 0);
+
+		for (size_t nodeIndex{ 0 }; nodeIndex < nodes.size(); ++nodeIndex)
+		{
+			const BVHNode& node{ nodes[nodeIndex] };
+			const bool isValid{ node.IsLeaf()
+				? node.leftFirst <= primitiveCount && node.primitiveCount <= primitiveCount - node.leftFirst
+				: node.leftFirst > nodeIndex && size_t(node.leftFirst) + 1 < nodes.size() && depths[nodeIndex] < MAX_DEPTH };
+
+			if (!isValid)
+				return false;
+
+			if (!node.IsLeaf())
+			{
+				depths[node.leftFirst] = std::max(depths[node.leftFirst], depths[nodeIndex] + 1);
+				depths[node.leftFirst + 1] = std::max(depths[node.leftFirst + 1], depths[nodeIndex] + 1);
+			}
+		}
+
+		m_Nodes.assign(nodes.begin(), nodes.end());
+		m_PrimitiveIndices.assign(primitiveIndices.begin(), primitiveIndices.end());
+		m_BuildCost = CalculateSAHCost();
+		return true;
+	}
+
+	void BVH::Clear()
+	{
+		m_Nodes.clear();
+		m_PrimitiveIndices.clear();
+		m_BuildCost = 0.0f;
+	}
+
+	void BVH::Update(const std::vector<AABB>& primitiveBounds)
+	{
+		if (m_PrimitiveIndices.size() != primitiveBounds.size() || IsEmpty())
+		{
+			Build(primitiveBounds);
+			return;
+		}
+
+		Refit(primitiveBounds);
+
+		if (CalculateSAHCost() > m_BuildCost * m_RebuildThreshold)
+		{
+			Build(primitiveBounds);
+		}
+	}
+
+	void BVH::Refit(const std::vector<AABB>& primitiveBounds)
+	{
+		assert(m_PrimitiveIndices.size() == primitiveBounds.size());
+
+		//Children are always stored after their parent, so walking backwards updates every node after its children
+		for (int nodeIndex{ int(m_Nodes.size()) - 1 }; nodeIndex >= 0; --nodeIndex)
+		{
+			BVHNode& node{ m_Nodes[nodeIndex] };
+
+			if (node.IsLeaf())
+			{
+				UpdateNodeBounds(uint32_t(nodeIndex), primitiveBounds);
+				continue;
+			}
+
+			node.bounds = m_Nodes[node.leftFirst].bounds;
+			node.bounds.Grow(m_Nodes[node.leftFirst + 1].bounds);
+		}
+	}
+
+	float BVH::CalculateSAHCost() const
+	{
+		if (IsEmpty())
+			return 0.0f;
+
+		//Traversal and intersection are weighted equally, relative to the area of the root
+		float cost{ 0.0f };
+
+		for (const BVHNode& node : m_Nodes)
+		{
+			const float area{ node.bounds.GetSurfaceArea() };
+			cost += node.IsLeaf() ? area * GetBlockCount(node.primitiveCount) : area;
+		}
+
+		const float rootArea{ m_Nodes[0].bounds.GetSurfaceArea() };
+		return rootArea > 0.0f ? cost / rootArea : cost;
+	}
+
+	void BVH::UpdateNodeBounds(uint32_t nodeIndex, const std::vector<AABB>& primitiveBounds)
+	{
+		BVHNode& node{ m_Nodes[nodeIndex] };
+		node.bounds = AABB{};
+
+		for (uint32_t i{ 0 }; i < node.primitiveCount; ++i)
+		{
+			node.bounds.Grow(primitiveBounds[m_PrimitiveIndices[node.leftFirst + i]]);
+		}
+	}
+
+	void BVH::Subdivide(uint32_t nodeIndex, uint32_t depth, const std::vector<AABB>& primitiveBounds, const std::vector<Vector3>& centroids)
+	{
+		//The depth limit keeps the fixed size traversal stacks from overflowing on degenerate input
+		if (m_Nodes[nodeIndex].primitiveCount <= m_LeafBlockSize || depth >= MAX_DEPTH)
+			return;
+
+		int axis{ 0 };
+		float splitPosition{ 0.0f };
+		const float splitCost{ FindBestSplit(m_Nodes[nodeIndex], primitiveBounds, centroids, axis, splitPosition) };
+		const float leafCost{ GetBlockCount(m_Nodes[nodeIndex].primitiveCount) * m_Nodes[nodeIndex].bounds.GetSurfaceArea() };
+
+		if (splitCost >= leafCost)
+			return;
+
+		//Partition the primitives in place around the split plane
+		const uint32_t first{ m_Nodes[nodeIndex].leftFirst };
+		const uint32_t count{ m_Nodes[nodeIndex].primitiveCount };
+
+		int i{ int(first) };
+		int j{ int(first + count) - 1 };
+
+		while (i <= j)
+		{
+			if (centroids[m_PrimitiveIndices[i]][axis] < splitPosition)
+			{
+				++i;
+			}
+			else
+			{
+				std::swap(m_PrimitiveIndices[i], m_PrimitiveIndices[j]);
+				--j;
+			}
+		}
+
+		const uint32_t leftCount{ uint32_t(i) - first };
+		if (leftCount == 0 || leftCount == count)
+			return;
+
+		const uint32_t leftChildIndex{ uint32_t(m_Nodes.size()) };
+		const uint32_t rightChildIndex{ leftChildIndex + 1 };
+
+		BVHNode& leftChild{ m_Nodes.emplace_back() };
+		leftChild.leftFirst = first;
+		leftChild.primitiveCount = leftCount;
+
+		BVHNode& rightChild{ m_Nodes.emplace_back() };
+		rightChild.leftFirst = uint32_t(i);
+		rightChild.primitiveCount = count - leftCount;
+
+		m_Nodes[nodeIndex].leftFirst = leftChildIndex;
+		m_Nodes[nodeIndex].primitiveCount = 0;
+
+		UpdateNodeBounds(leftChildIndex, primitiveBounds);
+		UpdateNodeBounds(rightChildIndex, primitiveBounds);
+
+		Subdivide(leftChildIndex, depth + 1, primitiveBounds, centroids);
+		Subdivide(rightChildIndex, depth + 1, primitiveBounds, centroids);
+	}
+
+	float BVH::FindBestSplit(const BVHNode& node, const std::vector<AABB>& primitiveBounds, const std::vector<Vector3>& centroids, int& axis, float& splitPosition) const
+	{
+		struct Bin
+		{
+			AABB bounds{};
+			uint32_t primitiveCount{ 0 };
+		};
+
+		float bestCost{ FLT_MAX };
+
+		AABB centroidBounds{};
+		for (uint32_t i{ 0 }; i < node.primitiveCount; ++i)
+		{
+			centroidBounds.Grow(centroids[m_PrimitiveIndices[node.leftFirst + i]]);
+		}
+
+		for (int currentAxis{ 0 }; currentAxis < 3; ++currentAxis)
+		{
+			const float boundsMin{ centroidBounds.min[currentAxis] };
+			const float boundsMax{ centroidBounds.max[currentAxis] };
+
+			if (boundsMin == boundsMax)
+				continue;
+
+			Bin bins[m_BinCount]{};
+			const float binScale{ m_BinCount / (boundsMax - boundsMin) };
+
+			for (uint32_t i{ 0 }; i < node.primitiveCount; ++i)
+			{
+				const uint32_t primitiveIndex{ m_PrimitiveIndices[node.leftFirst + i] };
+				const int binIndex{ std::min(m_BinCount - 1, int((centroids[primitiveIndex][currentAxis] - boundsMin) * binScale)) };
+
+				++bins[binIndex].primitiveCount;
+				bins[binIndex].bounds.Grow(primitiveBounds[primitiveIndex]);
+			}
+
+			//Sweep from both sides to get the area and count left and right of every bin boundary
+			float leftAreas[m_BinCount - 1]{};
+			float rightAreas[m_BinCount - 1]{};
+			uint32_t leftCounts[m_BinCount - 1]{};
+			uint32_t rightCounts[m_BinCount - 1]{};
+
+			AABB leftBounds{};
+			AABB rightBounds{};
+			uint32_t leftSum{ 0 };
+			uint32_t rightSum{ 0 };
+
+			for (int i{ 0 }; i < m_BinCount - 1; ++i)
+			{
+				leftSum += bins[i].primitiveCount;
+				leftCounts[i] = leftSum;
+				leftBounds.Grow(bins[i].bounds);
+				leftAreas[i] = leftSum > 0 ? leftBounds.GetSurfaceArea() : 0.0f;
+
+				rightSum += bins[m_BinCount - 1 - i].primitiveCount;
+				rightCounts[m_BinCount - 2 - i] = rightSum;
+				rightBounds.Grow(bins[m_BinCount - 1 - i].bounds);
+				rightAreas[m_BinCount - 2 - i] = rightSum > 0 ? rightBounds.GetSurfaceArea() : 0.0f;
+			}
+
+			const float binWidth{ (boundsMax - boundsMin) / m_BinCount };
+
+			for (int i{ 0 }; i < m_BinCount - 1; ++i)
+			{
+				const float cost{ (GetBlockCount(leftCounts[i]) * leftAreas[i]) + (GetBlockCount(rightCounts[i]) * rightAreas[i]) };
+
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					axis = currentAxis;
+					splitPosition = boundsMin + (binWidth * (i + 1));
+				}
+			}
+		}
+
+		return bestCost;
+	}
+#pragma endregion
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Math.h"
+
+namespace dae
+{
+	struct AABB
+	{
+		Vector3 min{ FLT_MAX, FLT_MAX, FLT_MAX };
+		Vector3 max{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		void Grow(const Vector3& point);
+		void Grow(const AABB& bounds);
+
+		Vector3 GetCenter() const;
+		float GetSurfaceArea() const;
+
+		//Bounds of the 8 transformed corners
+		AABB Transformed(const Matrix& transform) const;
+	};
+
+	struct BVHNode
+	{
+		AABB bounds{};
+
+		//Index of the left child (right child is leftFirst + 1) for inner nodes,
+		//index of the first primitive in the primitive index list for leaves
+		uint32_t leftFirst{ 0 };
+		uint32_t primitiveCount{ 0 };
+
+		inline bool IsLeaf() const { return primitiveCount > 0; }
+	};
+
+	//Bounding Volume Hierarchy built with the (binned) Surface Area Heuristic.
+	//Only knows about the bounds of the primitives it is built over, so it can be used for triangles as well as whole objects.
+	class BVH final
+	{
+	public:
+		//Leaves are never deeper than this (the root is at depth 0), nodes at the limit become leaves no matter how many primitives they hold
+		static constexpr uint32_t MAX_DEPTH{ 63 };
+		//Depth first traversals keep at most one pending sibling per level plus both children of the deepest inner node
+		static constexpr uint32_t TRAVERSAL_STACK_SIZE{ MAX_DEPTH + 1 };
+
+		BVH() = default;
+
+		void Build(const std::vector<AABB>& primitiveBounds);
+		void Clear();
+
+		//Takes over the nodes and primitive indices of a hierarchy that was built over primitiveCount primitives before (with the same leaf block size),
+		//instead of building it again. Returns false and stays empty when they do not form a valid hierarchy over that many primitives or it is deeper than MAX_DEPTH
+		bool Restore(std::span<const BVHNode> nodes, std::span<const uint32_t> primitiveIndices, uint32_t primitiveCount);
+
+		//Refits the node bounds to the moved primitives, only rebuilds when the topology no longer matches
+		//or when the SAH cost has degraded past the rebuild threshold compared to the last full build
+		void Update(const std::vector<AABB>& primitiveBounds);
+		void Refit(const std::vector<AABB>& primitiveBounds);
+		float CalculateSAHCost() const;
+
+		inline void SetRebuildThreshold(float costRatio) { m_RebuildThreshold = costRatio; }
+
+		//Leaves are tested blockSize primitives at a time (SIMD), so the SAH counts whole blocks and leaves that fit in one block are not split further.
+		//Only takes effect on the next full build.
+		inline void SetLeafBlockSize(uint32_t blockSize) { m_LeafBlockSize = blockSize > 0 ? blockSize : 1; }
+		inline uint32_t GetLeafBlockSize() const { return m_LeafBlockSize; }
+		inline float GetBuildCost() const { return m_BuildCost; }
+
+		inline bool IsEmpty() const { return m_Nodes.empty(); }
+		inline const AABB& GetBounds() const { return m_Nodes[0].bounds; }
+		inline const std::vector<BVHNode>& GetNodes() const { return m_Nodes; }
+		inline const std::vector<uint32_t>& GetPrimitiveIndices() const { return m_PrimitiveIndices; }
+
+	private:
+		static constexpr int m_BinCount{ 12 };
+
+		inline uint32_t GetBlockCount(uint32_t primitiveCount) const { return (primitiveCount + m_LeafBlockSize - 1) / m_LeafBlockSize; }
+
+		void UpdateNodeBounds(uint32_t nodeIndex, const std::vector<AABB>& primitiveBounds);
+		void Subdivide(uint32_t nodeIndex, uint32_t depth, const std::vector<AABB>& primitiveBounds, const std::vector<Vector3>& centroids);
+		float FindBestSplit(const BVHNode& node, const std::vector<AABB>& primitiveBounds, const std::vector<Vector3>& centroids, int& axis, float& splitPosition) const;
+
+		std::vector<BVHNode> m_Nodes{};
+		std::vector<uint32_t> m_PrimitiveIndices{};
+		std::vector<Vector3> m_Centroids{};
+
+		float m_BuildCost{ 0.0f };
+		float m_RebuildThreshold{ 1.5f };
+		uint32_t m_LeafBlockSize{ 1 };
+	};
+
+	/**
+	 * \brief Packs the primitives of every leaf into consecutive SIMD blocks, in the order the leaf references them
+	 * \param getPrimitive callable returning the primitive (or a reference to it) with the given primitive index
+	 * \param blocks Block type with a static laneCount and SetLane(lane, primitive), default constructed lanes must never report a hit
+	 * \param leafFirstBlocks first block of every leaf, indexed by node
+	 */
+	template<typename Block, typename GetPrimitive>
+	void PackLeafBlocks(const BVH& bvh, GetPrimitive&& getPrimitive, std::vector<Block>& blocks, std::vector<uint32_t>& leafFirstBlocks)
+	{
+		const std::vector<BVHNode>& nodes{ bvh.GetNodes() };
+		const std::vector<uint32_t>& primitiveIndices{ bvh.GetPrimitiveIndices() };
+
+		blocks.clear();
+		leafFirstBlocks.assign(nodes.size(), 0);
+
+		for (size_t nodeIndex{ 0 }; nodeIndex < nodes.size(); ++nodeIndex)
+		{
+			const BVHNode& node{ nodes[nodeIndex] };
+			if (!node.IsLeaf())
+				continue;
+
+			leafFirstBlocks[nodeIndex] = uint32_t(blocks.size());
+
+			for (uint32_t i{ 0 }; i < node.primitiveCount; ++i)
+			{
+				if (i % Block::laneCount == 0)
+					blocks.emplace_back();
+
+				blocks.back().SetLane(i % Block::laneCount, getPrimitive(primitiveIndices[node.leftFirst + i]));
+			}
+		}
+	}
+}
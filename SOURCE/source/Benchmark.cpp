@@ -0,0 +1,570 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "AllocationCounter.h"
+#include "Material.h"
+#include "Microbenchmarks.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "Sphere.h"
+#include "Timer.h"
+
+namespace dae
+{
+	namespace Benchmark
+	{
+		namespace
+		{
+			using Clock = std::chrono::steady_clock;
+
+			//Default steps of --scaling
+			const std::vector<uint32_t> PRIMITIVE_SCALING_COUNTS{ 1000, 10000, 100000, 1000000 };
+			const std::vector<uint32_t> LIGHT_SCALING_COUNTS{ 1, 2, 4, 8, 16, 32, 64 };
+
+			bool ParseUnsigned(const char* pText, uint32_t& value)
+			{
+				char* pEnd{ nullptr };
+				const unsigned long parsedValue{ std::strtoul(pText, &pEnd, 10) };
+
+				if (pEnd == pText || *pEnd != '\0')
+					return false;
+
+				value = uint32_t(parsedValue);
+				return true;
+			}
+
+			//Comma separated, e.g. 1000,10000,100000
+			bool ParseUnsignedList(const char* pText, std::vector<uint32_t>& values)
+			{
+				values.clear();
+
+				for (const char* pCurrent{ pText };; )
+				{
+					char* pEnd{ nullptr };
+					const unsigned long value{ std::strtoul(pCurrent, &pEnd, 10) };
+
+					if (pEnd == pCurrent || (*pEnd != ',' && *pEnd != '\0'))
+						return false;
+
+					values.push_back(uint32_t(value));
+
+					if (*pEnd == '\0')
+						return true;
+
+					pCurrent = pEnd + 1;
+				}
+			}
+
+			bool ParseBRDFMode(const std::string& name, BRDFMode& brdfMode)
+			{
+				if (name == "reference")
+					brdfMode = BRDFMode::Reference;
+				else if (name == "fast")
+					brdfMode = BRDFMode::Fast;
+				else
+					return false;
+
+				return true;
+			}
+
+			bool ParseResolution(const char* pText, uint32_t& width, uint32_t& height)
+			{
+				char* pEnd{ nullptr };
+				const unsigned long parsedWidth{ std::strtoul(pText, &pEnd, 10) };
+
+				if (pEnd == pText || (*pEnd != 'x' && *pEnd != 'X'))
+					return false;
+
+				const char* pHeight{ pEnd + 1 };
+				const unsigned long parsedHeight{ std::strtoul(pHeight, &pEnd, 10) };
+
+				if (pEnd == pHeight || *pEnd != '\0' || parsedWidth == 0 || parsedHeight == 0)
+					return false;
+
+				width = uint32_t(parsedWidth);
+				height = uint32_t(parsedHeight);
+				return true;
+			}
+
+			//Resident set size of the process, 0 when it can not be queried
+			uint64_t GetResidentMemoryBytes()
+			{
+#if defined(_WIN32)
+				PROCESS_MEMORY_COUNTERS memoryCounters{};
+				if (GetProcessMemoryInfo(GetCurrentProcess(), &memoryCounters, sizeof(memoryCounters)))
+					return memoryCounters.WorkingSetSize;
+
+				return 0;
+#else
+				std::ifstream statm{ "/proc/self/statm" };
+				uint64_t totalPages{ 0 };
+				uint64_t residentPages{ 0 };
+
+				if (!(statm >> totalPages >> residentPages))
+					return 0;
+
+				return residentPages * uint64_t(sysconf(_SC_PAGESIZE));
+#endif
+			}
+
+			//Animates the scene like the windowed loop does and watches the resident memory, which has to level off after the first frames
+			int RunSoakTest(const Settings& settings, Scene& scene, Renderer& renderer)
+			{
+				//Allowed growth after the warm-up, allocator noise stays well below this
+				constexpr uint64_t maxMemoryGrowth{ 4 * 1024 * 1024 };
+				constexpr uint32_t sampleInterval{ 1000 };
+
+				Timer timer{};
+				timer.Start();
+
+				const uint32_t warmUpFrameCount{ std::min(settings.frameCount / 10, 100u) };
+				uint64_t baselineMemory{ 0 };
+				uint64_t peakMemory{ 0 };
+
+				//Only counts the frames themselves, reading the memory usage allocates too
+				uint64_t allocationCountAfterWarmUp{ 0 };
+
+				for (uint32_t frame{ 0 }; frame < settings.frameCount; ++frame)
+				{
+					const uint64_t allocationCountBefore{ AllocationCounter::GetAllocationCount() };
+
+					timer.Update();
+					scene.Update(&timer);
+					renderer.Render(&scene);
+
+					if (frame >= warmUpFrameCount)
+						allocationCountAfterWarmUp += AllocationCounter::GetAllocationCount() - allocationCountBefore;
+
+					if (frame + 1 == warmUpFrameCount || (warmUpFrameCount == 0 && frame == 0))
+					{
+						baselineMemory = GetResidentMemoryBytes();
+						peakMemory = baselineMemory;
+					}
+					else if (frame % sampleInterval == 0 || frame + 1 == settings.frameCount)
+					{
+						peakMemory = std::max(peakMemory, GetResidentMemoryBytes());
+					}
+				}
+
+				const uint64_t endMemory{ GetResidentMemoryBytes() };
+				peakMemory = std::max(peakMemory, endMemory);
+
+				//Updating and rendering the scene has to stay allocation free once everything is sized
+				const bool hasPassed{ peakMemory <= baselineMemory + maxMemoryGrowth && allocationCountAfterWarmUp == 0 };
+
+				std::cout << "scene=" << settings.sceneName << "\n";
+				std::cout << "frames=" << settings.frameCount << "\n";
+				std::cout << "rss_baseline_kb=" << (baselineMemory / 1024) << "\n";
+				std::cout << "rss_peak_kb=" << (peakMemory / 1024) << "\n";
+				std::cout << "rss_end_kb=" << (endMemory / 1024) << "\n";
+				std::cout << "allocation_counter=" << AllocationCounter::IsEnabled() << "\n";
+				std::cout << "allocations_after_warm_up=" << allocationCountAfterWarmUp << "\n";
+				std::cout << "soak=" << (hasPassed ? "passed" : "failed") << std::endl;
+
+				return hasPassed ? 0 : 1;
+			}
+
+			void ConfigureRenderer(const Settings& settings, Renderer& renderer)
+			{
+				renderer.SetPacketTracing(settings.isPacketTracingEnabled);
+				renderer.SetOccluderCache(settings.isOccluderCacheEnabled);
+				renderer.SetMaterialGrouping(settings.isMaterialGroupingEnabled);
+
+				BRDFMode brdfMode{};
+				ParseBRDFMode(settings.brdfModeName, brdfMode);
+				renderer.SetBRDFMode(brdfMode);
+				renderer.SetProgressive(settings.isProgressive);
+			}
+
+			//Returns false when the scene could not be initialized, see Scene::GetError
+			bool InitializeScene(Scene& scene, double& loadTime)
+			{
+				const Clock::time_point loadStart{ Clock::now() };
+				scene.Initialize();
+				loadTime = std::chrono::duration<double, std::milli>(Clock::now() - loadStart).count();
+
+				if (!scene.GetError().empty())
+				{
+					std::cout << "Could not load scene " << scene.GetError() << std::endl;
+					return false;
+				}
+
+				return true;
+			}
+
+			struct FrameTimes
+			{
+				double minFrameTime{ DBL_MAX };
+				double maxFrameTime{ 0.0 };
+				double totalFrameTime{ 0.0 };
+				uint32_t frameCount{ 0 };
+				RenderStatistics statistics{};
+				//Heap allocations during the timed frames, anything but 0 fails the run
+				uint64_t allocationCount{ 0 };
+
+				double GetAverageFrameTime() const
+				{
+					return frameCount > 0 ? totalFrameTime / frameCount : 0.0;
+				}
+
+				double GetMegaRaysPerSecond() const
+				{
+					const uint64_t totalRayCount{ statistics.primaryRayCount + statistics.shadowRayCount };
+					return totalFrameTime > 0.0 ? (double(totalRayCount) / (totalFrameTime * 1000.0)) : 0.0;
+				}
+			};
+
+			//The scene is never updated, so every frame traces exactly the same rays.
+			//One untimed frame first, so the worker threads are running and the caches are warm.
+			FrameTimes RenderFrames(const Settings& settings, Scene& scene, Renderer& renderer)
+			{
+				renderer.Render(&scene);
+
+				FrameTimes frameTimes{};
+				for (uint32_t frame{ 0 }; frame < settings.frameCount; ++frame)
+				{
+					const uint64_t allocationCountBefore{ AllocationCounter::GetAllocationCount() };
+					const Clock::time_point frameStart{ Clock::now() };
+					renderer.Render(&scene);
+					const double frameTime{ std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count() };
+					frameTimes.allocationCount += AllocationCounter::GetAllocationCount() - allocationCountBefore;
+
+					frameTimes.minFrameTime = std::min(frameTimes.minFrameTime, frameTime);
+					frameTimes.maxFrameTime = std::max(frameTimes.maxFrameTime, frameTime);
+					frameTimes.totalFrameTime += frameTime;
+					frameTimes.statistics.Add(renderer.GetFrameStatistics());
+					++frameTimes.frameCount;
+				}
+
+				return frameTimes;
+			}
+
+			//Renders a generated scene per step and prints one line of "key=value" pairs for each, so they can be plotted against the swept count.
+			//The steps run one after the other in this process, rss_kb is the resident memory after the frames of a step and is most telling when the counts grow.
+			int RunScalingBenchmark(const Settings& settings)
+			{
+				const bool isPrimitiveScaling{ settings.scalingName == "primitives" };
+				const uint64_t baseObjectCount{ uint64_t(settings.generator.sphereCount) + settings.generator.meshInstanceCount };
+
+				std::cout << "scaling=" << settings.scalingName << "\n";
+				std::cout << "width=" << settings.width << "\n";
+				std::cout << "height=" << settings.height << "\n";
+				std::cout << "frames=" << settings.frameCount << "\n";
+				std::cout << "seed=" << settings.generator.seed << "\n";
+				std::cout << "materials=" << settings.generator.materialCount << std::endl;
+
+				for (const uint32_t count : settings.scalingCounts)
+				{
+					SceneGenerator::Settings generatorSettings{ settings.generator };
+					if (isPrimitiveScaling)
+					{
+						//Keeps the ratio of spheres to mesh instances
+						generatorSettings.sphereCount = baseObjectCount > 0 ? uint32_t(uint64_t(count) * settings.generator.sphereCount / baseObjectCount) : count;
+						generatorSettings.meshInstanceCount = count - generatorSettings.sphereCount;
+					}
+					else
+						generatorSettings.lightCount = count;
+
+					Scene_File scene{ "generated.scene", SceneGenerator::Generate(generatorSettings) };
+
+					double loadTime{ 0.0 };
+					if (!InitializeScene(scene, loadTime))
+						return 1;
+
+					Renderer renderer{ settings.width, settings.height, settings.threadCount };
+					ConfigureRenderer(settings, renderer);
+
+					const FrameTimes frameTimes{ RenderFrames(settings, scene, renderer) };
+
+					std::cout << "spheres=" << generatorSettings.sphereCount
+						<< " instances=" << generatorSettings.meshInstanceCount
+						<< " instanced_triangles=" << (uint64_t(generatorSettings.meshInstanceCount) * SceneGenerator::MESH_TRIANGLE_COUNT)
+						<< " lights=" << generatorSettings.lightCount
+						<< " scene_load_ms=" << loadTime
+						<< " frame_ms_min=" << frameTimes.minFrameTime
+						<< " frame_ms_avg=" << frameTimes.GetAverageFrameTime()
+						<< " mrays_per_s=" << frameTimes.GetMegaRaysPerSecond()
+						<< " frame_allocations=" << frameTimes.allocationCount
+						<< " rss_kb=" << (GetResidentMemoryBytes() / 1024) << std::endl;
+
+					if (frameTimes.allocationCount > 0)
+					{
+						std::cout << "Heap allocations while rendering frames" << std::endl;
+						return 1;
+					}
+				}
+
+				return 0;
+			}
+
+			void PrintUsage()
+			{
+				std::cout << "Usage: RayTracer --batch [--scene W4|file.scene] [--resolution 640x480] [--frames 100] [--threads 0] [--output frame.bmp] [--soak] [--single-rays] [--no-occluder-cache] [--brdf fast] [--material-grouping] [--progressive]\n";
+				std::cout << "                         [--spheres 900] [--instances 100] [--lights 4] [--materials 16] [--seed 1337] [--write-scene file.scene] [--scaling primitives|lights] [--scaling-counts 1000,10000]\n";
+				std::cout << "       RayTracer --microbenchmark <name> [--iterations 10]\n";
+				Microbenchmarks::PrintNames();
+			}
+		}
+
+		bool IsBatchMode(int argc, char* args[])
+		{
+			for (int i{ 1 }; i < argc; ++i)
+			{
+				if (std::strcmp(args[i], "--batch") == 0 || std::strcmp(args[i], "--microbenchmark") == 0)
+					return true;
+			}
+
+			return false;
+		}
+
+		bool ParseArguments(int argc, char* args[], Settings& settings)
+		{
+			bool hasFrameCount{ false };
+
+			for (int i{ 1 }; i < argc; ++i)
+			{
+				const char* pArgument{ args[i] };
+
+				if (std::strcmp(pArgument, "--batch") == 0)
+					continue;
+
+				if (std::strcmp(pArgument, "--soak") == 0)
+				{
+					settings.isSoakTest = true;
+					continue;
+				}
+
+				if (std::strcmp(pArgument, "--single-rays") == 0)
+				{
+					settings.isPacketTracingEnabled = false;
+					continue;
+				}
+
+				if (std::strcmp(pArgument, "--no-occluder-cache") == 0)
+				{
+					settings.isOccluderCacheEnabled = false;
+					continue;
+				}
+
+				if (std::strcmp(pArgument, "--material-grouping") == 0)
+				{
+					settings.isMaterialGroupingEnabled = true;
+					continue;
+				}
+
+				if (std::strcmp(pArgument, "--progressive") == 0)
+				{
+					settings.isProgressive = true;
+					continue;
+				}
+
+				//Every other option takes a value
+				if (i + 1 >= argc)
+				{
+					std::cout << "Missing value for " << pArgument << "\n";
+					PrintUsage();
+					return false;
+				}
+
+				const char* pValue{ args[++i] };
+				bool isValid{ true };
+
+				if (std::strcmp(pArgument, "--scene") == 0)
+					settings.sceneName = pValue;
+				else if (std::strcmp(pArgument, "--resolution") == 0)
+					isValid = ParseResolution(pValue, settings.width, settings.height);
+				else if (std::strcmp(pArgument, "--frames") == 0)
+				{
+					isValid = ParseUnsigned(pValue, settings.frameCount) && settings.frameCount > 0;
+					hasFrameCount = true;
+				}
+				else if (std::strcmp(pArgument, "--threads") == 0)
+					isValid = ParseUnsigned(pValue, settings.threadCount);
+				else if (std::strcmp(pArgument, "--output") == 0)
+					settings.outputPath = pValue;
+				else if (std::strcmp(pArgument, "--microbenchmark") == 0)
+					settings.microbenchmarkName = pValue;
+				else if (std::strcmp(pArgument, "--brdf") == 0)
+				{
+					BRDFMode brdfMode{};
+					settings.brdfModeName = pValue;
+					isValid = ParseBRDFMode(settings.brdfModeName, brdfMode);
+				}
+				else if (std::strcmp(pArgument, "--iterations") == 0)
+					isValid = ParseUnsigned(pValue, settings.iterations) && settings.iterations > 0;
+				else if (std::strcmp(pArgument, "--spheres") == 0)
+				{
+					isValid = ParseUnsigned(pValue, settings.generator.sphereCount);
+					settings.isGeneratedScene = true;
+				}
+				else if (std::strcmp(pArgument, "--instances") == 0)
+				{
+					isValid = ParseUnsigned(pValue, settings.generator.meshInstanceCount);
+					settings.isGeneratedScene = true;
+				}
+				else if (std::strcmp(pArgument, "--lights") == 0)
+				{
+					isValid = ParseUnsigned(pValue, settings.generator.lightCount) && settings.generator.lightCount > 0;
+					settings.isGeneratedScene = true;
+				}
+				else if (std::strcmp(pArgument, "--materials") == 0)
+				{
+					isValid = ParseUnsigned(pValue, settings.generator.materialCount) && settings.generator.materialCount > 0
+						&& settings.generator.materialCount <= SceneGenerator::MAX_MATERIAL_COUNT;
+					settings.isGeneratedScene = true;
+				}
+				else if (std::strcmp(pArgument, "--seed") == 0)
+				{
+					isValid = ParseUnsigned(pValue, settings.generator.seed);
+					settings.isGeneratedScene = true;
+				}
+				else if (std::strcmp(pArgument, "--write-scene") == 0)
+				{
+					settings.generatedScenePath = pValue;
+					settings.isGeneratedScene = true;
+				}
+				else if (std::strcmp(pArgument, "--scaling") == 0)
+				{
+					settings.scalingName = pValue;
+					isValid = settings.scalingName == "primitives" || settings.scalingName == "lights";
+				}
+				else if (std::strcmp(pArgument, "--scaling-counts") == 0)
+					isValid = ParseUnsignedList(pValue, settings.scalingCounts);
+				else
+				{
+					std::cout << "Unknown argument " << pArgument << "\n";
+					PrintUsage();
+					return false;
+				}
+
+				if (!isValid)
+				{
+					std::cout << "Invalid value " << pValue << " for " << pArgument << "\n";
+					PrintUsage();
+					return false;
+				}
+			}
+
+			if (settings.isSoakTest && !hasFrameCount)
+				settings.frameCount = 100000;
+
+			if (settings.isGeneratedScene)
+				settings.sceneName = "generated";
+
+			if (settings.scalingCounts.empty())
+				settings.scalingCounts = settings.scalingName == "lights" ? LIGHT_SCALING_COUNTS : PRIMITIVE_SCALING_COUNTS;
+			else if (settings.scalingName == "lights" && std::find(settings.scalingCounts.begin(), settings.scalingCounts.end(), 0u) != settings.scalingCounts.end())
+			{
+				std::cout << "Light counts have to be at least 1\n";
+				return false;
+			}
+
+			return true;
+		}
+
+		int Run(const Settings& settings)
+		{
+			if (!settings.microbenchmarkName.empty())
+			{
+				if (Microbenchmarks::Run(settings.microbenchmarkName, settings.iterations))
+					return 0;
+
+				std::cout << "Unknown microbenchmark " << settings.microbenchmarkName << "\n";
+				Microbenchmarks::PrintNames();
+				return 1;
+			}
+
+			if (!settings.scalingName.empty())
+				return RunScalingBenchmark(settings);
+
+			if (!settings.generatedScenePath.empty())
+			{
+				if (!SceneGenerator::Write(settings.generatedScenePath, settings.generator))
+				{
+					std::cout << "Could not write " << settings.generatedScenePath << std::endl;
+					return 1;
+				}
+
+				std::cout << "scene_file=" << settings.generatedScenePath << std::endl;
+				return 0;
+			}
+
+			const std::unique_ptr<Scene> pScene{ settings.isGeneratedScene
+				? std::make_unique<Scene_File>("generated.scene", SceneGenerator::Generate(settings.generator))
+				: CreateScene(settings.sceneName) };
+
+			if (!pScene)
+			{
+				std::cout << "Unknown scene " << settings.sceneName << "\n";
+				return 1;
+			}
+
+			double loadTime{ 0.0 };
+			if (!InitializeScene(*pScene, loadTime))
+				return 1;
+
+			Renderer renderer{ settings.width, settings.height, settings.threadCount };
+			ConfigureRenderer(settings, renderer);
+
+			if (settings.isSoakTest)
+				return RunSoakTest(settings, *pScene, renderer);
+
+			const FrameTimes frameTimes{ RenderFrames(settings, *pScene, renderer) };
+			const RenderStatistics& totalStatistics{ frameTimes.statistics };
+
+			std::cout << "scene=" << settings.sceneName << "\n";
+			std::cout << "scene_load_ms=" << loadTime << "\n";
+			std::cout << "width=" << settings.width << "\n";
+			std::cout << "height=" << settings.height << "\n";
+			std::cout << "frames=" << settings.frameCount << "\n";
+			std::cout << "threads=" << renderer.GetThreadCount() << "\n";
+			std::cout << "packets=" << settings.isPacketTracingEnabled << "\n";
+			std::cout << "occluder_cache=" << settings.isOccluderCacheEnabled << "\n";
+			std::cout << "brdf=" << settings.brdfModeName << "\n";
+			std::cout << "material_grouping=" << settings.isMaterialGroupingEnabled << "\n";
+			std::cout << "progressive=" << settings.isProgressive << "\n";
+			std::cout << "accumulated_frames=" << renderer.GetAccumulatedFrameCount() << "\n";
+			std::cout << "frame_ms_min=" << frameTimes.minFrameTime << "\n";
+			std::cout << "frame_ms_avg=" << frameTimes.GetAverageFrameTime() << "\n";
+			std::cout << "frame_ms_max=" << frameTimes.maxFrameTime << "\n";
+			std::cout << "mrays_per_s=" << frameTimes.GetMegaRaysPerSecond() << "\n";
+			std::cout << "primary_rays=" << totalStatistics.primaryRayCount << "\n";
+			std::cout << "shadow_rays=" << totalStatistics.shadowRayCount << "\n";
+			std::cout << "occluder_cache_tests=" << totalStatistics.occluderCacheTestCount << "\n";
+			std::cout << "occluder_cache_hits=" << totalStatistics.occluderCacheHitCount << "\n";
+			std::cout << "occluder_cache_hit_rate=" << (totalStatistics.occluderCacheTestCount > 0 ? double(totalStatistics.occluderCacheHitCount) / double(totalStatistics.occluderCacheTestCount) : 0.0) << "\n";
+			std::cout << "allocation_counter=" << AllocationCounter::IsEnabled() << "\n";
+			std::cout << "frame_allocations=" << frameTimes.allocationCount << std::endl;
+
+			if (frameTimes.allocationCount > 0)
+			{
+				std::cout << "Heap allocations while rendering frames" << std::endl;
+				return 1;
+			}
+
+			if (!settings.outputPath.empty() && !renderer.SaveBufferToImage(settings.outputPath))
+			{
+				std::cout << "Could not save " << settings.outputPath << std::endl;
+				return 1;
+			}
+
+			return 0;
+		}
+	}
+}
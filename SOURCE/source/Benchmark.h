@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SceneGenerator.h"
+
+namespace dae
+{
+	//Headless batch rendering from the command line, prints the timings as "key=value" lines so they can be collected across builds and machines.
+	//Usage: RayTracer --batch [--scene W4|file.scene] [--resolution 640x480] [--frames 100] [--threads 0] [--output frame.bmp] [--soak] [--single-rays] [--no-occluder-cache] [--brdf fast] [--material-grouping] [--progressive]
+	//                         [--spheres 900] [--instances 100] [--lights 4] [--materials 16] [--seed 1337] [--write-scene file.scene] [--scaling primitives|lights] [--scaling-counts 1000,10000]
+	//       RayTracer --microbenchmark <name> [--iterations 10]
+	namespace Benchmark
+	{
+		struct Settings
+		{
+			//W1 to W4 or a scene file, see CreateScene
+			std::string sceneName{ "W4" };
+			uint32_t width{ 640 };
+			uint32_t height{ 480 };
+			uint32_t frameCount{ 100 };
+			uint32_t threadCount{ 0 };
+
+			//The last frame is saved as BMP when not empty
+			std::string outputPath{};
+
+			//Updates (animates) the scene every frame and fails when the resident memory keeps growing,
+			//runs 100000 frames unless --frames is given
+			bool isSoakTest{ false };
+
+			//Traces every primary ray on its own instead of in packets, to compare both
+			bool isPacketTracingEnabled{ true };
+			//Traces every shadow ray fully instead of testing the last occluder of its light first
+			bool isOccluderCacheEnabled{ true };
+			//reference or fast, see BRDFMode
+			std::string brdfModeName{ "fast" };
+			//Shades the hits of a tile grouped by material type, see Renderer::SetMaterialGrouping
+			bool isMaterialGroupingEnabled{ false };
+			//Accumulates the frames like the progressive mode of the window, the unchanged scene converges after Renderer::maxAccumulatedFrameCount frames
+			bool isProgressive{ false };
+
+			//Renders a SceneGenerator scene instead of sceneName when any of its settings is given
+			bool isGeneratedScene{ false };
+			SceneGenerator::Settings generator{};
+			//Writes the generated scene to this file instead of rendering it when not empty
+			std::string generatedScenePath{};
+
+			//primitives or lights, renders a generated scene for every one of scalingCounts and prints one line per scene.
+			//primitives sets the amount of spheres plus mesh instances (in the ratio of the generator settings), lights the amount of lights.
+			std::string scalingName{};
+			std::vector<uint32_t> scalingCounts{};
+
+			//Runs one of the Microbenchmarks instead of rendering when not empty
+			std::string microbenchmarkName{};
+			uint32_t iterations{ 10 };
+		};
+
+		bool IsBatchMode(int argc, char* args[]);
+
+		/**
+		 * \brief Parses the batch mode arguments, unknown or malformed arguments are reported and make it fail
+		 * \return false when the arguments are invalid
+		 */
+		bool ParseArguments(int argc, char* args[], Settings& settings);
+
+		//Returns the process exit code
+		int Run(const Settings& settings);
+	}
+}
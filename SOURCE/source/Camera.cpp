@@ -29,6 +29,10 @@ namespace dae
 	{
 		const float deltaTime = pTimer->GetElapsed();
 
+		const Vector3 previousOrigin{ m_Origin };
+		const float previousYaw{ m_TotalYaw };
+		const float previousPitch{ m_TotalPitch };
+
 		//Keyboard Input
 		const uint8_t* pKeyboardState = SDL_GetKeyboardState(nullptr);
 
@@ -76,6 +80,10 @@ namespace dae
 
 			m_Origin += movementDirection.Normalized() * m_CameraMovementSpeed * deltaTime;
 		}
+
+		if (m_Origin != previousOrigin || m_TotalYaw != previousYaw || m_TotalPitch != previousPitch)
+			++m_Version;
+
 		CalculateCameraToWorld();
 	}
 }
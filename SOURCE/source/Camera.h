@@ -16,10 +16,12 @@ namespace dae
 		void Update(Timer* pTimer);
 		Matrix CalculateCameraToWorld();
 		inline Vector3 GetOrigin() const { return m_Origin; }
-		inline void SetOrigin(Vector3 origin) { m_Origin = origin; }
+		inline void SetOrigin(Vector3 origin) { m_Origin = origin; ++m_Version; }
 		inline float GetFOVAngle() const { return m_FOVAngle; }
-		inline void SetFOVAngle(float fovAngle) {m_FOVAngle = fovAngle; }
+		inline void SetFOVAngle(float fovAngle) {m_FOVAngle = fovAngle; ++m_Version; }
 		inline Matrix GetCameraToWorld() const { return m_CameraToWorld; }
+		//Changes whenever the camera moved, turned or zoomed, so the renderer knows when its accumulated frames are outdated
+		inline uint64_t GetVersion() const { return m_Version; }
 
 	private:
 		Vector3 m_Origin{ };
@@ -35,5 +37,6 @@ namespace dae
 		const float m_CameraRotationSpeed{ 2.0f };
 
 		Matrix m_CameraToWorld{ };
+		uint64_t m_Version{ 0 };
 	};
 }
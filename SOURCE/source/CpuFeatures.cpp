@@ -0,0 +1,34 @@
+#include "CpuFeatures.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace dae
+{
+	bool CpuFeatures::DetectAVX2()
+	{
+#if defined(_MSC_VER)
+		int registers[4]{};
+
+		__cpuid(registers, 0);
+		if (registers[0] < 7)
+			return false;
+
+		//OSXSAVE and AVX, then whether the OS enabled the XMM and YMM state
+		__cpuid(registers, 1);
+		const bool hasOSXSave{ (registers[2] & (1 << 27)) != 0 };
+		const bool hasAVX{ (registers[2] & (1 << 28)) != 0 };
+		if (!hasOSXSave || !hasAVX || (_xgetbv(0) & 0x6) != 0x6)
+			return false;
+
+		__cpuidex(registers, 7, 0);
+		return (registers[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#else
+		return false;
+#endif
+	}
+}
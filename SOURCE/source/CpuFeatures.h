@@ -0,0 +1,23 @@
+#pragma once
+
+//Kernels for wider instruction sets are compiled for that target only and picked at runtime,
+//so the executable still runs on CPUs without them. MSVC allows the intrinsics in any function.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace dae
+{
+	namespace CpuFeatures
+	{
+		//Also takes into account whether the OS saves the AVX registers
+		bool DetectAVX2();
+
+		//Detected once at startup, so checking it in hot loops is just a load
+		inline const bool g_HasAVX2{ DetectAVX2() };
+
+		inline bool HasAVX2() { return g_HasAVX2; }
+	}
+}
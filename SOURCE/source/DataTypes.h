@@ -1,11 +1,18 @@
 #pragma once
+#include <algorithm>
+#include <bit>
 #include <cassert>
+#include <memory>
+#include <span>
 
 #include "Math.h"
+#include "BVH.h"
 #include "vector"
 
 namespace dae
 {
+	class MappedFile;
+
 #pragma region GEOMETRY
 	struct Plane
 	{
@@ -25,14 +32,19 @@ namespace dae
 	struct Triangle
 	{
 		Triangle() = default;
+
+		//The normal has to be on the side the winding faces, culling is decided from the winding.
+		//Zero area triangles have no winding and a NaN normal from the loaders, they are never hit
 		Triangle(const Vector3& _v0, const Vector3& _v1, const Vector3& _v2, const Vector3& _normal):
-			v0{_v0}, v1{_v1}, v2{_v2}, normal{_normal.Normalized()}{}
+			v0{_v0}, v1{_v1}, v2{_v2}, edgeV0V1{_v1 - _v0}, edgeV0V2{_v2 - _v0}, normal{_normal.Normalized()}
+		{
+			assert((Vector3::Cross(edgeV0V1, edgeV0V2).SqrMagnitude() == 0.0f || Vector3::Dot(Vector3::Cross(edgeV0V1, edgeV0V2), normal) >= 0.0f)
+				&& "Triangle normal does not match its winding");
+		}
 
 		Triangle(const Vector3& _v0, const Vector3& _v1, const Vector3& _v2) :
-			v0{ _v0 }, v1{ _v1 }, v2{ _v2 }
+			v0{ _v0 }, v1{ _v1 }, v2{ _v2 }, edgeV0V1{ _v1 - _v0 }, edgeV0V2{ _v2 - _v0 }
 		{
-			const Vector3 edgeV0V1 = v1 - v0;
-			const Vector3 edgeV0V2 = v2 - v0;
 			normal = Vector3::Cross(edgeV0V1, edgeV0V2).Normalized();
 		}
 
@@ -40,12 +52,59 @@ namespace dae
 		Vector3 v1{};
 		Vector3 v2{};
 
+		//Precomputed for the Moller-Trumbore hit test
+		Vector3 edgeV0V1{};
+		Vector3 edgeV0V2{};
+
 		Vector3 normal{};
 
 		TriangleCullMode cullMode{};
 		unsigned char materialIndex{};
 	};
 
+	//Four triangles in structure of arrays layout, so one ray can be tested against all of them at once with SSE.
+	//Unused lanes hold degenerate triangles that can never be hit.
+	struct alignas(16) TriangleBlock
+	{
+		static constexpr uint32_t laneCount{ 4 };
+
+		float v0X[laneCount]{};
+		float v0Y[laneCount]{};
+		float v0Z[laneCount]{};
+
+		float edgeV0V1X[laneCount]{};
+		float edgeV0V1Y[laneCount]{};
+		float edgeV0V1Z[laneCount]{};
+
+		float edgeV0V2X[laneCount]{};
+		float edgeV0V2Y[laneCount]{};
+		float edgeV0V2Z[laneCount]{};
+
+		float normalX[laneCount]{};
+		float normalY[laneCount]{};
+		float normalZ[laneCount]{};
+
+		void SetLane(uint32_t lane, const Triangle& triangle)
+		{
+			v0X[lane] = triangle.v0.x;
+			v0Y[lane] = triangle.v0.y;
+			v0Z[lane] = triangle.v0.z;
+
+			edgeV0V1X[lane] = triangle.edgeV0V1.x;
+			edgeV0V1Y[lane] = triangle.edgeV0V1.y;
+			edgeV0V1Z[lane] = triangle.edgeV0V1.z;
+
+			edgeV0V2X[lane] = triangle.edgeV0V2.x;
+			edgeV0V2Y[lane] = triangle.edgeV0V2.y;
+			edgeV0V2Z[lane] = triangle.edgeV0V2.z;
+
+			normalX[lane] = triangle.normal.x;
+			normalY[lane] = triangle.normal.y;
+			normalZ[lane] = triangle.normal.z;
+		}
+	};
+
+	//Triangles are stored once in object space, MeshInstance places them in the world
 	struct TriangleMesh
 	{
 		TriangleMesh() = default;
@@ -53,48 +112,57 @@ namespace dae
 		positions(_positions), indices(_indices), cullMode(_cullMode)
 		{
 			CreateTriangles();
-			UpdateTransforms();
 		}
 
 		TriangleMesh(const std::vector<Vector3>& _positions, const std::vector<int>& _indices, const std::vector<Vector3>& _normals, TriangleCullMode _cullMode) :
 			positions(_positions), indices(_indices), normals(_normals), cullMode(_cullMode)
 		{
 			CreateTriangles();
-			UpdateTransforms();
 		}
 
-		std::vector<Triangle> triangles{};
 		std::vector<Vector3> positions{};
 		std::vector<Vector3> normals{};
 		std::vector<int> indices{};
-		unsigned char materialIndex{};
+
+		//Set when the mesh uses the arrays of a memory mapped MeshCache in place, positions, normals and indices then stay empty.
+		//The mapping is shared by the copies of the mesh and closed with the last one.
+		std::shared_ptr<const MappedFile> pMappedFile{};
+		std::span<const Vector3> mappedPositions{};
+		std::span<const Vector3> mappedNormals{};
+		std::span<const int> mappedIndices{};
 
 		TriangleCullMode cullMode{TriangleCullMode::BackFaceCulling};
 
-		Matrix rotationTransform{};
-		Matrix translationTransform{};
-		Matrix scaleTransform{};
+		//Built over the object space triangles, indices in its leaves are triangle indices (see GetTriangle)
+		BVH bvh{};
 
-		std::vector<Vector3> transformedPositions{};
-		std::vector<Vector3> transformedNormals{};
+		//The triangles of every BVH leaf packed into consecutive blocks, this is what gets intersected and the only copy of the triangles besides the arrays.
+		//leafFirstBlocks is indexed by node and only meaningful for leaves.
+		std::vector<TriangleBlock> triangleBlocks{};
+		std::vector<uint32_t> leafFirstBlocks{};
 
-		void Translate(const Vector3& translation)
-		{
-			translationTransform = Matrix::CreateTranslation(translation);
-		}
+		//The arrays the triangles are created from, mapped or not
+		inline std::span<const Vector3> GetPositions() const { return pMappedFile ? mappedPositions : std::span<const Vector3>{ positions }; }
+		inline std::span<const Vector3> GetNormals() const { return pMappedFile ? mappedNormals : std::span<const Vector3>{ normals }; }
+		inline std::span<const int> GetIndices() const { return pMappedFile ? mappedIndices : std::span<const int>{ indices }; }
+		inline uint32_t GetTriangleCount() const { return uint32_t(GetIndices().size() / 3); }
 
-		void RotateY(float yaw)
+		//Made from the arrays whenever it is needed, only the TriangleBlocks are kept
+		Triangle GetTriangle(uint32_t triangleIndex) const
 		{
-			rotationTransform = Matrix::CreateRotationY(yaw);
-		}
+			const std::span<const Vector3> meshPositions{ GetPositions() };
+			const std::span<const int> meshIndices{ GetIndices() };
 
-		void Scale(const Vector3& scale)
-		{
-			scaleTransform = Matrix::CreateScale(scale);
+			Triangle triangle{ meshPositions[meshIndices[3 * triangleIndex]], meshPositions[meshIndices[(3 * triangleIndex) + 1]],
+				meshPositions[meshIndices[(3 * triangleIndex) + 2]], GetNormals()[triangleIndex] };
+			triangle.cullMode = cullMode;
+			return triangle;
 		}
 
-		void AppendTriangle(const Triangle& triangle, bool ignoreTransformUpdate = false)
+		void AppendTriangle(const Triangle& triangle, bool ignoreTriangleUpdate = false)
 		{
+			assert(!pMappedFile && "Mapped meshes are read only");
+
 			int startIndex = static_cast<int>(positions.size());
 
 			positions.push_back(triangle.v0);
@@ -107,31 +175,36 @@ namespace dae
 
 			normals.push_back(triangle.normal);
 
-			//Not ideal, but making sure all vertices are updated
-			if(!ignoreTransformUpdate)
-				UpdateTransforms();
+			//Not ideal, but making sure the triangles and BVH are up to date
+			if(!ignoreTriangleUpdate)
+				CreateTriangles();
 		}
 
+		//Builds the BVH and the TriangleBlocks from the arrays
 		void CreateTriangles()
 		{
-			const int triangleCount{ int(indices.size()) / 3 };
-
-			triangles.clear();
+			UpdateBVH();
+		}
 
-			for (int i{ 0 }; i < triangleCount; ++i)
+		//Like CreateTriangles, but restores a BVH that was built over the same triangles before (e.g. stored in a MeshCache) instead of building it.
+		//Builds it after all when the nodes do not fit, returns whether they could be used
+		bool CreateTriangles(std::span<const BVHNode> bvhNodes, std::span<const uint32_t> bvhPrimitiveIndices)
+		{
+			bvh.SetLeafBlockSize(TriangleBlock::laneCount);
+			if (!bvh.Restore(bvhNodes, bvhPrimitiveIndices, GetTriangleCount()))
 			{
-				const Vector3 v0{ positions[indices[3 * i]] };
-				const Vector3 v1{ positions[indices[(3 * i) + 1]] };
-				const Vector3 v2{ positions[indices[(3 * i) + 2]] };
-
-				triangles.emplace_back(v0, v1, v2, normals[i]);
-				triangles[i].materialIndex = materialIndex;
-				triangles[i].cullMode = cullMode;
+				UpdateBVH();
+				return false;
 			}
+
+			UpdateTriangleBlocks();
+			return true;
 		}
 
 		void CalculateNormals()
 		{
+			assert(!pMappedFile && "Mapped meshes are read only");
+
 			const int triangleCount{ int(indices.size()) / 3 };
 			for (int i{ 0 }; i < triangleCount; ++i)
 			{
@@ -146,39 +219,48 @@ namespace dae
 			}
 		}
 
-		void UpdateTransforms()
+		void UpdateBVH()
 		{
-			for (int i{ 0 }; i < int(triangles.size()); ++i)
-			{
-				Vector3 transformedPosition1{ };
-				transformedPosition1 = scaleTransform * positions[indices[3 * i]];
-				transformedPosition1 = rotationTransform * transformedPosition1;
-				transformedPosition1 = translationTransform * transformedPosition1;
+			const std::span<const Vector3> meshPositions{ GetPositions() };
+			const std::span<const int> meshIndices{ GetIndices() };
+			const uint32_t triangleCount{ GetTriangleCount() };
 
-				transformedPositions.emplace_back(transformedPosition1);
+			std::vector<AABB> triangleBounds{};
+			triangleBounds.reserve(triangleCount);
 
-				Vector3 transformedPosition2{ };
-				transformedPosition2 = scaleTransform * positions[indices[(3 * i) + 1]];
-				transformedPosition2 = rotationTransform * transformedPosition2;
-				transformedPosition2 = translationTransform * transformedPosition2;
+			for (uint32_t i{ 0 }; i < triangleCount; ++i)
+			{
+				AABB& bounds{ triangleBounds.emplace_back() };
+				bounds.Grow(meshPositions[meshIndices[3 * i]]);
+				bounds.Grow(meshPositions[meshIndices[(3 * i) + 1]]);
+				bounds.Grow(meshPositions[meshIndices[(3 * i) + 2]]);
+			}
 
-				transformedPositions.emplace_back(transformedPosition2);
+			bvh.SetLeafBlockSize(TriangleBlock::laneCount);
+			bvh.Update(triangleBounds);
+
+			UpdateTriangleBlocks();
+		}
 
-				Vector3 transformedPosition3{ };
-				transformedPosition3 = scaleTransform * positions[indices[(3 * i) + 2]];
-				transformedPosition3 = rotationTransform * transformedPosition3;
-				transformedPosition3 = translationTransform * transformedPosition3;
+		void UpdateTriangleBlocks()
+		{
+			PackLeafBlocks(bvh, [this](uint32_t triangleIndex) { return GetTriangle(triangleIndex); }, triangleBlocks, leafFirstBlocks);
+		}
+	};
 
-				transformedPositions.emplace_back(transformedPosition3);
+	//Places a TriangleMesh in the world, rays are transformed into the object space of the mesh during traversal
+	struct MeshInstance
+	{
+		uint32_t meshIndex{};
+		unsigned char materialIndex{};
 
-				triangles[i].v0 = transformedPosition1;
-				triangles[i].v1 = transformedPosition2;
-				triangles[i].v2 = transformedPosition3;
+		Matrix transform{};
+		Matrix inverseTransform{};
 
-				const Vector3 transformedNormal{ rotationTransform * normals[i] };
-				transformedNormals.emplace_back(transformedNormal);
-				triangles[i].normal = transformedNormal;
-			}
+		void SetTransform(const Matrix& _transform)
+		{
+			transform = _transform;
+			inverseTransform = Matrix::Inverse(_transform);
 		}
 	};
 #pragma endregion
@@ -209,12 +291,115 @@ namespace dae
 		float max{ FLT_MAX };
 	};
 
+	//A square block of rays sharing one origin (primary rays), in structure of arrays layout so four of them at a time are tested against one primitive with SSE.
+	//Rays that are not in use have a max of 0 and can never hit anything.
+	struct alignas(16) RayPacket
+	{
+		static constexpr uint32_t width{ 4 };
+		static constexpr uint32_t rayCount{ width * width };
+		static constexpr uint32_t laneCount{ 4 };
+
+		Vector3 origin{};
+		float min{ 0.0001f };
+
+		alignas(16) float directionX[rayCount]{};
+		alignas(16) float directionY[rayCount]{};
+		alignas(16) float directionZ[rayCount]{};
+		alignas(16) float max[rayCount]{};
+
+		uint32_t activeMask{ 0 };
+
+		//Interval of the inverse directions of all active rays, used to cull BVH nodes for the whole packet at once.
+		//Only valid when the packet is coherent: every axis has the same (non zero) sign for all of its rays.
+		Vector3 inverseDirectionMin{};
+		Vector3 inverseDirectionMax{};
+		bool isCoherent{ false };
+
+		void SetRay(uint32_t index, const Vector3& direction, float _max = FLT_MAX)
+		{
+			directionX[index] = direction.x;
+			directionY[index] = direction.y;
+			directionZ[index] = direction.z;
+			max[index] = _max;
+			activeMask |= 1u << index;
+		}
+
+		Vector3 GetDirection(uint32_t index) const
+		{
+			return { directionX[index], directionY[index], directionZ[index] };
+		}
+
+		Ray GetRay(uint32_t index) const
+		{
+			return { origin, GetDirection(index), min, max[index] };
+		}
+
+		//Has to be called once all rays are set
+		void UpdateInverseDirectionBounds()
+		{
+			isCoherent = activeMask != 0;
+			inverseDirectionMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+			inverseDirectionMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+			if (!isCoherent)
+				return;
+
+			//Every other active ray has to point to the same side as the first one
+			const Vector3 firstDirection{ GetDirection(uint32_t(std::countr_zero(activeMask))) };
+
+			for (uint32_t index{ 0 }; index < rayCount; ++index)
+			{
+				if ((activeMask & (1u << index)) == 0)
+					continue;
+
+				const Vector3 direction{ GetDirection(index) };
+
+				for (int axis{ 0 }; axis < 3; ++axis)
+				{
+					//Rays on both sides of an axis, or parallel to it, make the interval useless
+					if (direction[axis] == 0.0f || (direction[axis] > 0.0f) != (firstDirection[axis] > 0.0f))
+					{
+						isCoherent = false;
+						return;
+					}
+
+					const float inverse{ 1.0f / direction[axis] };
+					inverseDirectionMin[axis] = std::min(inverseDirectionMin[axis], inverse);
+					inverseDirectionMax[axis] = std::max(inverseDirectionMax[axis], inverse);
+				}
+			}
+		}
+	};
+
+	enum class OccluderType : uint8_t
+	{
+		None,
+		Plane,
+		SphereBlock,
+		TriangleBlock
+	};
+
+	//What blocked a shadow ray, so the next shadow ray towards the same light can test it first.
+	//Spheres and triangles are remembered by the SIMD block they are in, which is tested as a whole.
+	struct Occluder
+	{
+		OccluderType type{ OccluderType::None };
+
+		//Index into the planes, the sphere blocks or the triangle blocks of the instanced mesh
+		uint32_t index{ 0 };
+		uint32_t instanceIndex{ 0 };
+	};
+
 	struct HitRecord
 	{
 		Vector3 origin{};
 		Vector3 normal{};
 		float cameraToPointDistance = FLT_MAX; //t
 
+		//Barycentric coordinates of the hit (weights of v1 and v2), only set by triangle hit tests
+		float u{ 0.0f };
+		float v{ 0.0f };
+
 		bool didHit{ false };
 		unsigned char materialIndex{ 0 };
 	};
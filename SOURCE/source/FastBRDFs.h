@@ -0,0 +1,274 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <immintrin.h>
+
+#include "Math.h"
+#include "CpuFeatures.h"
+
+namespace dae
+{
+	//Cook-Torrance samples in structure of arrays layout, shaded 4 (SSE) or 8 (AVX2) at a time.
+	//The material constants are stored per sample, so one batch can mix every Cook-Torrance material of a scene.
+	struct alignas(32) CookTorrenceBatch
+	{
+		static constexpr uint32_t laneCount{ 8 };
+
+		float normalX[laneCount]{};
+		float normalY[laneCount]{};
+		float normalZ[laneCount]{};
+
+		float viewX[laneCount]{};
+		float viewY[laneCount]{};
+		float viewZ[laneCount]{};
+
+		float lightX[laneCount]{};
+		float lightY[laneCount]{};
+		float lightZ[laneCount]{};
+
+		float albedoR[laneCount]{};
+		float albedoG[laneCount]{};
+		float albedoB[laneCount]{};
+		float f0[laneCount]{};
+		float roughnessPow4[laneCount]{};
+		float k[laneCount]{};
+		//1 for materials with a diffuse part, 0 for metals
+		float diffuseWeight[laneCount]{};
+
+		//Written by the shading functions
+		float colorR[laneCount]{};
+		float colorG[laneCount]{};
+		float colorB[laneCount]{};
+
+		void SetLane(uint32_t lane, const Vector3& n, const Vector3& v, const Vector3& l, const ColorRGB& albedo, float _f0, float _roughnessPow4, float _k, float _diffuseWeight)
+		{
+			normalX[lane] = n.x;
+			normalY[lane] = n.y;
+			normalZ[lane] = n.z;
+
+			viewX[lane] = v.x;
+			viewY[lane] = v.y;
+			viewZ[lane] = v.z;
+
+			lightX[lane] = l.x;
+			lightY[lane] = l.y;
+			lightZ[lane] = l.z;
+
+			albedoR[lane] = albedo.r;
+			albedoG[lane] = albedo.g;
+			albedoB[lane] = albedo.b;
+			f0[lane] = _f0;
+			roughnessPow4[lane] = _roughnessPow4;
+			k[lane] = _k;
+			diffuseWeight[lane] = _diffuseWeight;
+		}
+	};
+
+	//Optimized versions of the BRDFs in BRDFs.h, which stay the reference they are tested against.
+	//Everything that only depends on the material is passed in precomputed, and the scalar and SIMD versions use the same
+	//operations in the same order (no FMA), so they give exactly the same results. They differ from the reference only by
+	//the rounding of the multiplication chain that replaces pow(x, 5).
+	namespace FastBRDF
+	{
+		inline float Pow5(float x)
+		{
+			const float x2{ x * x };
+			return x2 * x2 * x;
+		}
+
+		/**
+		 * \param nDotH Dot of the surface normal and the normalized half vector
+		 * \param roughnessPow4 roughness^4 of the material
+		 */
+		inline float NormalDistribution_GGX(float nDotH, float roughnessPow4)
+		{
+			const float denominator{ ((nDotH * nDotH) * (roughnessPow4 - 1.0f)) + 1.0f };
+			return roughnessPow4 / (PI * (denominator * denominator));
+		}
+
+		/**
+		 * \param vDotH Dot of the view direction and the normalized half vector
+		 * \param f0 Red channel of the base reflectivity, like the reference only that one is used
+		 */
+		inline float FresnelFunction_Schlick(float vDotH, float f0)
+		{
+			return f0 + ((1.0f - f0) * Pow5(1.0f - vDotH));
+		}
+
+		/**
+		 * \param nDotV Dot of the surface normal and the view or light direction
+		 * \param k ((roughness^2 + 1)^2) / 8 of the material
+		 */
+		inline float GeometryFunction_SchlickGGX(float nDotV, float k)
+		{
+			if (nDotV == 0.0f)
+				return 0.0f;
+
+			return nDotV / ((nDotV * (1.0f - k)) + k);
+		}
+
+		inline float GeometryFunction_Smith(float nDotV, float nDotL, float k)
+		{
+			return GeometryFunction_SchlickGGX(nDotV, k) * GeometryFunction_SchlickGGX(nDotL, k);
+		}
+
+		//Diffuse and specular of Material_CookTorrence for one sample
+		inline ColorRGB CookTorrence(const Vector3& n, const Vector3& v, const Vector3& l, const ColorRGB& albedo, float f0, float roughnessPow4, float k, float diffuseWeight)
+		{
+			//Divided by the exact magnitude like the SIMD versions, Normalized uses rsqrt when the SIMD math is enabled
+			const Vector3 sum{ v + l };
+			const float magnitude{ sum.Magnitude() };
+			const Vector3 h{ sum.x / magnitude, sum.y / magnitude, sum.z / magnitude };
+			const float nDotV{ Vector3::Dot(n, v) };
+			const float nDotL{ Vector3::Dot(n, l) };
+
+			const float D{ NormalDistribution_GGX(Vector3::Dot(n, h), roughnessPow4) };
+			const float F{ FresnelFunction_Schlick(Vector3::Dot(v, h), f0) };
+			const float G{ GeometryFunction_Smith(nDotV, nDotL, k) };
+
+			const float specular{ ((F * D) * G) * (1.0f / ((4.0f * nDotV) * nDotL)) };
+			const float kd{ (1.0f - F) * diffuseWeight };
+
+			return { ((albedo.r * kd) / PI) + specular, ((albedo.g * kd) / PI) + specular, ((albedo.b * kd) / PI) + specular };
+		}
+
+#pragma region SIMD
+		inline __m128 GeometryFunction_SchlickGGX_SSE(__m128 nDotV, __m128 k)
+		{
+			const __m128 value{ _mm_div_ps(nDotV, _mm_add_ps(_mm_mul_ps(nDotV, _mm_sub_ps(_mm_set1_ps(1.0f), k)), k)) };
+			return _mm_andnot_ps(_mm_cmpeq_ps(nDotV, _mm_setzero_ps()), value);
+		}
+
+		//Lanes firstLane to firstLane + 3 of the batch, firstLane has to be a multiple of 4
+		inline void ShadeCookTorrenceLanes_SSE(CookTorrenceBatch& batch, uint32_t firstLane)
+		{
+			const __m128 one{ _mm_set1_ps(1.0f) };
+			const __m128 pi{ _mm_set1_ps(PI) };
+
+			const __m128 nX{ _mm_load_ps(batch.normalX + firstLane) };
+			const __m128 nY{ _mm_load_ps(batch.normalY + firstLane) };
+			const __m128 nZ{ _mm_load_ps(batch.normalZ + firstLane) };
+			const __m128 vX{ _mm_load_ps(batch.viewX + firstLane) };
+			const __m128 vY{ _mm_load_ps(batch.viewY + firstLane) };
+			const __m128 vZ{ _mm_load_ps(batch.viewZ + firstLane) };
+			const __m128 lX{ _mm_load_ps(batch.lightX + firstLane) };
+			const __m128 lY{ _mm_load_ps(batch.lightY + firstLane) };
+			const __m128 lZ{ _mm_load_ps(batch.lightZ + firstLane) };
+			const __m128 f0{ _mm_load_ps(batch.f0 + firstLane) };
+			const __m128 roughnessPow4{ _mm_load_ps(batch.roughnessPow4 + firstLane) };
+			const __m128 k{ _mm_load_ps(batch.k + firstLane) };
+
+			//Normalized half vector
+			const __m128 sumX{ _mm_add_ps(vX, lX) };
+			const __m128 sumY{ _mm_add_ps(vY, lY) };
+			const __m128 sumZ{ _mm_add_ps(vZ, lZ) };
+			const __m128 sqrMagnitude{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(sumX, sumX), _mm_mul_ps(sumY, sumY)), _mm_mul_ps(sumZ, sumZ)) };
+			const __m128 magnitude{ _mm_sqrt_ps(sqrMagnitude) };
+			const __m128 hX{ _mm_div_ps(sumX, magnitude) };
+			const __m128 hY{ _mm_div_ps(sumY, magnitude) };
+			const __m128 hZ{ _mm_div_ps(sumZ, magnitude) };
+
+			const __m128 nDotV{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(nX, vX), _mm_mul_ps(nY, vY)), _mm_mul_ps(nZ, vZ)) };
+			const __m128 nDotL{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(nX, lX), _mm_mul_ps(nY, lY)), _mm_mul_ps(nZ, lZ)) };
+			const __m128 nDotH{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(nX, hX), _mm_mul_ps(nY, hY)), _mm_mul_ps(nZ, hZ)) };
+			const __m128 vDotH{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(vX, hX), _mm_mul_ps(vY, hY)), _mm_mul_ps(vZ, hZ)) };
+
+			const __m128 denominator{ _mm_add_ps(_mm_mul_ps(_mm_mul_ps(nDotH, nDotH), _mm_sub_ps(roughnessPow4, one)), one) };
+			const __m128 D{ _mm_div_ps(roughnessPow4, _mm_mul_ps(pi, _mm_mul_ps(denominator, denominator))) };
+
+			const __m128 x{ _mm_sub_ps(one, vDotH) };
+			const __m128 x2{ _mm_mul_ps(x, x) };
+			const __m128 F{ _mm_add_ps(f0, _mm_mul_ps(_mm_sub_ps(one, f0), _mm_mul_ps(_mm_mul_ps(x2, x2), x))) };
+
+			const __m128 G{ _mm_mul_ps(GeometryFunction_SchlickGGX_SSE(nDotV, k), GeometryFunction_SchlickGGX_SSE(nDotL, k)) };
+
+			const __m128 specular{ _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(F, D), G), _mm_div_ps(one, _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(4.0f), nDotV), nDotL))) };
+			const __m128 kd{ _mm_mul_ps(_mm_sub_ps(one, F), _mm_load_ps(batch.diffuseWeight + firstLane)) };
+
+			const __m128 albedoR{ _mm_load_ps(batch.albedoR + firstLane) };
+			const __m128 albedoG{ _mm_load_ps(batch.albedoG + firstLane) };
+			const __m128 albedoB{ _mm_load_ps(batch.albedoB + firstLane) };
+
+			_mm_store_ps(batch.colorR + firstLane, _mm_add_ps(_mm_div_ps(_mm_mul_ps(albedoR, kd), pi), specular));
+			_mm_store_ps(batch.colorG + firstLane, _mm_add_ps(_mm_div_ps(_mm_mul_ps(albedoG, kd), pi), specular));
+			_mm_store_ps(batch.colorB + firstLane, _mm_add_ps(_mm_div_ps(_mm_mul_ps(albedoB, kd), pi), specular));
+		}
+
+		TARGET_AVX2 inline __m256 GeometryFunction_SchlickGGX_AVX2(__m256 nDotV, __m256 k)
+		{
+			const __m256 value{ _mm256_div_ps(nDotV, _mm256_add_ps(_mm256_mul_ps(nDotV, _mm256_sub_ps(_mm256_set1_ps(1.0f), k)), k)) };
+			return _mm256_andnot_ps(_mm256_cmp_ps(nDotV, _mm256_setzero_ps(), _CMP_EQ_OQ), value);
+		}
+
+		//All eight lanes of the batch at once, only call this when the CPU supports AVX2
+		TARGET_AVX2 inline void ShadeCookTorrenceLanes_AVX2(CookTorrenceBatch& batch)
+		{
+			const __m256 one{ _mm256_set1_ps(1.0f) };
+			const __m256 pi{ _mm256_set1_ps(PI) };
+
+			const __m256 nX{ _mm256_load_ps(batch.normalX) };
+			const __m256 nY{ _mm256_load_ps(batch.normalY) };
+			const __m256 nZ{ _mm256_load_ps(batch.normalZ) };
+			const __m256 vX{ _mm256_load_ps(batch.viewX) };
+			const __m256 vY{ _mm256_load_ps(batch.viewY) };
+			const __m256 vZ{ _mm256_load_ps(batch.viewZ) };
+			const __m256 lX{ _mm256_load_ps(batch.lightX) };
+			const __m256 lY{ _mm256_load_ps(batch.lightY) };
+			const __m256 lZ{ _mm256_load_ps(batch.lightZ) };
+			const __m256 f0{ _mm256_load_ps(batch.f0) };
+			const __m256 roughnessPow4{ _mm256_load_ps(batch.roughnessPow4) };
+			const __m256 k{ _mm256_load_ps(batch.k) };
+
+			//No FMA on purpose, the results have to match the scalar and SSE versions exactly
+			const __m256 sumX{ _mm256_add_ps(vX, lX) };
+			const __m256 sumY{ _mm256_add_ps(vY, lY) };
+			const __m256 sumZ{ _mm256_add_ps(vZ, lZ) };
+			const __m256 sqrMagnitude{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sumX, sumX), _mm256_mul_ps(sumY, sumY)), _mm256_mul_ps(sumZ, sumZ)) };
+			const __m256 magnitude{ _mm256_sqrt_ps(sqrMagnitude) };
+			const __m256 hX{ _mm256_div_ps(sumX, magnitude) };
+			const __m256 hY{ _mm256_div_ps(sumY, magnitude) };
+			const __m256 hZ{ _mm256_div_ps(sumZ, magnitude) };
+
+			const __m256 nDotV{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nX, vX), _mm256_mul_ps(nY, vY)), _mm256_mul_ps(nZ, vZ)) };
+			const __m256 nDotL{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nX, lX), _mm256_mul_ps(nY, lY)), _mm256_mul_ps(nZ, lZ)) };
+			const __m256 nDotH{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nX, hX), _mm256_mul_ps(nY, hY)), _mm256_mul_ps(nZ, hZ)) };
+			const __m256 vDotH{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vX, hX), _mm256_mul_ps(vY, hY)), _mm256_mul_ps(vZ, hZ)) };
+
+			const __m256 denominator{ _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(nDotH, nDotH), _mm256_sub_ps(roughnessPow4, one)), one) };
+			const __m256 D{ _mm256_div_ps(roughnessPow4, _mm256_mul_ps(pi, _mm256_mul_ps(denominator, denominator))) };
+
+			const __m256 x{ _mm256_sub_ps(one, vDotH) };
+			const __m256 x2{ _mm256_mul_ps(x, x) };
+			const __m256 F{ _mm256_add_ps(f0, _mm256_mul_ps(_mm256_sub_ps(one, f0), _mm256_mul_ps(_mm256_mul_ps(x2, x2), x))) };
+
+			const __m256 G{ _mm256_mul_ps(GeometryFunction_SchlickGGX_AVX2(nDotV, k), GeometryFunction_SchlickGGX_AVX2(nDotL, k)) };
+
+			const __m256 specular{ _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(F, D), G), _mm256_div_ps(one, _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(4.0f), nDotV), nDotL))) };
+			const __m256 kd{ _mm256_mul_ps(_mm256_sub_ps(one, F), _mm256_load_ps(batch.diffuseWeight)) };
+
+			const __m256 albedoR{ _mm256_load_ps(batch.albedoR) };
+			const __m256 albedoG{ _mm256_load_ps(batch.albedoG) };
+			const __m256 albedoB{ _mm256_load_ps(batch.albedoB) };
+
+			_mm256_store_ps(batch.colorR, _mm256_add_ps(_mm256_div_ps(_mm256_mul_ps(albedoR, kd), pi), specular));
+			_mm256_store_ps(batch.colorG, _mm256_add_ps(_mm256_div_ps(_mm256_mul_ps(albedoG, kd), pi), specular));
+			_mm256_store_ps(batch.colorB, _mm256_add_ps(_mm256_div_ps(_mm256_mul_ps(albedoB, kd), pi), specular));
+		}
+
+		//Shades the first laneCount samples of the batch, lanes after those are computed too but hold no meaningful result
+		inline void ShadeCookTorrenceBatch(CookTorrenceBatch& batch, uint32_t laneCount, bool useAVX2)
+		{
+			if (useAVX2)
+			{
+				ShadeCookTorrenceLanes_AVX2(batch);
+				return;
+			}
+
+			ShadeCookTorrenceLanes_SSE(batch, 0);
+
+			if (laneCount > 4)
+				ShadeCookTorrenceLanes_SSE(batch, 4);
+		}
+#pragma endregion
+	}
+}
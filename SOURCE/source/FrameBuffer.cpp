@@ -0,0 +1,104 @@
+#include "FrameBuffer.h"
+
+#include <fstream>
+
+namespace dae
+{
+	FrameBuffer::FrameBuffer(uint32_t width, uint32_t height, bool hasFloatTarget)
+		: m_Width{ width }
+		, m_Height{ height }
+		, m_Pixels(size_t(width) * height, 0xFF000000u)
+	{
+		if (hasFloatTarget)
+			m_Colors.resize(size_t(width) * height);
+	}
+
+	void FrameBuffer::SetPixel(uint32_t x, uint32_t y, const ColorRGB& color)
+	{
+		const size_t index{ x + (size_t(y) * m_Width) };
+
+		if (!m_Colors.empty())
+			m_Colors[index] = color;
+
+		ColorRGB clampedColor{ color };
+		clampedColor.MaxToOne();
+
+		m_Pixels[index] = PackRGBA8(clampedColor);
+	}
+
+	void FrameBuffer::AccumulatePixel(uint32_t x, uint32_t y, const ColorRGB& color, float weight)
+	{
+		const size_t index{ x + (size_t(y) * m_Width) };
+
+		ColorRGB& averageColor{ m_Colors[index] };
+		averageColor = weight < 1.0f ? ColorRGB::Lerp(averageColor, color, weight) : color;
+
+		ColorRGB clampedColor{ averageColor };
+		clampedColor.MaxToOne();
+
+		m_Pixels[index] = PackRGBA8(clampedColor);
+	}
+
+	void FrameBuffer::SetFloatTarget(bool isEnabled)
+	{
+		if (isEnabled)
+		{
+			m_Colors.assign(size_t(m_Width) * m_Height, ColorRGB{});
+			return;
+		}
+
+		m_Colors.clear();
+		m_Colors.shrink_to_fit();
+	}
+
+	bool FrameBuffer::SaveToBMP(const std::string& filename) const
+	{
+		std::ofstream file(filename, std::ios::binary);
+		if (!file)
+			return false;
+
+		//24 bit BMP, rows are stored bottom up and padded to 4 bytes
+		const uint32_t rowSize{ ((m_Width * 3) + 3) & ~3u };
+		const uint32_t imageSize{ rowSize * m_Height };
+		constexpr uint32_t headerSize{ 14 + 40 };
+
+		auto writeU16 = [&file](uint16_t value) { file.write(reinterpret_cast<const char*>(&value), sizeof(value)); };
+		auto writeU32 = [&file](uint32_t value) { file.write(reinterpret_cast<const char*>(&value), sizeof(value)); };
+
+		//File header
+		file.write("BM", 2);
+		writeU32(headerSize + imageSize);
+		writeU32(0);
+		writeU32(headerSize);
+
+		//Info header
+		writeU32(40);
+		writeU32(m_Width);
+		writeU32(m_Height);
+		writeU16(1);
+		writeU16(24);
+		writeU32(0);
+		writeU32(imageSize);
+		writeU32(2835);
+		writeU32(2835);
+		writeU32(0);
+		writeU32(0);
+
+		std::vector<char> row(rowSize, 0);
+
+		for (uint32_t y{ m_Height }; y-- > 0;)
+		{
+			for (uint32_t x{ 0 }; x < m_Width; ++x)
+			{
+				const uint32_t pixel{ m_Pixels[x + (size_t(y) * m_Width)] };
+				row[(x * 3) + 0] = static_cast<char>((pixel >> 16) & 0xFF);
+				row[(x * 3) + 1] = static_cast<char>((pixel >> 8) & 0xFF);
+				row[(x * 3) + 2] = static_cast<char>(pixel & 0xFF);
+			}
+
+			file.write(row.data(), rowSize);
+		}
+
+		return bool(file);
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ColorRGB.h"
+
+namespace dae
+{
+	//In-memory render target, does not depend on a window so it can be used for headless rendering.
+	//Pixels are stored as RGBA8 (R in the lowest byte), optionally alongside the unclamped float colors.
+	class FrameBuffer final
+	{
+	public:
+		FrameBuffer(uint32_t width, uint32_t height, bool hasFloatTarget = false);
+
+		//Not thread safe for the same pixel, different pixels can be written from different threads
+		void SetPixel(uint32_t x, uint32_t y, const ColorRGB& color);
+		//Moves the float color of the pixel weight of the way towards color (1 replaces it) and writes the result like SetPixel,
+		//so frames are averaged in the float target. Needs the float target
+		void AccumulatePixel(uint32_t x, uint32_t y, const ColorRGB& color, float weight);
+		bool SaveToBMP(const std::string& filename) const;
+
+		//Allocates the float colors (black) or frees them
+		void SetFloatTarget(bool isEnabled);
+
+		inline uint32_t GetWidth() const { return m_Width; }
+		inline uint32_t GetHeight() const { return m_Height; }
+		inline bool HasFloatTarget() const { return !m_Colors.empty(); }
+
+		inline const uint32_t* GetPixels() const { return m_Pixels.data(); }
+		inline uint32_t GetPitch() const { return m_Width * uint32_t(sizeof(uint32_t)); }
+		inline const ColorRGB* GetColors() const { return m_Colors.data(); }
+
+		static inline uint32_t PackRGBA8(const ColorRGB& color)
+		{
+			return static_cast<uint32_t>(color.r * 255)
+				| (static_cast<uint32_t>(color.g * 255) << 8)
+				| (static_cast<uint32_t>(color.b * 255) << 16)
+				| (0xFFu << 24);
+		}
+
+	private:
+		uint32_t m_Width{};
+		uint32_t m_Height{};
+
+		std::vector<uint32_t> m_Pixels{};
+		std::vector<ColorRGB> m_Colors{};
+	};
+}
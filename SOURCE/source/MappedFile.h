@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+namespace dae
+{
+	//Read only view of a whole file mapped into memory, the pages are only read from disk when they are touched.
+	//The view stays valid until the MappedFile is closed or destroyed.
+	class MappedFile final
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile(MappedFile&&) noexcept = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile& operator=(MappedFile&&) noexcept = delete;
+
+		//Closes the file that was open before, returns false when the file can not be opened or mapped.
+		//Empty files open successfully with a size of 0 and no data.
+		bool Open(const std::string& filename);
+		void Close();
+
+		inline bool IsOpen() const { return m_IsOpen; }
+		inline const char* GetData() const { return m_pData; }
+		inline size_t GetSize() const { return m_Size; }
+
+	private:
+		const char* m_pData{ nullptr };
+		size_t m_Size{ 0 };
+		bool m_IsOpen{ false };
+
+#if defined(_WIN32)
+		void* m_FileHandle{ nullptr };
+		void* m_MappingHandle{ nullptr };
+#endif
+	};
+}
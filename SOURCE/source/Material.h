@@ -2,9 +2,117 @@
 #include "Math.h"
 #include "DataTypes.h"
 #include "BRDFs.h"
+#include "FastBRDFs.h"
 
 namespace dae
 {
+#pragma region Material DATA
+	enum class MaterialType : uint8_t
+	{
+		SolidColor,
+		Lambert,
+		LambertPhong,
+		CookTorrence,
+
+		//Not a type, the amount of types
+		Count
+	};
+
+	enum class BRDFMode : uint8_t
+	{
+		//The BRDFs.h functions, exactly what Material::Shade returns
+		Reference,
+		//FastBRDF with the precomputed material constants, Cook-Torrance samples are shaded in SIMD batches
+		Fast
+	};
+
+	//Flat copy of a Material with everything that does not depend on the hit precomputed, the Scene keeps a table of them indexed by materialIndex.
+	//Shading through it needs no virtual call, so hits grouped by type can be shaded in one tight loop per type.
+	struct MaterialData
+	{
+		static constexpr uint32_t typeCount{ uint32_t(MaterialType::Count) };
+
+		MaterialType type{ MaterialType::SolidColor };
+
+		//SolidColor: the color, Lambert and LambertPhong: their constant Lambert term, CookTorrence: the albedo
+		ColorRGB color{};
+
+		//LambertPhong
+		float specularReflectance{ 0.0f };
+		float phongExponent{ 1.0f };
+
+		//CookTorrence, fully metallic materials have no diffuse part
+		ColorRGB f0{};
+		float roughness{ 1.0f };
+		bool hasDiffuse{ true };
+
+		//CookTorrence, roughness^4 for the normal distribution and ((roughness^2 + 1)^2) / 8 for the geometry function
+		float roughnessPow4{ 1.0f };
+		float k{ 0.5f };
+	};
+
+	namespace MaterialShading
+	{
+		//The Reference mode gives the same results as Material::Shade of the material the data was taken from
+		template<MaterialType type, BRDFMode brdfMode = BRDFMode::Reference>
+		inline ColorRGB Shade(const MaterialData& material, const HitRecord& hitRecord, const Vector3& l, const Vector3& v)
+		{
+			if constexpr (type == MaterialType::SolidColor)
+			{
+				return material.color;
+			}
+			else if constexpr (type == MaterialType::Lambert)
+			{
+				return material.color;
+			}
+			else if constexpr (type == MaterialType::LambertPhong)
+			{
+				return material.color + BRDF::Phong(material.specularReflectance, material.phongExponent, l, -v, hitRecord.normal);
+			}
+			else if constexpr (type == MaterialType::CookTorrence && brdfMode != BRDFMode::Reference)
+			{
+				return FastBRDF::CookTorrence(hitRecord.normal, v, l, material.color, material.f0.r, material.roughnessPow4, material.k, material.hasDiffuse ? 1.0f : 0.0f);
+			}
+			else if constexpr (type == MaterialType::CookTorrence)
+			{
+				const Vector3 h{ (v + l).Normalized() };
+
+				const float D{ BRDF::NormalDistribution_GGX(hitRecord.normal, h, material.roughness) };
+				const ColorRGB F{ BRDF::FresnelFunction_Schlick(h, v, material.f0) };
+				const float G{ BRDF::GeometryFunction_Smith(hitRecord.normal, v, l, material.roughness) };
+
+				const ColorRGB specular{ (D * F * G) * (1.0f / (4.0f * Vector3::Dot(v, hitRecord.normal) * Vector3::Dot(l, hitRecord.normal))) };
+				const float kd{ material.hasDiffuse ? (1.0f - F.r) : 0.0f };
+				const ColorRGB diffuse{ BRDF::Lambert(kd, material.color) };
+
+				return diffuse + specular;
+			}
+		}
+
+		template<BRDFMode brdfMode = BRDFMode::Reference>
+		inline ColorRGB Shade(const MaterialData& material, const HitRecord& hitRecord, const Vector3& l, const Vector3& v)
+		{
+			static_assert(MaterialData::typeCount == 4, "Every material type needs a case here");
+
+			switch (material.type)
+			{
+			case MaterialType::SolidColor:
+				return Shade<MaterialType::SolidColor, brdfMode>(material, hitRecord, l, v);
+			case MaterialType::Lambert:
+				return Shade<MaterialType::Lambert, brdfMode>(material, hitRecord, l, v);
+			case MaterialType::LambertPhong:
+				return Shade<MaterialType::LambertPhong, brdfMode>(material, hitRecord, l, v);
+			case MaterialType::CookTorrence:
+				return Shade<MaterialType::CookTorrence, brdfMode>(material, hitRecord, l, v);
+			case MaterialType::Count:
+				break;
+			}
+
+			return {};
+		}
+	}
+#pragma endregion
+
 #pragma region Material BASE
 	class Material
 	{
@@ -25,6 +133,9 @@ namespace dae
 		 * \return color
 		 */
 		virtual ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) = 0;
+
+		//What gets added to the material table of the Scene, the Renderer shades with that instead of calling Shade
+		virtual MaterialData GetData() const = 0;
 	};
 #pragma endregion
 
@@ -43,6 +154,11 @@ namespace dae
 			return m_Color;
 		}
 
+		MaterialData GetData() const override
+		{
+			return { .type{ MaterialType::SolidColor }, .color{ m_Color } };
+		}
+
 	private:
 		ColorRGB m_Color{colors::White};
 	};
@@ -62,6 +178,11 @@ namespace dae
 			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor);
 		}
 
+		MaterialData GetData() const override
+		{
+			return { .type{ MaterialType::Lambert }, .color{ BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor) } };
+		}
+
 	private:
 		ColorRGB m_DiffuseColor{ colors::White };
 		float m_DiffuseReflectance{ 1.0f }; //kd
@@ -87,6 +208,16 @@ namespace dae
 			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor) + BRDF::Phong(m_SpecularReflectance, m_PhongExponent, l, -v, hitRecord.normal);
 		}
 
+		MaterialData GetData() const override
+		{
+			return {
+				.type{ MaterialType::LambertPhong },
+				.color{ BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor) },
+				.specularReflectance{ m_SpecularReflectance },
+				.phongExponent{ m_PhongExponent }
+			};
+		}
+
 	private:
 		ColorRGB m_DiffuseColor{colors::White};
 		float m_DiffuseReflectance{0.5f}; //kd
@@ -123,6 +254,19 @@ namespace dae
 			return diffuse + specular;
 		}
 
+		MaterialData GetData() const override
+		{
+			return {
+				.type{ MaterialType::CookTorrence },
+				.color{ m_Albedo },
+				.f0{ m_Metalness == 0.0f ? ColorRGB(0.04f, 0.04f, 0.04f) : m_Albedo },
+				.roughness{ m_Roughness },
+				.hasDiffuse{ m_Metalness != 1.0f },
+				.roughnessPow4{ m_Roughness * m_Roughness * m_Roughness * m_Roughness },
+				.k{ ((m_Roughness * m_Roughness + 1) * (m_Roughness * m_Roughness + 1)) / 8.0f }
+			};
+		}
+
 	private:
 		ColorRGB m_Albedo{0.955f, 0.637f, 0.538f}; //Copper
 		float m_Metalness{1.0f};
@@ -1,9 +1,15 @@
 #pragma once
+#include <cassert>
+#include <cmath>
+
 #include "Vector3.h"
 #include "Vector4.h"
+#include "MathHelpers.h"
+#include "SimdMath.h"
 
 namespace dae {
-	struct Matrix
+	//Aligned so the rows can be loaded into registers directly
+	struct alignas(16) Matrix
 	{
 		Matrix() = default;
 		Matrix(
@@ -41,6 +47,7 @@ namespace dae {
 		static Matrix CreateScale(float sx, float sy, float sz);
 		static Matrix CreateScale(const Vector3& s);
 		static Matrix Transpose(const Matrix& m);
+		static Matrix Inverse(const Matrix& m);
 
 		Vector4& operator[](int index);
 		Vector4 operator[](int index) const;
@@ -63,5 +70,286 @@ namespace dae {
 		// v1x v1y v1z v1w
 		// v2x v2y v2z v2w
 		// v3x v3y v3z v3w
+
+#ifdef SIMD_MATH_ENABLED
+		//Row * m, with the products summed in the same order as the scalar Vector4::Dot of the row and a column
+		static __m128 MultiplyRow(__m128 row, const Matrix& m);
+#endif
 	};
-}
\ No newline at end of file
+
+	//Everything is defined in the header so it can be inlined into every translation unit
+	inline Matrix::Matrix(const Vector3& xAxis, const Vector3& yAxis, const Vector3& zAxis, const Vector3& t) :
+		Matrix({ xAxis, 0 }, { yAxis, 0 }, { zAxis, 0 }, { t, 1 })
+	{
+	}
+
+	inline Matrix::Matrix(const Vector4& xAxis, const Vector4& yAxis, const Vector4& zAxis, const Vector4& t)
+	{
+		data[0] = xAxis;
+		data[1] = yAxis;
+		data[2] = zAxis;
+		data[3] = t;
+	}
+
+	inline Matrix::Matrix(const Matrix& m)
+	{
+		data[0] = m[0];
+		data[1] = m[1];
+		data[2] = m[2];
+		data[3] = m[3];
+	}
+
+	inline Vector3 Matrix::TransformVector(const Vector3& v) const
+	{
+#ifdef SIMD_MATH_ENABLED
+		const __m128 vector{ v.ToRegister() };
+		const __m128 x{ _mm_mul_ps(_mm_load_ps(&data[0].x), SimdMath::Broadcast<0>(vector)) };
+		const __m128 y{ _mm_mul_ps(_mm_load_ps(&data[1].x), SimdMath::Broadcast<1>(vector)) };
+		const __m128 z{ _mm_mul_ps(_mm_load_ps(&data[2].x), SimdMath::Broadcast<2>(vector)) };
+
+		return Vector3::FromRegister(_mm_add_ps(_mm_add_ps(x, y), z));
+#else
+		return TransformVector(v[0], v[1], v[2]);
+#endif
+	}
+
+	inline Vector3 Matrix::TransformVector(float x, float y, float z) const
+	{
+		return Vector3{
+			data[0].x * x + data[1].x * y + data[2].x * z,
+			data[0].y * x + data[1].y * y + data[2].y * z,
+			data[0].z * x + data[1].z * y + data[2].z * z
+		};
+	}
+
+	inline Vector3 Matrix::TransformPoint(const Vector3& p) const
+	{
+#ifdef SIMD_MATH_ENABLED
+		const __m128 point{ p.ToRegister() };
+		const __m128 x{ _mm_mul_ps(_mm_load_ps(&data[0].x), SimdMath::Broadcast<0>(point)) };
+		const __m128 y{ _mm_mul_ps(_mm_load_ps(&data[1].x), SimdMath::Broadcast<1>(point)) };
+		const __m128 z{ _mm_mul_ps(_mm_load_ps(&data[2].x), SimdMath::Broadcast<2>(point)) };
+
+		return Vector3::FromRegister(_mm_add_ps(_mm_add_ps(_mm_add_ps(x, y), z), _mm_load_ps(&data[3].x)));
+#else
+		return TransformPoint(p[0], p[1], p[2]);
+#endif
+	}
+
+	inline Vector3 Matrix::TransformPoint(float x, float y, float z) const
+	{
+		return Vector3{
+			data[0].x * x + data[1].x * y + data[2].x * z + data[3].x,
+			data[0].y * x + data[1].y * y + data[2].y * z + data[3].y,
+			data[0].z * x + data[1].z * y + data[2].z * z + data[3].z,
+		};
+	}
+
+	inline const Matrix& Matrix::Transpose()
+	{
+		Matrix result{};
+		for (int r{ 0 }; r < 4; ++r)
+		{
+			for (int c{ 0 }; c < 4; ++c)
+			{
+				result[r][c] = data[c][r];
+			}
+		}
+
+		data[0] = result[0];
+		data[1] = result[1];
+		data[2] = result[2];
+		data[3] = result[3];
+
+		return *this;
+	}
+
+	inline Matrix Matrix::Transpose(const Matrix& m)
+	{
+		Matrix out{ m };
+		out.Transpose();
+
+		return out;
+	}
+
+	//Assumes an affine matrix (last column is 0, 0, 0, 1)
+	inline Matrix Matrix::Inverse(const Matrix& m)
+	{
+		const Vector3 xAxis{ m.GetAxisX() };
+		const Vector3 yAxis{ m.GetAxisY() };
+		const Vector3 zAxis{ m.GetAxisZ() };
+
+		//Inverse of the upper 3x3 through its adjugate, the cross products are the columns of the inverse
+		const Vector3 yCrossZ{ Vector3::Cross(yAxis, zAxis) };
+		const Vector3 zCrossX{ Vector3::Cross(zAxis, xAxis) };
+		const Vector3 xCrossY{ Vector3::Cross(xAxis, yAxis) };
+
+		const float determinant{ Vector3::Dot(xAxis, yCrossZ) };
+		assert(determinant != 0.0f && "Matrix is not invertible");
+
+		const float inverseDeterminant{ 1.0f / determinant };
+
+		Matrix result{
+			Vector3{ yCrossZ.x, zCrossX.x, xCrossY.x } * inverseDeterminant,
+			Vector3{ yCrossZ.y, zCrossX.y, xCrossY.y } * inverseDeterminant,
+			Vector3{ yCrossZ.z, zCrossX.z, xCrossY.z } * inverseDeterminant,
+			Vector3::Zero };
+
+		result[3] = { -result.TransformVector(m.GetTranslation()), 1.0f };
+		return result;
+	}
+
+	inline Vector3 Matrix::GetAxisX() const
+	{
+		return data[0];
+	}
+
+	inline Vector3 Matrix::GetAxisY() const
+	{
+		return data[1];
+	}
+
+	inline Vector3 Matrix::GetAxisZ() const
+	{
+		return data[2];
+	}
+
+	inline Vector3 Matrix::GetTranslation() const
+	{
+		return data[3];
+	}
+
+	inline Matrix Matrix::CreateTranslation(float x, float y, float z)
+	{
+		return { Vector3::UnitX, Vector3::UnitY, Vector3::UnitZ, Vector3(x, y, z)};
+	}
+
+	inline Matrix Matrix::CreateTranslation(const Vector3& t)
+	{
+		return { Vector3::UnitX, Vector3::UnitY, Vector3::UnitZ, t };
+	}
+
+	inline Matrix Matrix::CreateRotationX(float pitch)
+	{
+		const float pitchInRadians{ pitch * TO_RADIANS };
+		const float sine{ sinf(pitchInRadians) };
+		const float cosine{ cosf(pitchInRadians) };
+		return { Vector3::UnitX, Vector3(0, cosine, -sine), Vector3(0, sine, cosine), Vector3(0, 0, 0) };
+	}
+
+	inline Matrix Matrix::CreateRotationY(float yaw)
+	{
+		const float yawInRadians{ yaw * TO_RADIANS };
+		const float sine{ sinf(yawInRadians) };
+		const float cosine{ cosf(yawInRadians) };
+		return { Vector3(cosine, 0, sine), Vector3::UnitY, Vector3(-sine, 0, cosine), Vector3(0, 0, 0) };
+	}
+
+	inline Matrix Matrix::CreateRotationZ(float roll)
+	{
+		const float rollInRadians{ roll * TO_RADIANS };
+		const float sine{ sinf(rollInRadians) };
+		const float cosine{ cosf(rollInRadians) };
+		return { Vector3(cosine, -sine, 0), Vector3(sine, cosine, 0), Vector3::UnitZ, Vector3(0, 0, 0) };
+	}
+
+	inline Matrix Matrix::CreateRotation(const Vector3& r)
+	{
+		return {CreateRotationX(r.x) * CreateRotationY(-r.y) * CreateRotationZ(r.z)};
+	}
+
+	inline Matrix Matrix::CreateRotation(float pitch, float yaw, float roll)
+	{
+		return CreateRotation({ pitch, yaw, roll });
+	}
+
+	inline Matrix Matrix::CreateScale(float sx, float sy, float sz)
+	{
+		return { Vector3(sx, 0, 0), Vector3(0, sy, 0), Vector3(0, 0, sz), Vector3(0, 0, 0) };
+	}
+
+	inline Matrix Matrix::CreateScale(const Vector3& s)
+	{
+		return CreateScale(s[0], s[1], s[2]);
+	}
+
+#ifdef SIMD_MATH_ENABLED
+	inline __m128 Matrix::MultiplyRow(__m128 row, const Matrix& m)
+	{
+		const __m128 x{ _mm_mul_ps(SimdMath::Broadcast<0>(row), _mm_load_ps(&m.data[0].x)) };
+		const __m128 y{ _mm_mul_ps(SimdMath::Broadcast<1>(row), _mm_load_ps(&m.data[1].x)) };
+		const __m128 z{ _mm_mul_ps(SimdMath::Broadcast<2>(row), _mm_load_ps(&m.data[2].x)) };
+		const __m128 w{ _mm_mul_ps(SimdMath::Broadcast<3>(row), _mm_load_ps(&m.data[3].x)) };
+
+		return _mm_add_ps(_mm_add_ps(_mm_add_ps(x, y), z), w);
+	}
+#endif
+
+#pragma region Operator Overloads
+	inline Vector4& Matrix::operator[](int index)
+	{
+		assert(index <= 3 && index >= 0);
+		return data[index];
+	}
+
+	inline Vector4 Matrix::operator[](int index) const
+	{
+		assert(index <= 3 && index >= 0);
+		return data[index];
+	}
+
+	inline Matrix Matrix::operator*(const Matrix& m) const
+	{
+		Matrix result{};
+
+#if defined(SIMD_MATH_AVX2_ENABLED)
+		//Two rows per register, every lane of a row is multiplied with the matching row of m
+		for (int r{ 0 }; r < 4; r += 2)
+		{
+			const __m256 rows{ _mm256_loadu_ps(&data[r].x) };
+			const __m256 x{ _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, _MM_SHUFFLE(0, 0, 0, 0)), _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m.data[0].x))) };
+			const __m256 y{ _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, _MM_SHUFFLE(1, 1, 1, 1)), _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m.data[1].x))) };
+			const __m256 z{ _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, _MM_SHUFFLE(2, 2, 2, 2)), _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m.data[2].x))) };
+			const __m256 w{ _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, _MM_SHUFFLE(3, 3, 3, 3)), _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m.data[3].x))) };
+
+			_mm256_storeu_ps(&result.data[r].x, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(x, y), z), w));
+		}
+#elif defined(SIMD_MATH_ENABLED)
+		for (int r{ 0 }; r < 4; ++r)
+		{
+			_mm_store_ps(&result.data[r].x, MultiplyRow(_mm_load_ps(&data[r].x), m));
+		}
+#else
+		Matrix m_transposed = Transpose(m);
+
+		for (int r{ 0 }; r < 4; ++r)
+		{
+			for (int c{ 0 }; c < 4; ++c)
+			{
+				result[r][c] = Vector4::Dot(data[r], m_transposed[c]);
+			}
+		}
+#endif
+
+		return result;
+	}
+
+	inline const Matrix& Matrix::operator*=(const Matrix& m)
+	{
+		*this = *this * m;
+		return *this;
+	}
+
+	inline Vector3 Matrix::operator*(const Vector3& v) const
+	{
+		Vector3 result{ };
+
+		result.x = ((v.x * (*this)[0][0]) + (v.y * (*this)[1][0]) + (v.z * (*this)[2][0]) + (*this)[3][0]);
+		result.y = ((v.x * (*this)[0][1]) + (v.y * (*this)[1][1]) + (v.z * (*this)[2][1]) + (*this)[3][1]);
+		result.z = ((v.x * (*this)[0][2]) + (v.y * (*this)[1][2]) + (v.z * (*this)[2][2]) + (*this)[3][2]);
+
+		return result;
+	}
+
+#pragma endregion
+}
@@ -0,0 +1,329 @@
+#include "MeshCache.h"
+
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include "DataTypes.h"
+#include "MappedFile.h"
+#include "ObjLoader.h"
+
+namespace dae
+{
+	namespace MeshCache
+	{
+		namespace
+		{
+			constexpr uint64_t PRIME_1{ 0x9E3779B185EBCA87ull };
+			constexpr uint64_t PRIME_2{ 0xC2B2AE3D27D4EB4Full };
+			constexpr uint64_t PRIME_3{ 0x165667B19E3779F9ull };
+
+			constexpr uint64_t ALIGNMENT{ 16 };
+
+			static_assert(std::is_trivially_copyable_v<BVHNode>, "BVH nodes are stored as they are in memory");
+			static_assert(alignof(Vector3) <= ALIGNMENT && alignof(int) <= ALIGNMENT && alignof(BVHNode) <= ALIGNMENT && alignof(BVHSectionHeader) <= ALIGNMENT,
+				"Every section is written ALIGNMENT aligned, which has to be enough for the elements that are used in place");
+
+			inline uint64_t Align(uint64_t offset)
+			{
+				return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+			}
+
+			inline uint64_t ReadWord(const unsigned char* pBytes)
+			{
+				uint64_t word{};
+				std::memcpy(&word, pBytes, sizeof(word));
+				return word;
+			}
+
+			inline uint64_t MixWord(uint64_t hash, uint64_t word)
+			{
+				return std::rotl(hash + (word * PRIME_2), 31) * PRIME_1;
+			}
+
+			//Size and last write time, both 0 when the file does not exist
+			void GetSourceStamp(const std::string& sourceFilename, uint64_t& size, int64_t& writeTime)
+			{
+				std::error_code error{};
+				size = std::filesystem::file_size(sourceFilename, error);
+				if (error)
+				{
+					size = 0;
+					writeTime = 0;
+					return;
+				}
+
+				writeTime = int64_t(std::filesystem::last_write_time(sourceFilename, error).time_since_epoch().count());
+				if (error)
+					writeTime = 0;
+			}
+
+			//The mapping starts on a page boundary, so a section that starts aligned for Element can be used as Element array in place
+			template<typename Element>
+			inline bool IsInFile(uint64_t offset, uint64_t byteCount, uint64_t fileSize)
+			{
+				return offset % alignof(Element) == 0 && offset <= fileSize && byteCount <= fileSize - offset;
+			}
+
+			//The BVH section of a cache that passed every other check, empty when it is missing or was built for other triangles
+			PrebuiltBVH GetPrebuiltBVH(const char* pData, uint64_t fileSize, const MeshCacheHeader& header,
+				std::span<const Vector3> positions, std::span<const int> indices)
+			{
+				if ((header.flags & HasBVH) == 0 || header.bvhSize < sizeof(BVHSectionHeader))
+					return {};
+
+				BVHSectionHeader section{};
+				std::memcpy(&section, pData + header.bvhOffset, sizeof(BVHSectionHeader));
+
+				const uint64_t triangleCount{ header.triangleCount };
+				if (section.leafBlockSize != TriangleBlock::laneCount
+					|| !IsInFile<BVHNode>(section.nodesOffset, section.nodeCount * sizeof(BVHNode), fileSize)
+					|| !IsInFile<uint32_t>(section.primitiveIndicesOffset, triangleCount * sizeof(uint32_t), fileSize))
+					return {};
+
+				if (section.contentHash != GetContentHash(positions, indices))
+					return {};
+
+				return PrebuiltBVH{
+					{ reinterpret_cast<const BVHNode*>(pData + section.nodesOffset), section.nodeCount },
+					{ reinterpret_cast<const uint32_t*>(pData + section.primitiveIndicesOffset), triangleCount } };
+			}
+		}
+
+		uint64_t Hash(const void* pData, size_t size, uint64_t seed)
+		{
+			const unsigned char* pBytes{ static_cast<const unsigned char*>(pData) };
+			size_t offset{ 0 };
+
+			//Four independent lanes over 32 byte blocks so the multiplications overlap
+			uint64_t lanes[4]{ seed + PRIME_1 + PRIME_2, seed + PRIME_2, seed, seed - PRIME_1 };
+
+			for (; offset + 32 <= size; offset += 32)
+			{
+				for (int lane{ 0 }; lane < 4; ++lane)
+				{
+					lanes[lane] = MixWord(lanes[lane], ReadWord(pBytes + offset + (lane * 8)));
+				}
+			}
+
+			uint64_t hash{ std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18) + uint64_t(size) };
+
+			for (; offset + 8 <= size; offset += 8)
+			{
+				hash = (std::rotl(hash ^ MixWord(0, ReadWord(pBytes + offset)), 27) * PRIME_1) + PRIME_3;
+			}
+
+			for (; offset < size; ++offset)
+			{
+				hash = std::rotl(hash ^ (pBytes[offset] * PRIME_3), 11) * PRIME_1;
+			}
+
+			//Every input bit affects every output bit
+			hash ^= hash >> 33;
+			hash *= PRIME_2;
+			hash ^= hash >> 29;
+			hash *= PRIME_3;
+			hash ^= hash >> 32;
+			return hash;
+		}
+
+		uint64_t GetContentHash(std::span<const Vector3> positions, std::span<const int> indices)
+		{
+			return Hash(indices.data(), indices.size_bytes(), Hash(positions.data(), positions.size_bytes()));
+		}
+
+		std::string GetCachePath(const std::string& objFilename)
+		{
+			return objFilename + ".rtmesh";
+		}
+
+		bool Write(const std::string& cacheFilename, const std::string& sourceFilename,
+			std::span<const Vector3> positions, std::span<const Vector3> normals, std::span<const int> indices, const BVH* pBVH)
+		{
+			MeshCacheHeader header{};
+			header.positionCount = uint32_t(positions.size());
+			header.triangleCount = uint32_t(indices.size() / 3);
+			GetSourceStamp(sourceFilename, header.sourceSize, header.sourceWriteTime);
+
+			if (normals.size() != header.triangleCount)
+				return false;
+
+			header.positionsOffset = Align(sizeof(MeshCacheHeader));
+			header.normalsOffset = Align(header.positionsOffset + positions.size_bytes());
+			header.indicesOffset = Align(header.normalsOffset + normals.size_bytes());
+
+			uint64_t fileSize{ header.indicesOffset + indices.size_bytes() };
+
+			BVHSectionHeader section{};
+			if (pBVH != nullptr && !pBVH->IsEmpty())
+			{
+				if (pBVH->GetPrimitiveIndices().size() != header.triangleCount)
+					return false;
+
+				section.contentHash = GetContentHash(positions, indices);
+				section.nodeCount = uint32_t(pBVH->GetNodes().size());
+				section.leafBlockSize = pBVH->GetLeafBlockSize();
+
+				header.flags |= HasBVH;
+				header.bvhOffset = Align(fileSize);
+				section.nodesOffset = Align(header.bvhOffset + sizeof(BVHSectionHeader));
+				section.primitiveIndicesOffset = Align(section.nodesOffset + (pBVH->GetNodes().size() * sizeof(BVHNode)));
+
+				fileSize = section.primitiveIndicesOffset + (pBVH->GetPrimitiveIndices().size() * sizeof(uint32_t));
+				header.bvhSize = fileSize - header.bvhOffset;
+			}
+
+			header.payloadSize = fileSize - sizeof(MeshCacheHeader);
+
+			//Assembled in memory first, the checksum covers the padding as well
+			std::vector<char> buffer(fileSize, 0);
+			std::memcpy(buffer.data() + header.positionsOffset, positions.data(), positions.size_bytes());
+			std::memcpy(buffer.data() + header.normalsOffset, normals.data(), normals.size_bytes());
+			std::memcpy(buffer.data() + header.indicesOffset, indices.data(), indices.size_bytes());
+
+			if ((header.flags & HasBVH) != 0)
+			{
+				std::memcpy(buffer.data() + header.bvhOffset, &section, sizeof(BVHSectionHeader));
+				std::memcpy(buffer.data() + section.nodesOffset, pBVH->GetNodes().data(), pBVH->GetNodes().size() * sizeof(BVHNode));
+				std::memcpy(buffer.data() + section.primitiveIndicesOffset, pBVH->GetPrimitiveIndices().data(), pBVH->GetPrimitiveIndices().size() * sizeof(uint32_t));
+			}
+
+			header.checksum = Hash(buffer.data() + sizeof(MeshCacheHeader), header.payloadSize);
+			std::memcpy(buffer.data(), &header, sizeof(MeshCacheHeader));
+
+			const std::string temporaryFilename{ cacheFilename + ".tmp" };
+			{
+				std::ofstream file{ temporaryFilename, std::ios::binary | std::ios::trunc };
+				if (!file.write(buffer.data(), std::streamsize(buffer.size())))
+					return false;
+			}
+
+			std::error_code error{};
+			std::filesystem::rename(temporaryFilename, cacheFilename, error);
+			if (error)
+			{
+				std::filesystem::remove(temporaryFilename, error);
+				return false;
+			}
+
+			return true;
+		}
+
+		bool Load(const std::string& cacheFilename, const std::string& sourceFilename, TriangleMesh& mesh, PrebuiltBVH* pBVH)
+		{
+			if (pBVH != nullptr)
+				*pBVH = {};
+
+			const std::shared_ptr<MappedFile> pFile{ std::make_shared<MappedFile>() };
+			if (!pFile->Open(cacheFilename) || pFile->GetSize() < sizeof(MeshCacheHeader))
+				return false;
+
+			const char* pData{ pFile->GetData() };
+			const uint64_t fileSize{ pFile->GetSize() };
+
+			MeshCacheHeader header{};
+			std::memcpy(&header, pData, sizeof(MeshCacheHeader));
+
+			if (std::memcmp(header.magic, MeshCacheHeader{}.magic, sizeof(header.magic)) != 0 || header.version != VERSION || (header.flags & ~uint32_t(HasBVH)) != 0)
+				return false;
+
+			//Without the OBJ the cache is all there is, so it is used as it is
+			uint64_t sourceSize{};
+			int64_t sourceWriteTime{};
+			GetSourceStamp(sourceFilename, sourceSize, sourceWriteTime);
+
+			if (sourceSize != 0 && (sourceSize != header.sourceSize || sourceWriteTime != header.sourceWriteTime))
+				return false;
+
+			const uint64_t triangleCount{ header.triangleCount };
+			if (header.payloadSize != fileSize - sizeof(MeshCacheHeader) || (3 * triangleCount) > INT32_MAX
+				|| !IsInFile<Vector3>(header.positionsOffset, header.positionCount * sizeof(Vector3), fileSize)
+				|| !IsInFile<Vector3>(header.normalsOffset, triangleCount * sizeof(Vector3), fileSize)
+				|| !IsInFile<int>(header.indicesOffset, 3 * triangleCount * sizeof(int), fileSize)
+				|| ((header.flags & HasBVH) != 0 && !IsInFile<BVHSectionHeader>(header.bvhOffset, header.bvhSize, fileSize)))
+				return false;
+
+			if (Hash(pData + sizeof(MeshCacheHeader), header.payloadSize) != header.checksum)
+				return false;
+
+			const std::span<const Vector3> positions{ reinterpret_cast<const Vector3*>(pData + header.positionsOffset), header.positionCount };
+			const std::span<const Vector3> normals{ reinterpret_cast<const Vector3*>(pData + header.normalsOffset), triangleCount };
+			const std::span<const int> indices{ reinterpret_cast<const int*>(pData + header.indicesOffset), 3 * triangleCount };
+
+			//The checksum only proves the file is what was written, CreateTriangles trusts the indices
+			for (const int index : indices)
+			{
+				if (index < 0 || uint32_t(index) >= header.positionCount)
+					return false;
+			}
+
+			mesh.positions.clear();
+			mesh.normals.clear();
+			mesh.indices.clear();
+
+			mesh.pMappedFile = pFile;
+			mesh.mappedPositions = positions;
+			mesh.mappedNormals = normals;
+			mesh.mappedIndices = indices;
+
+			if (pBVH != nullptr)
+				*pBVH = GetPrebuiltBVH(pData, fileSize, header, positions, indices);
+
+			return true;
+		}
+
+		bool LoadOBJ(const std::string& objFilename, TriangleMesh& mesh, bool* pIsFromCache, bool* pIsBVHFromCache)
+		{
+			const std::string cacheFilename{ GetCachePath(objFilename) };
+
+			PrebuiltBVH prebuiltBVH{};
+			const bool isFromCache{ Load(cacheFilename, objFilename, mesh, &prebuiltBVH) };
+
+			if (!isFromCache)
+			{
+				ObjMesh objMesh{};
+				if (!ObjLoader::Load(objFilename, objMesh))
+					return false;
+
+				mesh.pMappedFile.reset();
+				mesh.positions = std::move(objMesh.positions);
+				mesh.normals = std::move(objMesh.faceNormals);
+				mesh.indices = std::move(objMesh.indices);
+			}
+
+			//Without a matching BVH in the cache the spans are empty and it is built
+			const bool isBVHFromCache{ mesh.CreateTriangles(prebuiltBVH.nodes, prebuiltBVH.primitiveIndices) && isFromCache };
+
+			if (pIsFromCache != nullptr)
+				*pIsFromCache = isFromCache;
+
+			if (pIsBVHFromCache != nullptr)
+				*pIsBVHFromCache = isBVHFromCache;
+
+			if (isBVHFromCache)
+				return true;
+
+			//A cache without a (matching) BVH is replaced, which a mapping would prevent on some platforms, so the mesh gets its own copy first
+			if (mesh.pMappedFile)
+			{
+				mesh.positions.assign(mesh.mappedPositions.begin(), mesh.mappedPositions.end());
+				mesh.normals.assign(mesh.mappedNormals.begin(), mesh.mappedNormals.end());
+				mesh.indices.assign(mesh.mappedIndices.begin(), mesh.mappedIndices.end());
+
+				mesh.pMappedFile.reset();
+				mesh.mappedPositions = {};
+				mesh.mappedNormals = {};
+				mesh.mappedIndices = {};
+			}
+
+			//Loading still works from a read only directory, only the next start parses and builds again
+			Write(cacheFilename, objFilename, mesh.positions, mesh.normals, mesh.indices, &mesh.bvh);
+			return true;
+		}
+	}
+}
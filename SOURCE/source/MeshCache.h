@@ -0,0 +1,107 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+#include "Vector3.h"
+
+namespace dae
+{
+	class BVH;
+	struct BVHNode;
+	struct TriangleMesh;
+
+	//Binary cache of a parsed mesh, written next to the OBJ it was parsed from ("bunny.obj" gets "bunny.obj.rtmesh").
+	//A MeshCacheHeader is followed by the positions, the face normals, the indices and optionally the BVH of the mesh, each 16 byte aligned,
+	//so a memory mapped cache is used by the TriangleMesh in place. Little endian only, like every platform the project builds for.
+	namespace MeshCache
+	{
+		//Increased whenever the layout changes, caches of other versions are parsed again and overwritten
+		constexpr uint32_t VERSION{ 1 };
+
+		enum MeshCacheFlags : uint32_t
+		{
+			//A prebuilt BVH follows the indices, bvhOffset and bvhSize describe it
+			HasBVH = 1u << 0,
+		};
+
+		//Starts the BVH section at bvhOffset
+		struct BVHSectionHeader
+		{
+			//GetContentHash of the triangles the BVH was built over, a BVH of other triangles is built again
+			uint64_t contentHash{ 0 };
+			uint32_t nodeCount{ 0 };
+			uint32_t leafBlockSize{ 0 };
+
+			//Offsets from the start of the file, there is one primitive index per triangle
+			uint64_t nodesOffset{ 0 };
+			uint64_t primitiveIndicesOffset{ 0 };
+		};
+
+		//A BVH stored in a cache, refers to the mapped file
+		struct PrebuiltBVH
+		{
+			std::span<const BVHNode> nodes{};
+			std::span<const uint32_t> primitiveIndices{};
+		};
+
+		struct MeshCacheHeader
+		{
+			char magic[4]{ 'R', 'T', 'M', 'C' };
+			uint32_t version{ VERSION };
+			uint32_t flags{ 0 };
+			uint32_t positionCount{ 0 };
+			//One normal and three indices per triangle
+			uint32_t triangleCount{ 0 };
+			uint32_t reserved{ 0 };
+
+			//Size and last write time of the OBJ when the cache was written, a cache of a changed OBJ is not used
+			uint64_t sourceSize{ 0 };
+			int64_t sourceWriteTime{ 0 };
+
+			//Offsets from the start of the file
+			uint64_t positionsOffset{ 0 };
+			uint64_t normalsOffset{ 0 };
+			uint64_t indicesOffset{ 0 };
+			uint64_t bvhOffset{ 0 };
+			uint64_t bvhSize{ 0 };
+
+			//Hash of everything after the header
+			uint64_t payloadSize{ 0 };
+			uint64_t checksum{ 0 };
+		};
+
+		//64 bit hash of the bytes, fast enough to check every cache when it is loaded. Not meant to be cryptographically secure.
+		uint64_t Hash(const void* pData, size_t size, uint64_t seed = 0);
+
+		//Hash of the positions and indices, identifies the triangles a stored BVH belongs to
+		uint64_t GetContentHash(std::span<const Vector3> positions, std::span<const int> indices);
+
+		std::string GetCachePath(const std::string& objFilename);
+
+		/**
+		 * \brief Writes the arrays as a cache of sourceFilename, through a temporary file so an interrupted write never leaves a broken cache behind
+		 * \param pBVH BVH built over the triangles of the arrays to store with them, may be nullptr
+		 * \return false when the file can not be written
+		 */
+		bool Write(const std::string& cacheFilename, const std::string& sourceFilename,
+			std::span<const Vector3> positions, std::span<const Vector3> normals, std::span<const int> indices, const BVH* pBVH = nullptr);
+
+		/**
+		 * \brief Maps the cache and lets mesh use its arrays in place, call CreateTriangles afterwards
+		 * \param pBVH set to the stored BVH when there is one that matches the content hash and leaf block size of the mesh, left empty otherwise. May be nullptr
+		 * \return false when the cache does not exist, is damaged, has another version or the source file changed since it was written
+		 */
+		bool Load(const std::string& cacheFilename, const std::string& sourceFilename, TriangleMesh& mesh, PrebuiltBVH* pBVH = nullptr);
+
+		/**
+		 * \brief Loads an OBJ from its cache, or parses it with ObjLoader and writes the cache for the next time, then creates the triangles of mesh.
+		 * The BVH is restored from the cache when it has a matching one, otherwise it is built and stored in the cache
+		 * \param pIsFromCache set to whether the cache was used, may be nullptr
+		 * \param pIsBVHFromCache set to whether the BVH was restored from the cache, may be nullptr
+		 * \return false when neither the cache nor the OBJ can be read, a cache that can not be written is not an error
+		 */
+		bool LoadOBJ(const std::string& objFilename, TriangleMesh& mesh, bool* pIsFromCache = nullptr, bool* pIsBVHFromCache = nullptr);
+	}
+}
@@ -0,0 +1,1573 @@
+#include "Microbenchmarks.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "CpuFeatures.h"
+#include "DataTypes.h"
+#include "FastBRDFs.h"
+#include "Material.h"
+#include "MeshCache.h"
+#include "ObjLoader.h"
+#include "Scene.h"
+#include "Sphere.h"
+#include "TextParsing.h"
+#include "Utils.h"
+
+namespace dae
+{
+	namespace Microbenchmarks
+	{
+		namespace
+		{
+			using Clock = std::chrono::steady_clock;
+
+			//Fixed seed so every run and every build tests the same data
+			constexpr uint32_t RANDOM_SEED{ 1337 };
+
+			Vector3 RandomPoint(std::mt19937& generator, float extent)
+			{
+				std::uniform_real_distribution<float> distribution{ -extent, extent };
+				return { distribution(generator), distribution(generator), distribution(generator) };
+			}
+
+			std::vector<Ray> CreateRays(std::mt19937& generator, uint32_t rayCount)
+			{
+				std::vector<Ray> rays{};
+				rays.reserve(rayCount);
+
+				for (uint32_t i{ 0 }; i < rayCount; ++i)
+				{
+					//Rays start on a sphere around the data and aim at a random point inside it, so roughly half of them hit something
+					const Vector3 origin{ RandomPoint(generator, 1.0f).Normalized() * 4.0f };
+					const Vector3 target{ RandomPoint(generator, 1.0f) };
+					rays.push_back(Ray{ origin, (target - origin).Normalized() });
+				}
+
+				return rays;
+			}
+
+			template<typename Kernel>
+			double MeasureMilliseconds(uint32_t iterations, Kernel&& kernel)
+			{
+				const Clock::time_point start{ Clock::now() };
+
+				for (uint32_t iteration{ 0 }; iteration < iterations; ++iteration)
+				{
+					kernel();
+				}
+
+				return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			}
+
+			constexpr uint32_t IMAGE_WIDTH{ 640 };
+			constexpr uint32_t IMAGE_HEIGHT{ 480 };
+
+			//The primary ray directions the Renderer traces for an IMAGE_WIDTH x IMAGE_HEIGHT image, in image order
+			std::vector<Vector3> CreatePrimaryDirections(Camera& camera)
+			{
+				const Matrix cameraToWorld{ camera.CalculateCameraToWorld() };
+				const float aspectRatio{ float(IMAGE_WIDTH) / float(IMAGE_HEIGHT) };
+				const float FOV{ std::tan((TO_RADIANS * camera.GetFOVAngle()) / 2.0f) };
+
+				std::vector<Vector3> directions{};
+				directions.reserve(IMAGE_WIDTH * IMAGE_HEIGHT);
+
+				for (uint32_t py{ 0 }; py < IMAGE_HEIGHT; ++py)
+				{
+					for (uint32_t px{ 0 }; px < IMAGE_WIDTH; ++px)
+					{
+						const float cX{ (((2.0f * (px + 0.5f)) / IMAGE_WIDTH) - 1.0f) * aspectRatio * FOV };
+						const float cY{ (1.0f - ((2.0f * py) / IMAGE_HEIGHT)) * FOV };
+						directions.push_back(((cX * cameraToWorld.GetAxisX()) + (cY * cameraToWorld.GetAxisY()) + cameraToWorld.GetAxisZ()).Normalized());
+					}
+				}
+
+				return directions;
+			}
+
+			//A scene initialized like the Renderer initializes it, with the primary ray directions of an IMAGE_WIDTH x IMAGE_HEIGHT image from its camera
+			struct SceneSetup
+			{
+				std::unique_ptr<Scene> pScene{};
+				Vector3 cameraOrigin{};
+				std::vector<Vector3> directions{};
+			};
+
+			SceneSetup CreateSceneSetup(const char* pSceneName)
+			{
+				SceneSetup setup{ CreateScene(pSceneName) };
+				setup.pScene->Initialize();
+				setup.cameraOrigin = setup.pScene->GetCamera().GetOrigin();
+				setup.directions = CreatePrimaryDirections(setup.pScene->GetCamera());
+				return setup;
+			}
+
+			//Calls hitCallback(direction, hit) for every primary ray that hits something
+			template<typename HitCallback>
+			void ForEachPrimaryHit(const SceneSetup& setup, HitCallback&& hitCallback)
+			{
+				for (const Vector3& direction : setup.directions)
+				{
+					HitRecord hit{};
+					if (setup.pScene->TryGetClosestHit(Ray{ setup.cameraOrigin, direction }, hit))
+						hitCallback(direction, hit);
+				}
+			}
+
+			//Triangles of random shape around random centers, with the default cull mode
+			std::vector<Triangle> CreateTriangles(std::mt19937& generator, uint32_t triangleCount)
+			{
+				std::vector<Triangle> triangles{};
+				triangles.reserve(triangleCount);
+
+				for (uint32_t i{ 0 }; i < triangleCount; ++i)
+				{
+					const Vector3 center{ RandomPoint(generator, 1.0f) };
+					triangles.emplace_back(center + RandomPoint(generator, 0.25f), center + RandomPoint(generator, 0.25f), center + RandomPoint(generator, 0.25f));
+				}
+
+				return triangles;
+			}
+
+			std::string GetTemporaryFilename(const char* pFilename)
+			{
+				return (std::filesystem::temp_directory_path() / pFilename).string();
+			}
+
+			void PrintThroughput(const char* pKey, uint64_t testCount, double milliseconds)
+			{
+				std::cout << pKey << "_ms=" << milliseconds << "\n";
+				std::cout << pKey << "_mtests_per_s=" << (milliseconds > 0.0 ? double(testCount) / (milliseconds * 1000.0) : 0.0) << "\n";
+			}
+
+			//How many times faster the new implementation is than the one it replaced
+			void PrintSpeedup(const std::string& key, double referenceMilliseconds, double milliseconds)
+			{
+				std::cout << key << "=" << (milliseconds > 0.0 ? referenceMilliseconds / milliseconds : 0.0) << "\n";
+			}
+
+#pragma region Triangle
+			//The plane intersection followed by three edge tests that Moller-Trumbore replaced
+			bool HitTest_Triangle_EdgeTests(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord)
+			{
+				const float rayDotNormal{ Vector3::Dot(ray.direction, triangle.normal) };
+
+				if (AreEqual(rayDotNormal, 0.0f) ||
+					(triangle.cullMode == TriangleCullMode::BackFaceCulling && rayDotNormal > 0.0f) ||
+					(triangle.cullMode == TriangleCullMode::FrontFaceCulling && rayDotNormal < 0.0f))
+					return false;
+
+				const Vector3 rayToTriangle{ triangle.v0 - ray.origin };
+				const float cameraToPointDistance = Vector3::Dot(rayToTriangle, triangle.normal) / rayDotNormal;
+
+				if (cameraToPointDistance <= ray.min || cameraToPointDistance >= ray.max)
+					return false;
+
+				const Vector3 hitPoint{ ray.origin + (ray.direction * cameraToPointDistance) };
+
+				auto isPointInTriangleEdge = [&](const Vector3& vertex1, const Vector3& vertex2)
+					{
+						return Vector3::Dot(Vector3::Cross(vertex2 - vertex1, hitPoint - vertex1), triangle.normal) >= 0.0f;
+					};
+
+				if (isPointInTriangleEdge(triangle.v0, triangle.v1) &&
+					isPointInTriangleEdge(triangle.v1, triangle.v2) &&
+					isPointInTriangleEdge(triangle.v2, triangle.v0))
+				{
+					hitRecord.didHit = true;
+					hitRecord.cameraToPointDistance = cameraToPointDistance;
+					hitRecord.origin = hitPoint;
+					hitRecord.materialIndex = triangle.materialIndex;
+					hitRecord.normal = triangle.normal;
+					return true;
+				}
+
+				return false;
+			}
+
+			void RunTriangle(uint32_t iterations)
+			{
+				constexpr uint32_t triangleCount{ 1024 };
+				constexpr uint32_t rayCount{ 1024 };
+
+				std::mt19937 generator{ RANDOM_SEED };
+
+				const TriangleCullMode cullModes[]{ TriangleCullMode::BackFaceCulling, TriangleCullMode::FrontFaceCulling, TriangleCullMode::NoCulling };
+
+				std::vector<Triangle> triangles{ CreateTriangles(generator, triangleCount) };
+				for (uint32_t i{ 0 }; i < triangleCount; ++i)
+				{
+					triangles[i].cullMode = cullModes[i % 3];
+				}
+
+				const std::vector<Ray> rays{ CreateRays(generator, rayCount) };
+
+				//Both kernels have to agree on every ray/triangle pair before their timings mean anything
+				uint32_t mismatchCount{ 0 };
+				float maxDistanceError{ 0.0f };
+
+				for (const Ray& ray : rays)
+				{
+					for (const Triangle& triangle : triangles)
+					{
+						HitRecord referenceHit{};
+						HitRecord hit{};
+						const bool referenceDidHit{ HitTest_Triangle_EdgeTests(triangle, ray, referenceHit) };
+						const bool didHit{ GeometryUtils::HitTest_Triangle(triangle, ray, hit) };
+
+						if (referenceDidHit != didHit)
+							++mismatchCount;
+						else if (didHit)
+							maxDistanceError = std::max(maxDistanceError, std::abs(referenceHit.cameraToPointDistance - hit.cameraToPointDistance));
+					}
+				}
+
+				uint64_t referenceHitCount{ 0 };
+				const double referenceTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (const Ray& ray : rays)
+						{
+							for (const Triangle& triangle : triangles)
+							{
+								HitRecord hitRecord{};
+								referenceHitCount += HitTest_Triangle_EdgeTests(triangle, ray, hitRecord);
+							}
+						}
+					}) };
+
+				uint64_t hitCount{ 0 };
+				const double mollerTrumboreTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (const Ray& ray : rays)
+						{
+							for (const Triangle& triangle : triangles)
+							{
+								HitRecord hitRecord{};
+								hitCount += GeometryUtils::HitTest_Triangle(triangle, ray, hitRecord);
+							}
+						}
+					}) };
+
+				const uint64_t testCount{ uint64_t(iterations) * triangleCount * rayCount };
+
+				std::cout << "tests=" << testCount << "\n";
+				PrintThroughput("edge_tests", testCount, referenceTime);
+				PrintThroughput("moller_trumbore", testCount, mollerTrumboreTime);
+				PrintSpeedup("speedup", referenceTime, mollerTrumboreTime);
+				std::cout << "hits=" << hitCount << "\n";
+				std::cout << "reference_hits=" << referenceHitCount << "\n";
+				std::cout << "mismatches=" << mismatchCount << "\n";
+				std::cout << "max_distance_error=" << maxDistanceError << std::endl;
+			}
+
+			void RunTriangleBlock(uint32_t iterations)
+			{
+				constexpr uint32_t triangleCount{ 1024 };
+				constexpr uint32_t rayCount{ 1024 };
+
+				std::mt19937 generator{ RANDOM_SEED };
+
+				std::vector<Triangle> triangles{ CreateTriangles(generator, triangleCount) };
+				std::vector<TriangleBlock> blocks((triangleCount + TriangleBlock::laneCount - 1) / TriangleBlock::laneCount);
+
+				for (uint32_t i{ 0 }; i < triangleCount; ++i)
+				{
+					triangles[i].cullMode = TriangleCullMode::NoCulling;
+					blocks[i / TriangleBlock::laneCount].SetLane(i % TriangleBlock::laneCount, triangles[i]);
+				}
+
+				const std::vector<Ray> rays{ CreateRays(generator, rayCount) };
+
+				//Closest hit over all triangles, the way a mesh leaf is tested
+				auto closestHitScalar = [&](const Ray& ray)
+					{
+						Ray currentRay{ ray };
+						HitRecord hitRecord{};
+
+						for (const Triangle& triangle : triangles)
+						{
+							if (GeometryUtils::HitTest_Triangle(triangle, currentRay, hitRecord))
+								currentRay.max = hitRecord.cameraToPointDistance;
+						}
+
+						return hitRecord;
+					};
+
+				auto closestHitBlocks = [&](const Ray& ray)
+					{
+						Ray currentRay{ ray };
+						HitRecord hitRecord{};
+
+						for (const TriangleBlock& block : blocks)
+						{
+							if (GeometryUtils::HitTest_TriangleBlock(block, TriangleCullMode::NoCulling, currentRay, hitRecord))
+								currentRay.max = hitRecord.cameraToPointDistance;
+						}
+
+						return hitRecord;
+					};
+
+				uint32_t mismatchCount{ 0 };
+				for (const Ray& ray : rays)
+				{
+					const HitRecord scalarHit{ closestHitScalar(ray) };
+					const HitRecord blockHit{ closestHitBlocks(ray) };
+
+					if (scalarHit.didHit != blockHit.didHit || scalarHit.cameraToPointDistance != blockHit.cameraToPointDistance || scalarHit.u != blockHit.u || scalarHit.v != blockHit.v)
+						++mismatchCount;
+				}
+
+				uint64_t scalarHitCount{ 0 };
+				const double scalarTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (const Ray& ray : rays)
+						{
+							scalarHitCount += closestHitScalar(ray).didHit;
+						}
+					}) };
+
+				uint64_t blockHitCount{ 0 };
+				const double blockTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (const Ray& ray : rays)
+						{
+							blockHitCount += closestHitBlocks(ray).didHit;
+						}
+					}) };
+
+				const uint64_t testCount{ uint64_t(iterations) * triangleCount * rayCount };
+
+				std::cout << "tests=" << testCount << "\n";
+				PrintThroughput("scalar", testCount, scalarTime);
+				PrintThroughput("block", testCount, blockTime);
+				PrintSpeedup("speedup", scalarTime, blockTime);
+				std::cout << "hits=" << blockHitCount << "\n";
+				std::cout << "reference_hits=" << scalarHitCount << "\n";
+				std::cout << "mismatches=" << mismatchCount << std::endl;
+			}
+#pragma endregion
+
+#pragma region Sphere
+			void RunSphere(uint32_t iterations)
+			{
+				constexpr uint32_t sphereCount{ 4096 };
+				constexpr uint32_t rayCount{ 256 };
+
+				std::mt19937 generator{ RANDOM_SEED };
+				std::uniform_real_distribution<float> radiusDistribution{ 0.005f, 0.05f };
+
+				std::vector<Sphere> spheres{};
+				spheres.reserve(sphereCount);
+
+				std::vector<SphereBlock> blocks((sphereCount + SphereBlock::laneCount - 1) / SphereBlock::laneCount);
+
+				for (uint32_t i{ 0 }; i < sphereCount; ++i)
+				{
+					const Sphere& sphere{ spheres.emplace_back(RandomPoint(generator, 1.0f), radiusDistribution(generator), int(i % 256)) };
+					blocks[i / SphereBlock::laneCount].SetLane(i % SphereBlock::laneCount, sphere);
+				}
+
+				const std::vector<Ray> rays{ CreateRays(generator, rayCount) };
+
+				//Closest hit over all spheres, the way a leaf of the sphere BVH is tested
+				auto closestHitScalar = [&](const Ray& ray)
+					{
+						Ray currentRay{ ray };
+						HitRecord hitRecord{};
+
+						for (const Sphere& sphere : spheres)
+						{
+							if (GeometryUtils::HitTest_Sphere(sphere, currentRay, hitRecord))
+								currentRay.max = hitRecord.cameraToPointDistance;
+						}
+
+						return hitRecord;
+					};
+
+				auto closestHitBlocks = [&](const Ray& ray, bool useAVX2)
+					{
+						Ray currentRay{ ray };
+						HitRecord hitRecord{};
+
+						for (const SphereBlock& block : blocks)
+						{
+							if (GeometryUtils::HitTest_SphereBlock(block, currentRay, hitRecord, useAVX2))
+								currentRay.max = hitRecord.cameraToPointDistance;
+						}
+
+						return hitRecord;
+					};
+
+				const bool hasAVX2{ CpuFeatures::HasAVX2() };
+
+				auto isSameHit = [](const HitRecord& a, const HitRecord& b)
+					{
+						return a.didHit == b.didHit && a.cameraToPointDistance == b.cameraToPointDistance && a.materialIndex == b.materialIndex
+							&& a.normal.x == b.normal.x && a.normal.y == b.normal.y && a.normal.z == b.normal.z;
+					};
+
+				uint32_t mismatchCount{ 0 };
+				for (const Ray& ray : rays)
+				{
+					const HitRecord scalarHit{ closestHitScalar(ray) };
+
+					if (!isSameHit(scalarHit, closestHitBlocks(ray, false)))
+						++mismatchCount;
+
+					if (hasAVX2 && !isSameHit(scalarHit, closestHitBlocks(ray, true)))
+						++mismatchCount;
+				}
+
+				uint64_t scalarHitCount{ 0 };
+				const double scalarTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (const Ray& ray : rays)
+						{
+							scalarHitCount += closestHitScalar(ray).didHit;
+						}
+					}) };
+
+				uint64_t sseHitCount{ 0 };
+				const double sseTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (const Ray& ray : rays)
+						{
+							sseHitCount += closestHitBlocks(ray, false).didHit;
+						}
+					}) };
+
+				const uint64_t testCount{ uint64_t(iterations) * sphereCount * rayCount };
+
+				std::cout << "tests=" << testCount << "\n";
+				std::cout << "avx2=" << hasAVX2 << "\n";
+				PrintThroughput("scalar", testCount, scalarTime);
+				PrintThroughput("sse", testCount, sseTime);
+
+				if (hasAVX2)
+				{
+					uint64_t avx2HitCount{ 0 };
+					const double avx2Time{ MeasureMilliseconds(iterations, [&]()
+						{
+							for (const Ray& ray : rays)
+							{
+								avx2HitCount += closestHitBlocks(ray, true).didHit;
+							}
+						}) };
+
+					PrintThroughput("avx2", testCount, avx2Time);
+					PrintSpeedup("avx2_speedup", scalarTime, avx2Time);
+					std::cout << "avx2_hits=" << avx2HitCount << "\n";
+				}
+
+				PrintSpeedup("sse_speedup", scalarTime, sseTime);
+				std::cout << "sse_hits=" << sseHitCount << "\n";
+				std::cout << "reference_hits=" << scalarHitCount << "\n";
+				std::cout << "mismatches=" << mismatchCount << std::endl;
+			}
+#pragma endregion
+
+#pragma region Packets
+			//Primary rays of a 640x480 image through the scene, traced one by one and as RayPacket blocks
+			void RunPacketsOnScene(const char* pSceneName, uint32_t iterations)
+			{
+				const SceneSetup setup{ CreateSceneSetup(pSceneName) };
+				Scene* const pScene{ setup.pScene.get() };
+				const Vector3& cameraOrigin{ setup.cameraOrigin };
+				const std::vector<Vector3>& directions{ setup.directions };
+
+				//Image directions of the rays in packet p
+				auto getDirectionIndex = [](uint32_t packetIndex, uint32_t rayIndex)
+					{
+						const uint32_t packetsPerRow{ IMAGE_WIDTH / RayPacket::width };
+						const uint32_t px{ ((packetIndex % packetsPerRow) * RayPacket::width) + (rayIndex % RayPacket::width) };
+						const uint32_t py{ ((packetIndex / packetsPerRow) * RayPacket::width) + (rayIndex / RayPacket::width) };
+						return px + (py * IMAGE_WIDTH);
+					};
+
+				std::vector<RayPacket> packets((IMAGE_WIDTH / RayPacket::width) * (IMAGE_HEIGHT / RayPacket::width));
+
+				for (uint32_t packetIndex{ 0 }; packetIndex < packets.size(); ++packetIndex)
+				{
+					RayPacket& packet{ packets[packetIndex] };
+					packet.origin = cameraOrigin;
+
+					for (uint32_t rayIndex{ 0 }; rayIndex < RayPacket::rayCount; ++rayIndex)
+					{
+						packet.SetRay(rayIndex, directions[getDirectionIndex(packetIndex, rayIndex)]);
+					}
+
+					packet.UpdateInverseDirectionBounds();
+				}
+
+				uint32_t mismatchCount{ 0 };
+				uint32_t incoherentCount{ 0 };
+
+				for (uint32_t packetIndex{ 0 }; packetIndex < packets.size(); ++packetIndex)
+				{
+					HitRecord packetHits[RayPacket::rayCount]{};
+					pScene->TryGetClosestHits(packets[packetIndex], packetHits);
+					incoherentCount += !packets[packetIndex].isCoherent;
+
+					for (uint32_t rayIndex{ 0 }; rayIndex < RayPacket::rayCount; ++rayIndex)
+					{
+						HitRecord hit{};
+						pScene->TryGetClosestHit(Ray{ cameraOrigin, directions[getDirectionIndex(packetIndex, rayIndex)] }, hit);
+
+						const HitRecord& packetHit{ packetHits[rayIndex] };
+						if (hit.didHit != packetHit.didHit || (hit.didHit &&
+							(hit.cameraToPointDistance != packetHit.cameraToPointDistance || hit.materialIndex != packetHit.materialIndex ||
+								hit.normal.x != packetHit.normal.x || hit.normal.y != packetHit.normal.y || hit.normal.z != packetHit.normal.z)))
+							++mismatchCount;
+					}
+				}
+
+				uint64_t singleHitCount{ 0 };
+				const double singleTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (const Vector3& direction : directions)
+						{
+							HitRecord hit{};
+							singleHitCount += pScene->TryGetClosestHit(Ray{ cameraOrigin, direction }, hit);
+						}
+					}) };
+
+				uint64_t packetHitCount{ 0 };
+				const double packetTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (const RayPacket& packet : packets)
+						{
+							HitRecord hits[RayPacket::rayCount]{};
+							packetHitCount += std::popcount(pScene->TryGetClosestHits(packet, hits));
+						}
+					}) };
+
+				const uint64_t rayCount{ uint64_t(iterations) * directions.size() };
+				const std::string sceneName{ pSceneName };
+
+				std::cout << sceneName << "_rays=" << rayCount << "\n";
+				std::cout << sceneName << "_incoherent_packets=" << incoherentCount << "/" << packets.size() << "\n";
+				PrintThroughput((sceneName + "_single").c_str(), rayCount, singleTime);
+				PrintThroughput((sceneName + "_packets").c_str(), rayCount, packetTime);
+				PrintSpeedup(sceneName + "_speedup", singleTime, packetTime);
+				std::cout << sceneName << "_single_hits=" << singleHitCount << "\n";
+				std::cout << sceneName << "_packet_hits=" << packetHitCount << "\n";
+				std::cout << sceneName << "_mismatches=" << mismatchCount << "\n";
+			}
+
+			void RunPackets(uint32_t iterations)
+			{
+				RunPacketsOnScene("W3", iterations);
+				RunPacketsOnScene("W4", iterations);
+				std::cout << std::flush;
+			}
+#pragma endregion
+
+#pragma region Shadows
+			//Shadow rays from the primary hits of a 640x480 image to every light, the any-hit DoesHit against a closest hit query that is cut short at the light
+			void RunShadowsOnScene(const char* pSceneName, uint32_t iterations)
+			{
+				const SceneSetup setup{ CreateSceneSetup(pSceneName) };
+				Scene* const pScene{ setup.pScene.get() };
+				std::vector<Ray> shadowRays{};
+
+				ForEachPrimaryHit(setup, [&](const Vector3&, const HitRecord& hit)
+					{
+						//Built like the Renderer builds them
+						for (const Light& light : pScene->GetLights())
+						{
+							const Vector3 hitToLight{ light.origin - hit.origin };
+							const float distanceFromLight{ hitToLight.Magnitude() };
+
+							Ray& shadowRay{ shadowRays.emplace_back(Ray{ hit.origin, hitToLight / distanceFromLight }) };
+							shadowRay.max = distanceFromLight;
+							shadowRay.min = 0.01f;
+						}
+					});
+
+				uint32_t mismatchCount{ 0 };
+
+				for (const Ray& shadowRay : shadowRays)
+				{
+					HitRecord hit{};
+					if (pScene->DoesHit(shadowRay) != pScene->TryGetClosestHit(shadowRay, hit))
+						++mismatchCount;
+				}
+
+				uint64_t closestHitOccludedCount{ 0 };
+				const double closestHitTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (const Ray& shadowRay : shadowRays)
+						{
+							HitRecord hit{};
+							closestHitOccludedCount += pScene->TryGetClosestHit(shadowRay, hit);
+						}
+					}) };
+
+				uint64_t anyHitOccludedCount{ 0 };
+				const double anyHitTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (const Ray& shadowRay : shadowRays)
+						{
+							anyHitOccludedCount += pScene->DoesHit(shadowRay);
+						}
+					}) };
+
+				const uint64_t rayCount{ uint64_t(iterations) * shadowRays.size() };
+				const std::string sceneName{ pSceneName };
+
+				std::cout << sceneName << "_shadow_rays=" << rayCount << "\n";
+				PrintThroughput((sceneName + "_closest_hit").c_str(), rayCount, closestHitTime);
+				PrintThroughput((sceneName + "_any_hit").c_str(), rayCount, anyHitTime);
+				PrintSpeedup(sceneName + "_speedup", closestHitTime, anyHitTime);
+				std::cout << sceneName << "_closest_hit_occluded=" << closestHitOccludedCount << "\n";
+				std::cout << sceneName << "_any_hit_occluded=" << anyHitOccludedCount << "\n";
+				std::cout << sceneName << "_mismatches=" << mismatchCount << "\n";
+			}
+
+			//The block any-hit kernels against the scalar DoesHit_Sphere and DoesHit_Triangle, block by block.
+			//Rays end around the middle of the data, so ray.max decides some of the hits
+			void RunShadowKernels(uint32_t iterations)
+			{
+				constexpr uint32_t primitiveCount{ 1024 };
+				constexpr uint32_t rayCount{ 1024 };
+
+				std::mt19937 generator{ RANDOM_SEED };
+				std::uniform_real_distribution<float> radiusDistribution{ 0.005f, 0.05f };
+				std::uniform_real_distribution<float> maxDistribution{ 3.0f, 5.0f };
+
+				std::vector<Sphere> spheres{};
+				spheres.reserve(primitiveCount);
+				std::vector<SphereBlock> sphereBlocks(primitiveCount / SphereBlock::laneCount);
+
+				for (uint32_t i{ 0 }; i < primitiveCount; ++i)
+				{
+					const Sphere& sphere{ spheres.emplace_back(RandomPoint(generator, 1.0f), radiusDistribution(generator), 0) };
+					sphereBlocks[i / SphereBlock::laneCount].SetLane(i % SphereBlock::laneCount, sphere);
+				}
+
+				std::vector<Triangle> triangles{ CreateTriangles(generator, primitiveCount) };
+				std::vector<TriangleBlock> triangleBlocks(primitiveCount / TriangleBlock::laneCount);
+
+				for (uint32_t i{ 0 }; i < primitiveCount; ++i)
+				{
+					triangles[i].cullMode = TriangleCullMode::NoCulling;
+					triangleBlocks[i / TriangleBlock::laneCount].SetLane(i % TriangleBlock::laneCount, triangles[i]);
+				}
+
+				std::vector<Ray> rays{ CreateRays(generator, rayCount) };
+				for (Ray& ray : rays)
+				{
+					ray.min = 0.01f;
+					ray.max = maxDistribution(generator);
+				}
+
+				const bool hasAVX2{ CpuFeatures::HasAVX2() };
+
+				uint32_t sphereMismatchCount{ 0 };
+				uint32_t triangleMismatchCount{ 0 };
+
+				for (const Ray& ray : rays)
+				{
+					for (uint32_t block{ 0 }; block < sphereBlocks.size(); ++block)
+					{
+						bool scalarHit{ false };
+						for (uint32_t lane{ 0 }; lane < SphereBlock::laneCount; ++lane)
+						{
+							scalarHit |= GeometryUtils::DoesHit_Sphere(spheres[(block * SphereBlock::laneCount) + lane], ray);
+						}
+
+						if (scalarHit != GeometryUtils::DoesHit_SphereBlock(sphereBlocks[block], ray, false))
+							++sphereMismatchCount;
+
+						if (hasAVX2 && scalarHit != GeometryUtils::DoesHit_SphereBlock(sphereBlocks[block], ray, true))
+							++sphereMismatchCount;
+					}
+
+					for (uint32_t block{ 0 }; block < triangleBlocks.size(); ++block)
+					{
+						bool scalarHit{ false };
+						for (uint32_t lane{ 0 }; lane < TriangleBlock::laneCount; ++lane)
+						{
+							scalarHit |= GeometryUtils::DoesHit_Triangle(triangles[(block * TriangleBlock::laneCount) + lane], ray);
+						}
+
+						if (scalarHit != GeometryUtils::DoesHit_TriangleBlock(triangleBlocks[block], TriangleCullMode::NoCulling, ray))
+							++triangleMismatchCount;
+					}
+				}
+
+				uint64_t scalarOccludedCount{ 0 };
+				const double scalarTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (const Ray& ray : rays)
+						{
+							scalarOccludedCount += std::any_of(spheres.begin(), spheres.end(), [&](const Sphere& sphere) { return GeometryUtils::DoesHit_Sphere(sphere, ray); })
+								|| std::any_of(triangles.begin(), triangles.end(), [&](const Triangle& triangle) { return GeometryUtils::DoesHit_Triangle(triangle, ray); });
+						}
+					}) };
+
+				uint64_t blockOccludedCount{ 0 };
+				const double blockTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (const Ray& ray : rays)
+						{
+							blockOccludedCount += std::any_of(sphereBlocks.begin(), sphereBlocks.end(), [&](const SphereBlock& block) { return GeometryUtils::DoesHit_SphereBlock(block, ray); })
+								|| std::any_of(triangleBlocks.begin(), triangleBlocks.end(), [&](const TriangleBlock& block) { return GeometryUtils::DoesHit_TriangleBlock(block, TriangleCullMode::NoCulling, ray); });
+						}
+					}) };
+
+				const uint64_t shadowRayCount{ uint64_t(iterations) * rayCount };
+
+				std::cout << "kernel_shadow_rays=" << shadowRayCount << "\n";
+				std::cout << "kernel_avx2=" << hasAVX2 << "\n";
+				PrintThroughput("kernel_scalar", shadowRayCount, scalarTime);
+				PrintThroughput("kernel_block", shadowRayCount, blockTime);
+				PrintSpeedup("kernel_speedup", scalarTime, blockTime);
+				std::cout << "kernel_scalar_occluded=" << scalarOccludedCount << "\n";
+				std::cout << "kernel_block_occluded=" << blockOccludedCount << "\n";
+				std::cout << "kernel_sphere_mismatches=" << sphereMismatchCount << "\n";
+				std::cout << "kernel_triangle_mismatches=" << triangleMismatchCount << "\n";
+			}
+
+			void RunShadows(uint32_t iterations)
+			{
+				RunShadowKernels(iterations);
+				RunShadowsOnScene("W3", iterations);
+				RunShadowsOnScene("W4", iterations);
+				std::cout << std::flush;
+			}
+#pragma endregion
+
+#pragma region Materials
+			struct ShadingSample
+			{
+				HitRecord hit{};
+				Vector3 l{};
+				Vector3 v{};
+			};
+
+			//Every primary hit with a material isIncluded accepts, lit by every light
+			template<typename MaterialFilter>
+			std::vector<ShadingSample> CreateShadingSamples(const SceneSetup& setup, MaterialFilter&& isIncluded)
+			{
+				const std::vector<MaterialData>& materialTable{ setup.pScene->GetMaterialTable() };
+				std::vector<ShadingSample> samples{};
+
+				ForEachPrimaryHit(setup, [&](const Vector3& direction, const HitRecord& hit)
+					{
+						if (!isIncluded(materialTable[hit.materialIndex]))
+							return;
+
+						for (const Light& light : setup.pScene->GetLights())
+						{
+							samples.push_back(ShadingSample{ hit, (light.origin - hit.origin).Normalized(), -direction });
+						}
+					});
+
+				return samples;
+			}
+
+			template<MaterialType type>
+			void ShadeSamplesOfType(const std::vector<MaterialData>& materialTable, const std::vector<ShadingSample>& samples, const uint32_t* pBegin, const uint32_t* pEnd, ColorRGB& sum)
+			{
+				for (const uint32_t* pIndex{ pBegin }; pIndex != pEnd; ++pIndex)
+				{
+					const ShadingSample& sample{ samples[*pIndex] };
+					sum += MaterialShading::Shade<type>(materialTable[sample.hit.materialIndex], sample.hit, sample.l, sample.v);
+				}
+			}
+
+			//Every primary hit of a 640x480 image of W4 lit by every light, shaded through the virtual Material::Shade,
+			//through the material table one sample at a time, and grouped by material type like the Renderer does
+			void RunMaterials(uint32_t iterations)
+			{
+				const SceneSetup setup{ CreateSceneSetup("W4") };
+				const std::vector<Material*>& materials{ setup.pScene->GetMaterials() };
+				const std::vector<MaterialData>& materialTable{ setup.pScene->GetMaterialTable() };
+				const std::vector<ShadingSample> samples{ CreateShadingSamples(setup, [](const MaterialData&) { return true; }) };
+
+				uint32_t mismatchCount{ 0 };
+
+				for (const ShadingSample& sample : samples)
+				{
+					const ColorRGB reference{ materials[sample.hit.materialIndex]->Shade(sample.hit, sample.l, sample.v) };
+					const ColorRGB color{ MaterialShading::Shade(materialTable[sample.hit.materialIndex], sample.hit, sample.l, sample.v) };
+
+					if (reference.r != color.r || reference.g != color.g || reference.b != color.b)
+						++mismatchCount;
+				}
+
+				ColorRGB virtualSum{};
+				const double virtualTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (const ShadingSample& sample : samples)
+						{
+							virtualSum += materials[sample.hit.materialIndex]->Shade(sample.hit, sample.l, sample.v);
+						}
+					}) };
+
+				ColorRGB tableSum{};
+				const double tableTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (const ShadingSample& sample : samples)
+						{
+							tableSum += MaterialShading::Shade(materialTable[sample.hit.materialIndex], sample.hit, sample.l, sample.v);
+						}
+					}) };
+
+				std::vector<uint32_t> sortedIndices(samples.size());
+				ColorRGB groupedSum{};
+				const double groupedTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						//The same counting sort on the material type as the Renderer
+						uint32_t typeStarts[MaterialData::typeCount + 1]{};
+						for (const ShadingSample& sample : samples)
+						{
+							++typeStarts[uint32_t(materialTable[sample.hit.materialIndex].type) + 1];
+						}
+
+						for (uint32_t type{ 0 }; type < MaterialData::typeCount; ++type)
+						{
+							typeStarts[type + 1] += typeStarts[type];
+						}
+
+						uint32_t typeEnds[MaterialData::typeCount]{};
+						std::copy_n(typeStarts, MaterialData::typeCount, typeEnds);
+
+						for (uint32_t index{ 0 }; index < samples.size(); ++index)
+						{
+							sortedIndices[typeEnds[uint32_t(materialTable[samples[index].hit.materialIndex].type)]++] = index;
+						}
+
+						const uint32_t* pSorted{ sortedIndices.data() };
+						ShadeSamplesOfType<MaterialType::SolidColor>(materialTable, samples, pSorted + typeStarts[0], pSorted + typeStarts[1], groupedSum);
+						ShadeSamplesOfType<MaterialType::Lambert>(materialTable, samples, pSorted + typeStarts[1], pSorted + typeStarts[2], groupedSum);
+						ShadeSamplesOfType<MaterialType::LambertPhong>(materialTable, samples, pSorted + typeStarts[2], pSorted + typeStarts[3], groupedSum);
+						ShadeSamplesOfType<MaterialType::CookTorrence>(materialTable, samples, pSorted + typeStarts[3], pSorted + typeStarts[4], groupedSum);
+					}) };
+
+				const uint64_t sampleCount{ uint64_t(iterations) * samples.size() };
+
+				std::cout << "samples=" << sampleCount << "\n";
+				PrintThroughput("virtual", sampleCount, virtualTime);
+				PrintThroughput("table", sampleCount, tableTime);
+				PrintThroughput("grouped", sampleCount, groupedTime);
+				PrintSpeedup("speedup", virtualTime, groupedTime);
+				//Printed so none of the loops can be optimized away, they only differ in summation order
+				std::cout << "checksums=" << (virtualSum.r + virtualSum.g + virtualSum.b) << " " << (tableSum.r + tableSum.g + tableSum.b) << " " << (groupedSum.r + groupedSum.g + groupedSum.b) << "\n";
+				std::cout << "mismatches=" << mismatchCount << std::endl;
+			}
+#pragma endregion
+
+#pragma region BRDF
+			float GetMaxDifference(const ColorRGB& a, const ColorRGB& b)
+			{
+				return std::max(std::abs(a.r - b.r), std::max(std::abs(a.g - b.g), std::abs(a.b - b.b)));
+			}
+
+			//Relative to the expected value, but absolute below 1 so dark samples do not blow it up
+			float GetMaxError(const ColorRGB& expected, const ColorRGB& actual)
+			{
+				const float scale{ std::max(1.0f, std::max(std::abs(expected.r), std::max(std::abs(expected.g), std::abs(expected.b)))) };
+				return GetMaxDifference(expected, actual) / scale;
+			}
+
+			//Like the Renderer, the samples are packed into one batch that stays in cache and shaded 8 at a time
+			double MeasureBatches(uint32_t iterations, const std::vector<ShadingSample>& samples, const std::vector<MaterialData>& materialTable, bool useAVX2, ColorRGB& sum)
+			{
+				CookTorrenceBatch batch{};
+
+				return MeasureMilliseconds(iterations, [&]()
+					{
+						for (size_t first{ 0 }; first < samples.size(); first += CookTorrenceBatch::laneCount)
+						{
+							const uint32_t laneCount{ uint32_t(std::min(samples.size() - first, size_t(CookTorrenceBatch::laneCount))) };
+
+							for (uint32_t lane{ 0 }; lane < laneCount; ++lane)
+							{
+								const ShadingSample& sample{ samples[first + lane] };
+								const MaterialData& material{ materialTable[sample.hit.materialIndex] };
+								batch.SetLane(lane, sample.hit.normal, sample.v, sample.l, material.color, material.f0.r, material.roughnessPow4, material.k, material.hasDiffuse ? 1.0f : 0.0f);
+							}
+
+							FastBRDF::ShadeCookTorrenceBatch(batch, laneCount, useAVX2);
+
+							for (uint32_t lane{ 0 }; lane < laneCount; ++lane)
+							{
+								sum += ColorRGB{ batch.colorR[lane], batch.colorG[lane], batch.colorB[lane] };
+							}
+						}
+					});
+			}
+
+			//Cook-Torrence samples of W4 through the reference BRDFs, FastBRDF one at a time and FastBRDF in SSE and AVX2 batches
+			void RunBRDF(uint32_t iterations)
+			{
+				const SceneSetup setup{ CreateSceneSetup("W4") };
+				const std::vector<MaterialData>& materialTable{ setup.pScene->GetMaterialTable() };
+				const std::vector<ShadingSample> samples{ CreateShadingSamples(setup, [](const MaterialData& material) { return material.type == MaterialType::CookTorrence; }) };
+
+				std::vector<CookTorrenceBatch> batches((samples.size() + CookTorrenceBatch::laneCount - 1) / CookTorrenceBatch::laneCount);
+
+				for (uint32_t index{ 0 }; index < samples.size(); ++index)
+				{
+					const ShadingSample& sample{ samples[index] };
+					const MaterialData& material{ materialTable[sample.hit.materialIndex] };
+
+					batches[index / CookTorrenceBatch::laneCount].SetLane(index % CookTorrenceBatch::laneCount, sample.hit.normal, sample.v, sample.l,
+						material.color, material.f0.r, material.roughnessPow4, material.k, material.hasDiffuse ? 1.0f : 0.0f);
+				}
+
+				//The fast scalar version has to match both SIMD versions exactly, and stay close to the reference
+				const bool hasAVX2{ CpuFeatures::HasAVX2() };
+				float maxFastError{ 0.0f };
+				uint32_t mismatchCount{ 0 };
+
+				std::vector<CookTorrenceBatch> avx2Batches{ batches };
+
+				for (uint32_t index{ 0 }; index < batches.size(); ++index)
+				{
+					FastBRDF::ShadeCookTorrenceBatch(batches[index], CookTorrenceBatch::laneCount, false);
+
+					if (hasAVX2)
+						FastBRDF::ShadeCookTorrenceBatch(avx2Batches[index], CookTorrenceBatch::laneCount, true);
+				}
+
+				const auto getLaneColor{ [](const std::vector<CookTorrenceBatch>& batches, uint32_t index)
+					{
+						const CookTorrenceBatch& batch{ batches[index / CookTorrenceBatch::laneCount] };
+						const uint32_t lane{ index % CookTorrenceBatch::laneCount };
+						return ColorRGB{ batch.colorR[lane], batch.colorG[lane], batch.colorB[lane] };
+					} };
+
+				for (uint32_t index{ 0 }; index < samples.size(); ++index)
+				{
+					const ShadingSample& sample{ samples[index] };
+					const MaterialData& material{ materialTable[sample.hit.materialIndex] };
+					const ColorRGB reference{ MaterialShading::Shade<MaterialType::CookTorrence, BRDFMode::Reference>(material, sample.hit, sample.l, sample.v) };
+					const ColorRGB fast{ MaterialShading::Shade<MaterialType::CookTorrence, BRDFMode::Fast>(material, sample.hit, sample.l, sample.v) };
+
+					maxFastError = std::max(maxFastError, GetMaxError(reference, fast));
+
+					if (GetMaxDifference(fast, getLaneColor(batches, index)) != 0.0f)
+						++mismatchCount;
+
+					if (hasAVX2 && GetMaxDifference(fast, getLaneColor(avx2Batches, index)) != 0.0f)
+						++mismatchCount;
+				}
+
+				ColorRGB referenceSum{};
+				const double referenceTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (const ShadingSample& sample : samples)
+						{
+							referenceSum += MaterialShading::Shade<MaterialType::CookTorrence, BRDFMode::Reference>(materialTable[sample.hit.materialIndex], sample.hit, sample.l, sample.v);
+						}
+					}) };
+
+				ColorRGB fastSum{};
+				const double fastTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (const ShadingSample& sample : samples)
+						{
+							fastSum += MaterialShading::Shade<MaterialType::CookTorrence, BRDFMode::Fast>(materialTable[sample.hit.materialIndex], sample.hit, sample.l, sample.v);
+						}
+					}) };
+
+				ColorRGB sseSum{};
+				const double sseTime{ MeasureBatches(iterations, samples, materialTable, false, sseSum) };
+
+				ColorRGB avx2Sum{};
+				const double avx2Time{ hasAVX2 ? MeasureBatches(iterations, samples, materialTable, true, avx2Sum) : 0.0 };
+
+				const uint64_t sampleCount{ uint64_t(iterations) * samples.size() };
+
+				std::cout << "avx2=" << hasAVX2 << "\n";
+				std::cout << "samples=" << sampleCount << "\n";
+				PrintThroughput("reference", sampleCount, referenceTime);
+				PrintThroughput("fast", sampleCount, fastTime);
+				PrintThroughput("sse", sampleCount, sseTime);
+				if (hasAVX2)
+					PrintThroughput("avx2", sampleCount, avx2Time);
+				std::cout << "checksums=" << (referenceSum.r + referenceSum.g + referenceSum.b) << " " << (fastSum.r + fastSum.g + fastSum.b)
+					<< " " << (sseSum.r + sseSum.g + sseSum.b) << " " << (avx2Sum.r + avx2Sum.g + avx2Sum.b) << "\n";
+				std::cout << "fast_max_error=" << maxFastError << "\n";
+				std::cout << "simd_mismatches=" << mismatchCount << std::endl;
+			}
+#pragma endregion
+
+#pragma region Math
+			//The scalar versions of the operations SimdMath.h can speed up, as they are compiled with SCALAR_MATH
+			namespace ScalarMath
+			{
+#ifdef SIMD_MATH_ENABLED
+				float Dot(const Vector3& v1, const Vector3& v2)
+				{
+					return ((v1.x * v2.x) + (v1.y * v2.y) + (v1.z * v2.z));
+				}
+
+				Vector3 Cross(const Vector3& v1, const Vector3& v2)
+				{
+					return { ((v1.y * v2.z) - (v1.z * v2.y)), ((v1.z * v2.x) - (v1.x * v2.z)), ((v1.x * v2.y) - (v1.y * v2.x)) };
+				}
+#endif
+
+				Vector3 Normalized(const Vector3& v)
+				{
+					const float m{ v.Magnitude() };
+					return { v.x / m, v.y / m, v.z / m };
+				}
+
+				Vector3 TransformVector(const Matrix& m, const Vector3& v)
+				{
+					return m.TransformVector(v.x, v.y, v.z);
+				}
+
+				Vector3 TransformPoint(const Matrix& m, const Vector3& p)
+				{
+					return m.TransformPoint(p.x, p.y, p.z);
+				}
+
+				Matrix Multiply(const Matrix& m1, const Matrix& m2)
+				{
+					Matrix result{};
+					const Matrix transposed{ Matrix::Transpose(m2) };
+
+					for (int r{ 0 }; r < 4; ++r)
+					{
+						for (int c{ 0 }; c < 4; ++c)
+						{
+							result[r][c] = Vector4::Dot(m1[r], transposed[c]);
+						}
+					}
+
+					return result;
+				}
+			}
+
+#ifdef SIMD_MATH_ENABLED
+			float Sum(float value)
+			{
+				return value;
+			}
+#endif
+
+			float Sum(const Vector3& value)
+			{
+				return value.x + value.y + value.z;
+			}
+
+			float Sum(const Matrix& value)
+			{
+				return Sum(value.GetAxisX()) + Sum(value.GetAxisY()) + Sum(value.GetAxisZ()) + Sum(value.GetTranslation());
+			}
+
+#ifdef SIMD_MATH_ENABLED
+			float GetMaxDifference(float a, float b)
+			{
+				return std::abs(a - b);
+			}
+#endif
+
+			float GetMaxDifference(const Vector3& a, const Vector3& b)
+			{
+				return std::max(std::abs(a.x - b.x), std::max(std::abs(a.y - b.y), std::abs(a.z - b.z)));
+			}
+
+			float GetMaxDifference(const Matrix& a, const Matrix& b)
+			{
+				float difference{ 0.0f };
+
+				for (int r{ 0 }; r < 4; ++r)
+				{
+					for (int c{ 0 }; c < 4; ++c)
+					{
+						difference = std::max(difference, std::abs(a[r][c] - b[r][c]));
+					}
+				}
+
+				return difference;
+			}
+
+			//Runs the operation over every index of the inputs with the Vector3 and Matrix implementation that is compiled in and with the scalar one.
+			//The results have to match exactly except for Normalized, whose largest difference shows the rsqrt error
+			template<typename Operation, typename ScalarOperation>
+			void MeasureMathOperation(const char* pName, uint32_t iterations, uint32_t count, Operation&& operation, ScalarOperation&& scalarOperation)
+			{
+				uint32_t mismatchCount{ 0 };
+				float maxDifference{ 0.0f };
+
+				for (uint32_t index{ 0 }; index < count; ++index)
+				{
+					const float difference{ GetMaxDifference(operation(index), scalarOperation(index)) };
+					maxDifference = std::max(maxDifference, difference);
+
+					if (difference != 0.0f)
+						++mismatchCount;
+				}
+
+				float sum{ 0.0f };
+				const double time{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (uint32_t index{ 0 }; index < count; ++index)
+						{
+							sum += Sum(operation(index));
+						}
+					}) };
+
+				float scalarSum{ 0.0f };
+				const double scalarTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						for (uint32_t index{ 0 }; index < count; ++index)
+						{
+							scalarSum += Sum(scalarOperation(index));
+						}
+					}) };
+
+				const uint64_t testCount{ uint64_t(iterations) * count };
+				const std::string name{ pName };
+
+				PrintThroughput(pName, testCount, time);
+				PrintThroughput((name + "_scalar").c_str(), testCount, scalarTime);
+				PrintSpeedup(name + "_speedup", scalarTime, time);
+				std::cout << name << "_checksums=" << sum << " " << scalarSum << "\n";
+				std::cout << name << "_mismatches=" << mismatchCount << "\n";
+				std::cout << name << "_max_difference=" << maxDifference << "\n";
+			}
+
+			//Every operation of SimdMath.h on random vectors and matrices that stay in the cache.
+			//Dot and Cross are measured on registers loaded from the vectors, which is why Vector3 does not use them
+			void RunMath(uint32_t iterations)
+			{
+				constexpr uint32_t VALUE_COUNT{ 4096 };
+
+				std::mt19937 generator{ RANDOM_SEED };
+				std::uniform_real_distribution<float> angleDistribution{ 0.0f, 360.0f };
+
+				std::vector<Vector3> vectors1(VALUE_COUNT);
+				std::vector<Vector3> vectors2(VALUE_COUNT);
+				std::vector<Matrix> matrices(VALUE_COUNT);
+
+				for (uint32_t index{ 0 }; index < VALUE_COUNT; ++index)
+				{
+					vectors1[index] = RandomPoint(generator, 10.0f);
+					vectors2[index] = RandomPoint(generator, 10.0f);
+					matrices[index] = Matrix::CreateRotation(angleDistribution(generator), angleDistribution(generator), angleDistribution(generator))
+						* Matrix::CreateTranslation(RandomPoint(generator, 10.0f));
+				}
+
+				//Scaled up since every test is only a handful of instructions
+				const uint32_t vectorIterations{ iterations * 100 };
+				const uint32_t matrixIterations{ iterations * 25 };
+
+#ifdef SIMD_MATH_ENABLED
+				std::cout << "simd_math=1\n";
+#else
+				std::cout << "simd_math=0\n";
+#endif
+#ifdef SIMD_MATH_AVX2_ENABLED
+				std::cout << "simd_math_avx2=1\n";
+#else
+				std::cout << "simd_math_avx2=0\n";
+#endif
+
+#ifdef SIMD_MATH_ENABLED
+				MeasureMathOperation("dot", vectorIterations, VALUE_COUNT,
+					[&](uint32_t index) { return _mm_cvtss_f32(SimdMath::Dot3(vectors1[index].ToRegister(), vectors2[index].ToRegister())); },
+					[&](uint32_t index) { return ScalarMath::Dot(vectors1[index], vectors2[index]); });
+
+				MeasureMathOperation("cross", vectorIterations, VALUE_COUNT,
+					[&](uint32_t index) { return Vector3::FromRegister(SimdMath::Cross3(vectors1[index].ToRegister(), vectors2[index].ToRegister())); },
+					[&](uint32_t index) { return ScalarMath::Cross(vectors1[index], vectors2[index]); });
+#endif
+
+				MeasureMathOperation("normalized", vectorIterations, VALUE_COUNT,
+					[&](uint32_t index) { return vectors1[index].Normalized(); },
+					[&](uint32_t index) { return ScalarMath::Normalized(vectors1[index]); });
+
+				MeasureMathOperation("transform_vector", vectorIterations, VALUE_COUNT,
+					[&](uint32_t index) { return matrices[index].TransformVector(vectors1[index]); },
+					[&](uint32_t index) { return ScalarMath::TransformVector(matrices[index], vectors1[index]); });
+
+				MeasureMathOperation("transform_point", vectorIterations, VALUE_COUNT,
+					[&](uint32_t index) { return matrices[index].TransformPoint(vectors1[index]); },
+					[&](uint32_t index) { return ScalarMath::TransformPoint(matrices[index], vectors1[index]); });
+
+				MeasureMathOperation("matrix_multiply", matrixIterations, VALUE_COUNT,
+					[&](uint32_t index) { return matrices[index] * matrices[(index + 1) % VALUE_COUNT]; },
+					[&](uint32_t index) { return ScalarMath::Multiply(matrices[index], matrices[(index + 1) % VALUE_COUNT]); });
+
+				std::cout << std::flush;
+			}
+#pragma endregion
+
+#pragma region OBJ
+			//The std::ifstream parser that ObjLoader replaced, it only understands "v x y z" and "f a b c"
+			bool ParseOBJ_Stream(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices)
+			{
+				std::ifstream file(filename);
+				if (!file)
+					return false;
+
+				std::string sCommand;
+				while (!file.eof())
+				{
+					sCommand = "EOF";
+					file >> sCommand;
+
+					if (sCommand == "EOF")
+						break;
+
+					if (sCommand == "v")
+					{
+						float x, y, z;
+						file >> x >> y >> z;
+						positions.push_back({ x, y, z });
+					}
+					else if (sCommand == "f")
+					{
+						float i0, i1, i2;
+						file >> i0 >> i1 >> i2;
+
+						indices.push_back((int)i0 - 1);
+						indices.push_back((int)i1 - 1);
+						indices.push_back((int)i2 - 1);
+					}
+
+					file.ignore(1000, '\n');
+
+					if (file.eof())
+						break;
+				}
+
+				for (uint64_t index = 0; index < indices.size(); index += 3)
+				{
+					Vector3 normal = Vector3::Cross(positions[indices[index + 1]] - positions[indices[index]], positions[indices[index + 2]] - positions[indices[index]]);
+					normal.Normalize();
+					normals.push_back(normal);
+				}
+
+				return true;
+			}
+
+			//Vertices with four decimals like most exporters write them, faces refer to random vertices
+			constexpr uint32_t OBJ_VERTEX_COUNT{ 100000 };
+			constexpr uint32_t OBJ_FACE_COUNT{ 200000 };
+
+			//Triangles that the stream parser understands as well
+			std::string CreateTriangleOBJ(std::mt19937& generator)
+			{
+				std::uniform_int_distribution<uint32_t> vertexDistribution{ 1, OBJ_VERTEX_COUNT };
+				std::string text{ "# Microbenchmark triangles\n" };
+
+				for (uint32_t vertex{ 0 }; vertex < OBJ_VERTEX_COUNT; ++vertex)
+				{
+					const Vector3 position{ RandomPoint(generator, 10.0f) };
+					TextParsing::AppendLine(text, "v %.4f %.4f %.4f\n", position.x, position.y, position.z);
+				}
+
+				//Three different corners, a repeated one would give a degenerate triangle without a normal
+				for (uint32_t face{ 0 }; face < OBJ_FACE_COUNT; ++face)
+				{
+					uint32_t corners[3]{ vertexDistribution(generator), vertexDistribution(generator), vertexDistribution(generator) };
+					while (corners[1] == corners[0])
+						corners[1] = vertexDistribution(generator);
+					while (corners[2] == corners[0] || corners[2] == corners[1])
+						corners[2] = vertexDistribution(generator);
+
+					TextParsing::AppendLine(text, "f %u %u %u\n", corners[0], corners[1], corners[2]);
+				}
+
+				return text;
+			}
+
+			//Vertices with texture coordinates and normals, every quad is written twice: with absolute v/vt/vn indices and with the same corners as relative ones
+			std::string CreateQuadOBJ(std::mt19937& generator)
+			{
+				std::uniform_int_distribution<uint32_t> vertexDistribution{ 0, OBJ_VERTEX_COUNT - 1 };
+				std::string text{ "# Microbenchmark quads\no quads\n" };
+
+				for (uint32_t vertex{ 0 }; vertex < OBJ_VERTEX_COUNT; ++vertex)
+				{
+					const Vector3 position{ RandomPoint(generator, 10.0f) };
+					const Vector3 normal{ RandomPoint(generator, 1.0f).Normalized() };
+					TextParsing::AppendLine(text, "v %.4f %.4f %.4f\nvt %.4f %.4f\nvn %.4f %.4f %.4f\n", position.x, position.y, position.z,
+						std::abs(position.x) / 10.0f, std::abs(position.y) / 10.0f, normal.x, normal.y, normal.z);
+				}
+
+				text += "usemtl default\ns 1\n";
+
+				for (uint32_t face{ 0 }; face < OBJ_FACE_COUNT / 4; ++face)
+				{
+					const uint32_t corners[4]{ vertexDistribution(generator), vertexDistribution(generator), vertexDistribution(generator), vertexDistribution(generator) };
+					TextParsing::AppendLine(text, "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n", corners[0] + 1, corners[0] + 1, corners[0] + 1, corners[1] + 1, corners[1] + 1, corners[1] + 1,
+						corners[2] + 1, corners[2] + 1, corners[2] + 1, corners[3] + 1, corners[3] + 1, corners[3] + 1);
+
+					const int relative[4]{ int(corners[0]) - int(OBJ_VERTEX_COUNT), int(corners[1]) - int(OBJ_VERTEX_COUNT), int(corners[2]) - int(OBJ_VERTEX_COUNT), int(corners[3]) - int(OBJ_VERTEX_COUNT) };
+					TextParsing::AppendLine(text, "f %d//%d %d//%d %d//%d %d//%d\n", relative[0], relative[0], relative[1], relative[1], relative[2], relative[2], relative[3], relative[3]);
+				}
+
+				return text;
+			}
+
+			bool WriteTextFile(const std::string& filename, const std::string& text)
+			{
+				std::ofstream file{ filename, std::ios::binary };
+				file.write(text.data(), std::streamsize(text.size()));
+				return bool(file);
+			}
+
+			void PrintLoadSpeed(const char* pKey, size_t byteCount, uint32_t iterations, double milliseconds)
+			{
+				std::cout << pKey << "_ms=" << milliseconds / iterations << "\n";
+				std::cout << pKey << "_mb_per_s=" << (milliseconds > 0.0 ? (double(byteCount) * iterations) / (milliseconds * 1000.0) : 0.0) << "\n";
+			}
+
+			//Loads generated OBJ files from disk (the second and later loads come from the file cache) with ObjLoader and with the stream parser it replaced.
+			//Both have to produce exactly the same triangles, the quads file checks the v/vt/vn syntax, the triangulation and relative indices
+			void RunOBJ(uint32_t iterations)
+			{
+				std::mt19937 generator{ RANDOM_SEED };
+
+				const std::string triangleFilename{ GetTemporaryFilename("RayTracer_microbenchmark_triangles.obj") };
+				const std::string quadFilename{ GetTemporaryFilename("RayTracer_microbenchmark_quads.obj") };
+				const std::string triangleText{ CreateTriangleOBJ(generator) };
+				const std::string quadText{ CreateQuadOBJ(generator) };
+
+				if (!WriteTextFile(triangleFilename, triangleText) || !WriteTextFile(quadFilename, quadText))
+				{
+					std::cout << "Could not write " << triangleFilename << " or " << quadFilename << std::endl;
+					return;
+				}
+
+				std::vector<Vector3> streamPositions{};
+				std::vector<Vector3> streamNormals{};
+				std::vector<int> streamIndices{};
+				const double streamTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						streamPositions.clear();
+						streamNormals.clear();
+						streamIndices.clear();
+						ParseOBJ_Stream(triangleFilename, streamPositions, streamNormals, streamIndices);
+					}) };
+
+				ObjMesh mesh{};
+				bool isLoaded{ true };
+				const double mappedTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						isLoaded &= ObjLoader::Load(triangleFilename, mesh);
+					}) };
+
+				uint32_t mismatchCount{ 0 };
+				if (!isLoaded || mesh.positions.size() != streamPositions.size() || mesh.indices != streamIndices)
+					++mismatchCount;
+				else
+				{
+					for (size_t index{ 0 }; index < streamPositions.size(); ++index)
+					{
+						if (mesh.positions[index] != streamPositions[index])
+							++mismatchCount;
+					}
+
+					for (size_t index{ 0 }; index < streamNormals.size(); ++index)
+					{
+						//NaN normals of degenerate triangles do not compare equal
+						if (mesh.faceNormals[index] != streamNormals[index] && !std::isnan(streamNormals[index].x))
+							++mismatchCount;
+					}
+				}
+
+				ObjMesh quadMesh{};
+				bool isQuadLoaded{ true };
+				const double quadTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						isQuadLoaded &= ObjLoader::Load(quadFilename, quadMesh);
+					}) };
+
+				//Every quad is two triangles, written once with absolute and once with relative indices
+				uint32_t quadMismatchCount{ 0 };
+				if (!isQuadLoaded || quadMesh.GetTriangleCount() != OBJ_FACE_COUNT || quadMesh.texCoords.size() != OBJ_VERTEX_COUNT)
+					++quadMismatchCount;
+				else
+				{
+					for (size_t triangle{ 0 }; triangle < quadMesh.GetTriangleCount(); triangle += 4)
+					{
+						for (size_t index{ 3 * triangle }; index < (3 * triangle) + 6; ++index)
+						{
+							if (quadMesh.indices[index] != quadMesh.indices[index + 6] || quadMesh.normalIndices[index] != quadMesh.normalIndices[index + 6]
+								|| quadMesh.texCoordIndices[index] != quadMesh.indices[index] || quadMesh.texCoordIndices[index + 6] != -1)
+								++quadMismatchCount;
+						}
+					}
+				}
+
+				std::filesystem::remove(triangleFilename);
+				std::filesystem::remove(quadFilename);
+
+				std::cout << "threads=" << std::max(std::thread::hardware_concurrency(), 1u) << "\n";
+				std::cout << "triangles_file_mb=" << double(triangleText.size()) / 1000000.0 << "\n";
+				PrintLoadSpeed("stream", triangleText.size(), iterations, streamTime);
+				PrintLoadSpeed("mapped", triangleText.size(), iterations, mappedTime);
+				PrintSpeedup("speedup", streamTime, mappedTime);
+				std::cout << "triangles=" << mesh.GetTriangleCount() << "\n";
+				std::cout << "mismatches=" << mismatchCount << "\n";
+				std::cout << "quads_file_mb=" << double(quadText.size()) / 1000000.0 << "\n";
+				PrintLoadSpeed("quads_mapped", quadText.size(), iterations, quadTime);
+				std::cout << "quads_triangles=" << quadMesh.GetTriangleCount() << "\n";
+				std::cout << "quads_mismatches=" << quadMismatchCount << std::endl;
+			}
+
+			//The first load of an OBJ parses it and writes its cache, every later one maps the cache and uses it in place.
+			//The mapped arrays have to match what ObjLoader parsed exactly
+			void RunMeshCache(uint32_t iterations)
+			{
+				std::mt19937 generator{ RANDOM_SEED };
+
+				const std::string objFilename{ GetTemporaryFilename("RayTracer_microbenchmark_mesh.obj") };
+				const std::string cacheFilename{ MeshCache::GetCachePath(objFilename) };
+				const std::string objText{ CreateTriangleOBJ(generator) };
+
+				if (!WriteTextFile(objFilename, objText))
+				{
+					std::cout << "Could not write " << objFilename << std::endl;
+					return;
+				}
+
+				//Both include creating the triangles, the first also builds the BVH
+				uint32_t cacheUseCount{ 0 };
+				uint32_t bvhCacheUseCount{ 0 };
+				const double parseTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						std::filesystem::remove(cacheFilename);
+
+						TriangleMesh mesh{};
+						bool isFromCache{ false };
+						bool isBVHFromCache{ false };
+						MeshCache::LoadOBJ(objFilename, mesh, &isFromCache, &isBVHFromCache);
+						cacheUseCount += isFromCache;
+						bvhCacheUseCount += isBVHFromCache;
+					}) };
+
+				const double cachedTime{ MeasureMilliseconds(iterations, [&]()
+					{
+						TriangleMesh mesh{};
+						bool isFromCache{ false };
+						bool isBVHFromCache{ false };
+						MeshCache::LoadOBJ(objFilename, mesh, &isFromCache, &isBVHFromCache);
+						cacheUseCount += isFromCache;
+						bvhCacheUseCount += isBVHFromCache;
+					}) };
+
+				ObjMesh objMesh{};
+				ObjLoader::Load(objFilename, objMesh);
+
+				TriangleMesh builtMesh{};
+				builtMesh.positions = objMesh.positions;
+				builtMesh.normals = objMesh.faceNormals;
+				builtMesh.indices = objMesh.indices;
+
+				const double buildTime{ MeasureMilliseconds(1, [&]() { builtMesh.CreateTriangles(); }) };
+
+				TriangleMesh cachedMesh{};
+				MeshCache::LoadOBJ(objFilename, cachedMesh);
+
+				const std::span<const Vector3> positions{ cachedMesh.GetPositions() };
+				const std::span<const Vector3> normals{ cachedMesh.GetNormals() };
+				const std::span<const int> indices{ cachedMesh.GetIndices() };
+
+				//Compared bitwise, the normals of degenerate triangles are NaN
+				uint32_t mismatchCount{ 0 };
+				if (!cachedMesh.pMappedFile || positions.size() != objMesh.positions.size() || normals.size() != objMesh.faceNormals.size() || indices.size() != objMesh.indices.size()
+					|| std::memcmp(positions.data(), objMesh.positions.data(), positions.size_bytes()) != 0
+					|| std::memcmp(normals.data(), objMesh.faceNormals.data(), normals.size_bytes()) != 0
+					|| std::memcmp(indices.data(), objMesh.indices.data(), indices.size_bytes()) != 0)
+					++mismatchCount;
+
+				//The restored BVH has to be the one a build produces
+				const std::vector<BVHNode>& nodes{ cachedMesh.bvh.GetNodes() };
+				const std::vector<BVHNode>& builtNodes{ builtMesh.bvh.GetNodes() };
+				if (nodes.size() != builtNodes.size() || cachedMesh.triangleBlocks.size() != builtMesh.triangleBlocks.size()
+					|| std::memcmp(nodes.data(), builtNodes.data(), nodes.size() * sizeof(BVHNode)) != 0
+					|| std::memcmp(cachedMesh.triangleBlocks.data(), builtMesh.triangleBlocks.data(), cachedMesh.triangleBlocks.size() * sizeof(TriangleBlock)) != 0)
+					++mismatchCount;
+
+				const uintmax_t cacheSize{ std::filesystem::file_size(cacheFilename) };
+
+				cachedMesh = TriangleMesh{};
+				std::filesystem::remove(cacheFilename);
+				std::filesystem::remove(objFilename);
+
+				std::cout << "obj_file_mb=" << double(objText.size()) / 1000000.0 << "\n";
+				std::cout << "cache_file_mb=" << double(cacheSize) / 1000000.0 << "\n";
+				std::cout << "triangles=" << objMesh.GetTriangleCount() << "\n";
+				std::cout << "bvh_nodes=" << builtNodes.size() << "\n";
+				std::cout << "triangles_and_bvh_build_ms=" << buildTime << "\n";
+				std::cout << "parse_and_write_ms=" << parseTime / iterations << "\n";
+				std::cout << "cached_ms=" << cachedTime / iterations << "\n";
+				PrintSpeedup("speedup", parseTime, cachedTime);
+				std::cout << "cache_uses=" << cacheUseCount << "/" << (2 * iterations) << "\n";
+				std::cout << "bvh_cache_uses=" << bvhCacheUseCount << "/" << (2 * iterations) << "\n";
+				std::cout << "mismatches=" << mismatchCount << std::endl;
+			}
+#pragma endregion
+
+			struct Microbenchmark
+			{
+				const char* pName;
+				void(*pRun)(uint32_t iterations);
+			};
+
+			const Microbenchmark MICROBENCHMARKS[]{
+				{ "triangle", &RunTriangle },
+				{ "triangle_block", &RunTriangleBlock },
+				{ "sphere", &RunSphere },
+				{ "packets", &RunPackets },
+				{ "shadows", &RunShadows },
+				{ "materials", &RunMaterials },
+				{ "brdf", &RunBRDF },
+				{ "math", &RunMath },
+				{ "obj", &RunOBJ },
+				{ "mesh_cache", &RunMeshCache },
+			};
+		}
+
+		bool Run(const std::string& name, uint32_t iterations)
+		{
+			for (const Microbenchmark& microbenchmark : MICROBENCHMARKS)
+			{
+				if (name != microbenchmark.pName)
+					continue;
+
+				std::cout << "microbenchmark=" << name << "\n";
+				std::cout << "iterations=" << iterations << "\n";
+				microbenchmark.pRun(iterations);
+				return true;
+			}
+
+			return false;
+		}
+
+		void PrintNames()
+		{
+			std::cout << "Microbenchmarks:";
+
+			for (const Microbenchmark& microbenchmark : MICROBENCHMARKS)
+			{
+				std::cout << " " << microbenchmark.pName;
+			}
+
+			std::cout << "\n";
+		}
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace dae
+{
+	//Kernel level benchmarks on synthetic data generated from a fixed seed, started with: RayTracer --microbenchmark <name>
+	//Every benchmark prints "key=value" lines, like the batch mode, and checks the optimized kernel against the one it replaces.
+	namespace Microbenchmarks
+	{
+		//Returns false for unknown names
+		bool Run(const std::string& name, uint32_t iterations);
+
+		void PrintNames();
+	}
+}
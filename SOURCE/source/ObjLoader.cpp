@@ -0,0 +1,428 @@
+#include "ObjLoader.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "MappedFile.h"
+#include "TextParsing.h"
+#include "WorkerPool.h"
+
+namespace dae
+{
+	namespace ObjLoader
+	{
+		namespace
+		{
+			using TextParsing::IsDigit;
+			using TextParsing::IsSpace;
+			using TextParsing::ParseFloat;
+			using TextParsing::ParseInt;
+
+			//Small files are parsed by the calling thread alone, starting the workers would take longer
+			constexpr size_t MIN_CHUNK_SIZE{ 256 * 1024 };
+			//More chunks than workers, so a chunk full of faces does not hold up the others
+			constexpr uint32_t CHUNKS_PER_THREAD{ 4 };
+
+			//Indices as they are written in the file: 1 based, negative ones count back from the last element so far, 0 when the corner has none
+			struct FaceCorner
+			{
+				int position{};
+				int texCoord{};
+				int normal{};
+			};
+
+			//Relative indices are resolved against the amount of elements the chunk defined before the face
+			struct Face
+			{
+				uint32_t firstCorner{};
+				uint32_t cornerCount{};
+				uint32_t positionCount{};
+				uint32_t texCoordCount{};
+				uint32_t normalCount{};
+			};
+
+			struct Chunk
+			{
+				const char* pBegin{ nullptr };
+				const char* pEnd{ nullptr };
+
+				std::vector<Vector3> positions{};
+				std::vector<Vector3> texCoords{};
+				std::vector<Vector3> vertexNormals{};
+				std::vector<FaceCorner> corners{};
+				std::vector<Face> faces{};
+				uint32_t triangleCount{ 0 };
+
+				//Where the elements of this chunk start in the ObjMesh, filled in between both passes
+				uint32_t firstPosition{ 0 };
+				uint32_t firstTexCoord{ 0 };
+				uint32_t firstNormal{ 0 };
+				uint32_t firstTriangle{ 0 };
+
+				bool isValid{ true };
+			};
+
+#pragma region Tokenizer
+			//A backslash at the end of a line continues the statement on the next one
+			inline bool IsLineContinuation(const char* pCurrent, const char* pEnd)
+			{
+				if (*pCurrent != '\\')
+					return false;
+
+				const char* pNext{ pCurrent + 1 };
+				if (pNext < pEnd && *pNext == '\r')
+					++pNext;
+
+				return pNext < pEnd && *pNext == '\n';
+			}
+
+			inline void SkipSpaces(const char*& pCurrent, const char* pEnd)
+			{
+				while (pCurrent < pEnd)
+				{
+					if (IsSpace(*pCurrent))
+						++pCurrent;
+					else if (IsLineContinuation(pCurrent, pEnd))
+						pCurrent = std::find(pCurrent, pEnd, '\n') + 1;
+					else
+						break;
+				}
+			}
+
+			//Also treats a comment as the end of the line
+			inline bool IsEndOfLine(const char* pCurrent, const char* pEnd)
+			{
+				return pCurrent >= pEnd || *pCurrent == '\n' || *pCurrent == '\r' || *pCurrent == '#';
+			}
+
+			inline void SkipLine(const char*& pCurrent, const char* pEnd)
+			{
+				while (pCurrent < pEnd && *pCurrent != '\n')
+				{
+					if (IsLineContinuation(pCurrent, pEnd))
+						pCurrent = std::find(pCurrent, pEnd, '\n');
+
+					++pCurrent;
+				}
+
+				if (pCurrent < pEnd)
+					++pCurrent;
+			}
+
+			//The first position after the line end at or after pPosition, lines that are continued with a backslash are kept together
+			const char* FindLineStart(const char* pPosition, const char* pBegin, const char* pEnd)
+			{
+				while (pPosition < pEnd)
+				{
+					const char* pNewLine{ std::find(pPosition, pEnd, '\n') };
+					if (pNewLine == pEnd)
+						return pEnd;
+
+					const char* pLast{ pNewLine };
+					if (pLast > pBegin && pLast[-1] == '\r')
+						--pLast;
+
+					if (pLast == pBegin || pLast[-1] != '\\')
+						return pNewLine + 1;
+
+					pPosition = pNewLine + 1;
+				}
+
+				return pEnd;
+			}
+#pragma endregion
+
+#pragma region Statements
+			//Reads up to maxCount numbers, at least minCount have to be there. Components that are not there stay 0.
+			bool ParseVector(const char*& pCurrent, const char* pEnd, Vector3& vector, int minCount, int maxCount)
+			{
+				vector = Vector3::Zero;
+
+				for (int component{ 0 }; component < maxCount; ++component)
+				{
+					SkipSpaces(pCurrent, pEnd);
+					if (IsEndOfLine(pCurrent, pEnd))
+						return component >= minCount;
+
+					if (!ParseFloat(pCurrent, pEnd, vector[component]))
+						return false;
+				}
+
+				//Ignores the w of positions and the color some exporters append to them
+				return true;
+			}
+
+			bool ParseFace(const char*& pCurrent, const char* pEnd, Chunk& chunk)
+			{
+				Face face{};
+				face.firstCorner = uint32_t(chunk.corners.size());
+				face.positionCount = uint32_t(chunk.positions.size());
+				face.texCoordCount = uint32_t(chunk.texCoords.size());
+				face.normalCount = uint32_t(chunk.vertexNormals.size());
+
+				while (true)
+				{
+					SkipSpaces(pCurrent, pEnd);
+					if (IsEndOfLine(pCurrent, pEnd))
+						break;
+
+					FaceCorner corner{};
+					if (!ParseInt(pCurrent, pEnd, corner.position) || corner.position == 0)
+						return false;
+
+					if (pCurrent < pEnd && *pCurrent == '/')
+					{
+						++pCurrent;
+
+						//v//vn has no texture coordinate
+						if (pCurrent < pEnd && *pCurrent != '/' && (!ParseInt(pCurrent, pEnd, corner.texCoord) || corner.texCoord == 0))
+							return false;
+
+						if (pCurrent < pEnd && *pCurrent == '/')
+						{
+							++pCurrent;
+
+							if (!ParseInt(pCurrent, pEnd, corner.normal) || corner.normal == 0)
+								return false;
+						}
+					}
+
+					if (pCurrent < pEnd && !IsSpace(*pCurrent) && !IsEndOfLine(pCurrent, pEnd) && !IsLineContinuation(pCurrent, pEnd))
+						return false;
+
+					chunk.corners.push_back(corner);
+				}
+
+				face.cornerCount = uint32_t(chunk.corners.size()) - face.firstCorner;
+				if (face.cornerCount < 3)
+					return false;
+
+				chunk.faces.push_back(face);
+				chunk.triangleCount += face.cornerCount - 2;
+				return true;
+			}
+
+			//True when the line starts with keyword followed by whitespace, pCurrent is then moved past it
+			inline bool IsKeyword(const char*& pCurrent, const char* pEnd, const char* pKeyword, size_t keywordLength)
+			{
+				if (size_t(pEnd - pCurrent) <= keywordLength || !std::equal(pKeyword, pKeyword + keywordLength, pCurrent) || !IsSpace(pCurrent[keywordLength]))
+					return false;
+
+				pCurrent += keywordLength;
+				return true;
+			}
+
+			void ParseChunk(Chunk& chunk)
+			{
+				const char* pCurrent{ chunk.pBegin };
+				const char* pEnd{ chunk.pEnd };
+
+				while (pCurrent < pEnd)
+				{
+					SkipSpaces(pCurrent, pEnd);
+
+					bool isValid{ true };
+					if (IsKeyword(pCurrent, pEnd, "v", 1))
+					{
+						Vector3& position{ chunk.positions.emplace_back() };
+						isValid = ParseVector(pCurrent, pEnd, position, 3, 3);
+					}
+					else if (IsKeyword(pCurrent, pEnd, "vt", 2))
+					{
+						Vector3& texCoord{ chunk.texCoords.emplace_back() };
+						isValid = ParseVector(pCurrent, pEnd, texCoord, 1, 3);
+					}
+					else if (IsKeyword(pCurrent, pEnd, "vn", 2))
+					{
+						Vector3& normal{ chunk.vertexNormals.emplace_back() };
+						isValid = ParseVector(pCurrent, pEnd, normal, 3, 3);
+					}
+					else if (IsKeyword(pCurrent, pEnd, "f", 1))
+						isValid = ParseFace(pCurrent, pEnd, chunk);
+
+					if (!isValid)
+					{
+						chunk.isValid = false;
+						return;
+					}
+
+					SkipLine(pCurrent, pEnd);
+				}
+			}
+
+			//1 based and relative indices to 0 based ones, countBeforeFace is the amount of elements in the whole file up to the face
+			inline bool ResolveIndex(int fileIndex, uint32_t countBeforeFace, uint32_t totalCount, int& index)
+			{
+				index = fileIndex > 0 ? fileIndex - 1 : int(countBeforeFace) + fileIndex;
+				return index >= 0 && uint32_t(index) < totalCount;
+			}
+
+			inline bool ResolveOptionalIndex(int fileIndex, uint32_t countBeforeFace, uint32_t totalCount, int& index)
+			{
+				if (fileIndex == 0)
+				{
+					index = -1;
+					return true;
+				}
+
+				return ResolveIndex(fileIndex, countBeforeFace, totalCount, index);
+			}
+
+			//Adds the faces of the chunk to the mesh as triangle fans, the vertices of all chunks have to be copied already
+			void ResolveChunk(Chunk& chunk, ObjMesh& mesh)
+			{
+				const uint32_t positionCount{ uint32_t(mesh.positions.size()) };
+				const uint32_t texCoordCount{ uint32_t(mesh.texCoords.size()) };
+				const uint32_t normalCount{ uint32_t(mesh.vertexNormals.size()) };
+
+				size_t triangleIndex{ chunk.firstTriangle };
+
+				for (const Face& face : chunk.faces)
+				{
+					const uint32_t positionsBefore{ chunk.firstPosition + face.positionCount };
+					const uint32_t texCoordsBefore{ chunk.firstTexCoord + face.texCoordCount };
+					const uint32_t normalsBefore{ chunk.firstNormal + face.normalCount };
+
+					FaceCorner resolvedCorners[3]{};
+
+					for (uint32_t cornerIndex{ 0 }; cornerIndex < face.cornerCount; ++cornerIndex)
+					{
+						const FaceCorner& corner{ chunk.corners[face.firstCorner + cornerIndex] };
+
+						//The first corner is shared by the whole fan, the second one is the previous triangle's last corner
+						FaceCorner& resolvedCorner{ resolvedCorners[std::min(cornerIndex, 2u)] };
+
+						if (!ResolveIndex(corner.position, positionsBefore, positionCount, resolvedCorner.position)
+							|| !ResolveOptionalIndex(corner.texCoord, texCoordsBefore, texCoordCount, resolvedCorner.texCoord)
+							|| !ResolveOptionalIndex(corner.normal, normalsBefore, normalCount, resolvedCorner.normal))
+						{
+							chunk.isValid = false;
+							return;
+						}
+
+						if (cornerIndex < 2)
+							continue;
+
+						for (uint32_t vertex{ 0 }; vertex < 3; ++vertex)
+						{
+							mesh.indices[(3 * triangleIndex) + vertex] = resolvedCorners[vertex].position;
+							mesh.texCoordIndices[(3 * triangleIndex) + vertex] = resolvedCorners[vertex].texCoord;
+							mesh.normalIndices[(3 * triangleIndex) + vertex] = resolvedCorners[vertex].normal;
+						}
+
+						const Vector3& v0{ mesh.positions[resolvedCorners[0].position] };
+						Vector3 normal{ Vector3::Cross(mesh.positions[resolvedCorners[1].position] - v0, mesh.positions[resolvedCorners[2].position] - v0) };
+						normal.Normalize();
+						mesh.faceNormals[triangleIndex] = normal;
+
+						++triangleIndex;
+						resolvedCorners[1] = resolvedCorners[2];
+					}
+				}
+			}
+#pragma endregion
+		}
+
+		bool Load(const std::string& filename, ObjMesh& mesh, uint32_t threadCount)
+		{
+			MappedFile file{};
+			if (!file.Open(filename))
+				return false;
+
+			return Parse(file.GetData(), file.GetSize(), mesh, threadCount);
+		}
+
+		bool Parse(const char* pData, size_t size, ObjMesh& mesh, uint32_t threadCount)
+		{
+			mesh = ObjMesh{};
+
+			if (threadCount == 0)
+				threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+			const size_t maxChunkCount{ size_t(threadCount) * CHUNKS_PER_THREAD };
+			const size_t chunkCount{ std::clamp(size / MIN_CHUNK_SIZE, size_t(1), maxChunkCount) };
+
+			std::vector<Chunk> chunks(chunkCount);
+			const char* pEnd{ pData + size };
+
+			for (size_t chunkIndex{ 0 }; chunkIndex < chunkCount; ++chunkIndex)
+			{
+				chunks[chunkIndex].pBegin = chunkIndex == 0 ? pData : chunks[chunkIndex - 1].pEnd;
+				chunks[chunkIndex].pEnd = chunkIndex + 1 == chunkCount ? pEnd : FindLineStart(pData + ((size * (chunkIndex + 1)) / chunkCount), pData, pEnd);
+				chunks[chunkIndex].pEnd = std::max(chunks[chunkIndex].pEnd, chunks[chunkIndex].pBegin);
+			}
+
+			WorkerPool workerPool{ chunkCount > 1 ? threadCount : 1 };
+
+			auto parseChunk = [&chunks](uint32_t chunkIndex, uint32_t)
+				{
+					ParseChunk(chunks[chunkIndex]);
+				};
+
+			workerPool.Run(uint32_t(chunkCount), parseChunk);
+
+			//Every chunk's elements follow those of the chunks before it
+			size_t positionCount{ 0 };
+			size_t texCoordCount{ 0 };
+			size_t normalCount{ 0 };
+			size_t triangleCount{ 0 };
+
+			for (Chunk& chunk : chunks)
+			{
+				if (!chunk.isValid)
+					return false;
+
+				chunk.firstPosition = uint32_t(positionCount);
+				chunk.firstTexCoord = uint32_t(texCoordCount);
+				chunk.firstNormal = uint32_t(normalCount);
+				chunk.firstTriangle = uint32_t(triangleCount);
+
+				positionCount += chunk.positions.size();
+				texCoordCount += chunk.texCoords.size();
+				normalCount += chunk.vertexNormals.size();
+				triangleCount += chunk.triangleCount;
+			}
+
+			//Indices are ints
+			if (positionCount > INT32_MAX || texCoordCount > INT32_MAX || normalCount > INT32_MAX || (3 * triangleCount) > INT32_MAX)
+				return false;
+
+			mesh.positions.resize(positionCount);
+			mesh.texCoords.resize(texCoordCount);
+			mesh.vertexNormals.resize(normalCount);
+			mesh.indices.resize(3 * triangleCount);
+			mesh.texCoordIndices.resize(3 * triangleCount);
+			mesh.normalIndices.resize(3 * triangleCount);
+			mesh.faceNormals.resize(triangleCount);
+
+			//All positions have to be in place before the face normals are computed, faces may refer to vertices of later chunks
+			auto copyVertices = [&chunks, &mesh](uint32_t chunkIndex, uint32_t)
+				{
+					const Chunk& chunk{ chunks[chunkIndex] };
+					std::copy(chunk.positions.begin(), chunk.positions.end(), mesh.positions.begin() + chunk.firstPosition);
+					std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), mesh.texCoords.begin() + chunk.firstTexCoord);
+					std::copy(chunk.vertexNormals.begin(), chunk.vertexNormals.end(), mesh.vertexNormals.begin() + chunk.firstNormal);
+				};
+
+			workerPool.Run(uint32_t(chunkCount), copyVertices);
+
+			auto resolveChunk = [&chunks, &mesh](uint32_t chunkIndex, uint32_t)
+				{
+					ResolveChunk(chunks[chunkIndex], mesh);
+				};
+
+			workerPool.Run(uint32_t(chunkCount), resolveChunk);
+
+			for (const Chunk& chunk : chunks)
+			{
+				if (!chunk.isValid)
+				{
+					mesh = ObjMesh{};
+					return false;
+				}
+			}
+
+			return true;
+		}
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Vector3.h"
+
+namespace dae
+{
+	//Contents of a Wavefront OBJ file. Polygons are triangulated as fans, every index is 0 based and refers to the arrays below.
+	struct ObjMesh
+	{
+		std::vector<Vector3> positions{};
+		//u, v and w of every "vt", missing components are 0
+		std::vector<Vector3> texCoords{};
+		//The "vn" normals as they are written in the file
+		std::vector<Vector3> vertexNormals{};
+
+		//Three per triangle, the texture coordinate and normal indices are -1 for corners that have none
+		std::vector<int> indices{};
+		std::vector<int> texCoordIndices{};
+		std::vector<int> normalIndices{};
+
+		//One per triangle, the normalized cross product of its edges
+		std::vector<Vector3> faceNormals{};
+
+		inline size_t GetTriangleCount() const { return indices.size() / 3; }
+	};
+
+	//Parses OBJ files in parallel: the file is memory mapped and split into chunks at line ends, every chunk is parsed by a worker
+	//into its own arrays and a second parallel pass resolves the indices and copies the chunks into the ObjMesh.
+	//Supports v, vt, vn and f with the v, v/vt, v//vn and v/vt/vn corner syntax, negative (relative) indices and polygons of any size.
+	//Other statements (groups, materials, lines, ...) are skipped.
+	namespace ObjLoader
+	{
+		/**
+		 * \brief Loads an OBJ file into mesh, which is cleared first
+		 * \param threadCount workers that parse the chunks, 0 uses the amount of hardware threads
+		 * \return false when the file can not be read, contains a malformed statement or a face refers to a vertex that does not exist
+		 */
+		bool Load(const std::string& filename, ObjMesh& mesh, uint32_t threadCount = 0);
+
+		//Same as Load, for OBJ data that is already in memory
+		bool Parse(const char* pData, size_t size, ObjMesh& mesh, uint32_t threadCount = 0);
+	}
+}
@@ -1,7 +1,3 @@
-//External includes
-#include "SDL.h"
-#include "SDL_surface.h"
-
 //Project includes
 #include "Renderer.h"
 #include "Math.h"
@@ -10,68 +6,181 @@
 #include "Scene.h"
 #include "Utils.h"
 #include "Sphere.h"
+#include "AllocationCounter.h"
+#include "CpuFeatures.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <bit>
+#include <cassert>
 #include <iostream>
-#include <execution>
 
 #define PARALLEL_EXECUTION
 
 using namespace dae;
 
-Renderer::Renderer(SDL_Window * pWindow) :
-	m_pWindow(pWindow),
-	m_pBuffer(SDL_GetWindowSurface(pWindow))
+namespace
 {
-	//Initialize
-	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
-	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+	//Radical inverse of index in the given base, consecutive indices spread evenly over [0, 1)
+	float GetHaltonValue(uint32_t index, const uint32_t base)
+	{
+		float value{ 0.0f };
+		float fraction{ 1.0f / base };
+
+		while (index > 0)
+		{
+			value += (index % base) * fraction;
+			index /= base;
+			fraction /= base;
+		}
+
+		return value;
+	}
 }
 
-void Renderer::Render(Scene* pScene) const
+void RenderStatistics::Add(const RenderStatistics& other)
+{
+	primaryRayCount += other.primaryRayCount;
+	shadowRayCount += other.shadowRayCount;
+	occluderCacheTestCount += other.occluderCacheTestCount;
+	occluderCacheHitCount += other.occluderCacheHitCount;
+}
+
+Renderer::Renderer(uint32_t width, uint32_t height, uint32_t threadCount, uint32_t tileSize) :
+	m_BRDFMode(BRDFMode::Fast),
+	m_FrameBuffer(width, height),
+	m_Width(int(width)),
+	m_Height(int(height)),
+	m_pWorkerPool(std::make_unique<WorkerPool>(threadCount))
+{
+	SetTileSize(tileSize);
+	m_WorkerData.resize(m_pWorkerPool->GetThreadCount());
+}
+
+Renderer::~Renderer() = default;
+
+uint32_t Renderer::GetThreadCount() const
+{
+	return m_pWorkerPool->GetThreadCount();
+}
+
+void Renderer::SetProgressive(bool isEnabled)
+{
+	m_ProgressiveEnabled = isEnabled;
+	ResetAccumulation();
+
+	//Allocated here rather than in Render, which has to stay allocation free
+	m_FrameBuffer.SetFloatTarget(isEnabled);
+}
+
+void Renderer::Render(Scene* pScene)
 {
 	Camera& camera = pScene->GetCamera();
-	auto& materials = pScene->GetMaterials();
-	auto& lights = pScene->GetLights();
 
-	const Vector3 right{ camera.GetCameraToWorld().GetAxisX() };
-	const Vector3 up{ camera.GetCameraToWorld().GetAxisY() };
-	const Vector3 forward{ camera.GetCameraToWorld().GetAxisZ() };
+	m_SampleOffsetX = 0.5f;
+	m_SampleOffsetY = 0.0f;
+
+	if (m_ProgressiveEnabled)
+	{
+		if (pScene != m_pAccumulatedScene || pScene->GetVersion() != m_AccumulatedSceneVersion || camera.GetVersion() != m_AccumulatedCameraVersion)
+		{
+			m_pAccumulatedScene = pScene;
+			m_AccumulatedSceneVersion = pScene->GetVersion();
+			m_AccumulatedCameraVersion = camera.GetVersion();
+			ResetAccumulation();
+		}
+
+		//The FrameBuffer already holds the converged image
+		if (m_AccumulatedFrameCount >= maxAccumulatedFrameCount)
+		{
+			m_FrameStatistics = {};
+			return;
+		}
+
+		//Halton (2, 3) points cover the pixel evenly whatever the amount of frames, the first frame keeps the default sample
+		if (m_AccumulatedFrameCount > 0)
+		{
+			m_SampleOffsetX = GetHaltonValue(m_AccumulatedFrameCount, 2);
+			m_SampleOffsetY = GetHaltonValue(m_AccumulatedFrameCount, 3) - 0.5f;
+		}
+
+		m_AccumulationWeight = 1.0f / float(m_AccumulatedFrameCount + 1);
+	}
 
 	const float aspectRatio{ float(m_Width) / float(m_Height) };
 	const float FOV{ tan((dae::TO_RADIANS * camera.GetFOVAngle()) / 2.0f) };
 
-	const uint32_t pixelCount{ uint32_t(m_Width * m_Height) };
-
-#ifdef PARALLEL_EXECUTION
+	//Only allocates when the amount of lights or the tile size changed, the occluders of a previous frame are still good guesses otherwise
+	const size_t lightCount{ pScene->GetLights().size() };
+	const size_t tilePixelCount{ size_t(m_TileSize) * m_TileSize };
+	for (WorkerData& workerData : m_WorkerData)
+	{
+		if (workerData.lastOccluders.size() != lightCount)
+			workerData.lastOccluders.assign(lightCount, Occluder{});
 
-	std::vector<uint32_t> pixelIndices{ };
+		if (workerData.tileHits.size() != tilePixelCount)
+		{
+			workerData.tileHits.resize(tilePixelCount);
+			workerData.tileRayDirections.resize(tilePixelCount);
+			workerData.tileColors.resize(tilePixelCount);
+			workerData.litSamples.reserve(tilePixelCount);
+			workerData.sortedLitSamples.resize(tilePixelCount);
+		}
+	}
 
-	pixelIndices.reserve(pixelCount);
+	[[maybe_unused]] const uint64_t allocationCountBefore{ AllocationCounter::GetAllocationCount() };
 
-	for (uint32_t pixel{ 0 }; pixel < pixelCount; ++pixel)
+	for (WorkerData& workerData : m_WorkerData)
 	{
-		pixelIndices.emplace_back(pixel);
+		workerData.statistics = {};
 	}
 
-	std::for_each(std::execution::par, pixelIndices.begin(), pixelIndices.end(),
-		[&](int i){ RenderPixel(pScene, i, FOV, aspectRatio, camera.GetCameraToWorld(), camera.GetOrigin()); });	
+	const Matrix cameraToWorld{ camera.GetCameraToWorld() };
+	const Vector3 cameraOrigin{ camera.GetOrigin() };
+
+	const uint32_t tileCountX{ (uint32_t(m_Width) + m_TileSize - 1) / m_TileSize };
+	const uint32_t tileCountY{ (uint32_t(m_Height) + m_TileSize - 1) / m_TileSize };
+
+	const RenderTileFunction renderTileFunction{ GetRenderTileFunction() };
+
+	auto renderTile = [&](uint32_t tileIndex, uint32_t workerIndex)
+		{
+			const uint32_t startX{ (tileIndex % tileCountX) * m_TileSize };
+			const uint32_t startY{ (tileIndex / tileCountX) * m_TileSize };
+			const uint32_t endX{ std::min(startX + m_TileSize, uint32_t(m_Width)) };
+			const uint32_t endY{ std::min(startY + m_TileSize, uint32_t(m_Height)) };
+
+			(this->*renderTileFunction)(pScene, workerIndex, startX, startY, endX, endY, FOV, aspectRatio, cameraToWorld, cameraOrigin);
+		};
+
+#ifdef PARALLEL_EXECUTION
+
+	m_pWorkerPool->Run(tileCountX * tileCountY, renderTile);
 
 #else
 
-	for (uint32_t pixel{ 0 }; pixel < pixelCount; ++pixel)
+	for (uint32_t tile{ 0 }; tile < tileCountX * tileCountY; ++tile)
 	{
-		RenderPixel(pScene, pixel, FOV, aspectRatio, camera.GetCameraToWorld(), camera.GetOrigin());
+		renderTile(tile, 0);
 	}
 
 #endif
 
-	//@END
-	//Update SDL Surface
-	SDL_UpdateWindowSurface(m_pWindow);
+	m_FrameStatistics = {};
+	for (const WorkerData& workerData : m_WorkerData)
+	{
+		m_FrameStatistics.Add(workerData.statistics);
+	}
+
+	if (m_ProgressiveEnabled)
+		++m_AccumulatedFrameCount;
+
+	//Rendering a frame, scheduling included, has to stay allocation free. The batch mode checks it too when built with COUNT_ALLOCATIONS
+	assert(AllocationCounter::GetAllocationCount() == allocationCountBefore && "Heap allocation while rendering a frame");
 }
 
-bool Renderer::SaveBufferToImage() const
+bool Renderer::SaveBufferToImage(const std::string& filename) const
 {
-	return SDL_SaveBMP(m_pBuffer, "RayTracing_Buffer.bmp");
+	return m_FrameBuffer.SaveToBMP(filename);
 }
 
 void Renderer::CycleLightingMode()
@@ -95,6 +204,7 @@ void Renderer::CycleLightingMode()
 		break;
 	}
 
+	ResetAccumulation();
 	PrintCurrentLightingMode();
 }
 
@@ -120,76 +230,348 @@ void Renderer::PrintCurrentLightingMode() const
 	}
 }
 
-void Renderer::RenderPixel(const Scene* pScene, const uint32_t pixelIndex, const float FOV, const float aspectRatio, const Matrix cameraToWorld, const Vector3 cameraOrigin) const
+Vector3 Renderer::GetPrimaryRayDirection(const uint32_t px, const uint32_t py, const float FOV, const float aspectRatio, const Matrix& cameraToWorld) const
 {
-	auto materials{ pScene->GetMaterials() };
-	const uint32_t px{ pixelIndex % m_Width };
-	const uint32_t py{ pixelIndex / m_Width };
+	const float cX{ (((2.0f * (px + m_SampleOffsetX)) / m_Width) - 1.0f) * aspectRatio * FOV };
+	const float cY{ (1.0f - ((2.0f * (py + m_SampleOffsetY)) / m_Height)) * FOV };
 
-	const float cX{ (((2.0f * (px + 0.5f)) / m_Width) - 1.0f) * aspectRatio * FOV };
-	const float cY{ (1.0f - ((2.0f * py) / m_Height)) * FOV };
+	const Vector3 rayDirection{ (cX * cameraToWorld.GetAxisX()) + (cY * cameraToWorld.GetAxisY()) + cameraToWorld.GetAxisZ() };
+	return rayDirection.Normalized();
+}
 
-	Vector3 rayDirection{ (cX * cameraToWorld.GetAxisX()) + (cY * cameraToWorld.GetAxisY()) + cameraToWorld.GetAxisZ() };
-	rayDirection = rayDirection.Normalized();
+Renderer::RenderTileFunction Renderer::GetRenderTileFunction() const
+{
+	//Indexed by lighting mode, then by whether shadows are enabled
+	static constexpr RenderTileFunction renderTileFunctions[4][2]
+	{
+		{ &Renderer::RenderTile<LightingMode::ObservedArea, false>, &Renderer::RenderTile<LightingMode::ObservedArea, true> },
+		{ &Renderer::RenderTile<LightingMode::Radiance, false>, &Renderer::RenderTile<LightingMode::Radiance, true> },
+		{ &Renderer::RenderTile<LightingMode::BRDF, false>, &Renderer::RenderTile<LightingMode::BRDF, true> },
+		{ &Renderer::RenderTile<LightingMode::Combined, false>, &Renderer::RenderTile<LightingMode::Combined, true> },
+	};
 
-	Ray hitRay{ cameraOrigin, rayDirection };
+	return renderTileFunctions[int(m_CurrentLightingMode)][m_ShadowsEnabled ? 1 : 0];
+}
 
-	ColorRGB finalColor{ 0.0f, 0.0f, 0.0f };
-	HitRecord hitRecord{ };
+template<Renderer::LightingMode lightingMode, bool areShadowsEnabled>
+void Renderer::RenderTile(const Scene* pScene, const uint32_t workerIndex, const uint32_t startX, const uint32_t startY, const uint32_t endX, const uint32_t endY, const float FOV, const float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin)
+{
+	WorkerData& workerData{ m_WorkerData[workerIndex] };
+	const uint32_t tileWidth{ endX - startX };
 
-	if (pScene->TryGetClosestHit(hitRay, hitRecord))
+	if (m_PacketTracingEnabled)
+	{
+		for (uint32_t py{ startY }; py < endY; py += RayPacket::width)
+		{
+			for (uint32_t px{ startX }; px < endX; px += RayPacket::width)
+			{
+				TracePacket(pScene, workerData, startX, startY, tileWidth, px, py, std::min(px + RayPacket::width, endX), std::min(py + RayPacket::width, endY), FOV, aspectRatio, cameraToWorld, cameraOrigin);
+			}
+		}
+	}
+	else
 	{
-		for (const auto& light : pScene->GetLights())
+		for (uint32_t py{ startY }; py < endY; ++py)
 		{
-			bool isInShadow{ false };
+			for (uint32_t px{ startX }; px < endX; ++px)
+			{
+				TracePixel(pScene, workerData, ((py - startY) * tileWidth) + (px - startX), px, py, FOV, aspectRatio, cameraToWorld, cameraOrigin);
+			}
+		}
+	}
+
+	ShadeTile<lightingMode, areShadowsEnabled>(pScene, workerData, startX, startY, endX, endY);
+}
+
+void Renderer::TracePixel(const Scene* pScene, WorkerData& workerData, const uint32_t tilePixelIndex, const uint32_t px, const uint32_t py, const float FOV, const float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin)
+{
+	const Vector3 rayDirection{ GetPrimaryRayDirection(px, py, FOV, aspectRatio, cameraToWorld) };
+	HitRecord& hitRecord{ workerData.tileHits[tilePixelIndex] };
+	hitRecord = {};
+
+	++workerData.statistics.primaryRayCount;
+	pScene->TryGetClosestHit(Ray{ cameraOrigin, rayDirection }, hitRecord);
+
+	workerData.tileRayDirections[tilePixelIndex] = rayDirection;
+}
+
+void Renderer::TracePacket(const Scene* pScene, WorkerData& workerData, const uint32_t tileStartX, const uint32_t tileStartY, const uint32_t tileWidth, const uint32_t startX, const uint32_t startY, const uint32_t endX, const uint32_t endY, const float FOV, const float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin)
+{
+	//Pixels outside of the image (at the right and bottom edges) leave their rays unused
+	RayPacket packet{};
+	packet.origin = cameraOrigin;
+
+	for (uint32_t py{ startY }; py < endY; ++py)
+	{
+		for (uint32_t px{ startX }; px < endX; ++px)
+		{
+			packet.SetRay(((py - startY) * RayPacket::width) + (px - startX), GetPrimaryRayDirection(px, py, FOV, aspectRatio, cameraToWorld));
+		}
+	}
+
+	packet.UpdateInverseDirectionBounds();
+
+	HitRecord hitRecords[RayPacket::rayCount]{};
+
+	workerData.statistics.primaryRayCount += std::popcount(packet.activeMask);
+	pScene->TryGetClosestHits(packet, hitRecords);
+
+	for (uint32_t py{ startY }; py < endY; ++py)
+	{
+		for (uint32_t px{ startX }; px < endX; ++px)
+		{
+			const uint32_t rayIndex{ ((py - startY) * RayPacket::width) + (px - startX) };
+			const uint32_t tilePixelIndex{ ((py - tileStartY) * tileWidth) + (px - tileStartX) };
+
+			workerData.tileHits[tilePixelIndex] = hitRecords[rayIndex];
+			workerData.tileRayDirections[tilePixelIndex] = packet.GetDirection(rayIndex);
+		}
+	}
+}
+
+bool Renderer::IsInShadow(const Scene* pScene, WorkerData& workerData, const uint32_t lightIndex, const Ray& shadowRay) const
+{
+	++workerData.statistics.shadowRayCount;
+
+	if (!m_OccluderCacheEnabled)
+		return pScene->DoesHit(shadowRay);
+
+	Occluder& lastOccluder{ workerData.lastOccluders[lightIndex] };
+
+	if (lastOccluder.type != OccluderType::None)
+	{
+		++workerData.statistics.occluderCacheTestCount;
+
+		if (pScene->DoesOccluderHit(lastOccluder, shadowRay))
+		{
+			++workerData.statistics.occluderCacheHitCount;
+			return true;
+		}
+	}
+
+	//Replaces the cached occluder, or clears it when the light is visible so lit pixels do not pay for the extra test
+	return pScene->DoesHit(shadowRay, lastOccluder);
+}
+
+template<Renderer::LightingMode lightingMode, bool areShadowsEnabled>
+void Renderer::ShadeTile(const Scene* pScene, WorkerData& workerData, const uint32_t startX, const uint32_t startY, const uint32_t endX, const uint32_t endY)
+{
+	const std::vector<Light>& lights{ pScene->GetLights() };
+	const uint32_t tileWidth{ endX - startX };
+	const uint32_t pixelCount{ tileWidth * (endY - startY) };
+
+	std::fill_n(workerData.tileColors.begin(), pixelCount, ColorRGB{ 0.0f, 0.0f, 0.0f });
+
+	//Light by light, so every pixel still adds up its lights in the same order
+	for (uint32_t lightIndex{ 0 }; lightIndex < lights.size(); ++lightIndex)
+	{
+		const Light& light{ lights[lightIndex] };
+		workerData.litSamples.clear();
+
+		for (uint32_t pixelIndex{ 0 }; pixelIndex < pixelCount; ++pixelIndex)
+		{
+			const HitRecord& hitRecord{ workerData.tileHits[pixelIndex] };
+			if (!hitRecord.didHit)
+				continue;
 
 			const Vector3 hitToLight{ light.origin - hitRecord.origin };
 			const float distanceFromLight{ hitToLight.Magnitude() };
 			const Vector3 directionToLight{ hitToLight / distanceFromLight };
 
-			if (m_ShadowsEnabled)
+			if constexpr (areShadowsEnabled)
 			{
 				Ray pointToLight{ hitRecord.origin, directionToLight };
 				pointToLight.max = distanceFromLight;
 				pointToLight.min = 0.01f;
 
-				if (pScene->DoesHit(pointToLight))
-				{
-					isInShadow = true;
-				}
+				if (IsInShadow(pScene, workerData, lightIndex, pointToLight))
+					continue;
 			}
 
-			if (!isInShadow)
+			workerData.litSamples.push_back(LitSample{ pixelIndex, directionToLight });
+		}
+
+		ShadeLitSamples<lightingMode>(pScene, workerData, light);
+	}
+
+	//Update Color in Buffer
+	if (m_ProgressiveEnabled)
+	{
+		for (uint32_t py{ startY }; py < endY; ++py)
+		{
+			for (uint32_t px{ startX }; px < endX; ++px)
+			{
+				m_FrameBuffer.AccumulatePixel(px, py, workerData.tileColors[((py - startY) * tileWidth) + (px - startX)], m_AccumulationWeight);
+			}
+		}
+	}
+	else
+	{
+		for (uint32_t py{ startY }; py < endY; ++py)
+		{
+			for (uint32_t px{ startX }; px < endX; ++px)
 			{
-				const float illumination{ LightUtils::GetObservedArea(light, hitRecord) };
-				const ColorRGB radiance = LightUtils::GetRadiance(light, hitRecord.origin);
-				const ColorRGB brdf = materials[hitRecord.materialIndex]->Shade(hitRecord, directionToLight, -rayDirection);
-
-				if (m_CurrentLightingMode == Renderer::LightingMode::Radiance)
-				{
-					finalColor += radiance;
-				}
-				else if (m_CurrentLightingMode == Renderer::LightingMode::ObservedArea)
-				{
-					finalColor += ColorRGB(illumination, illumination, illumination);
-				}
-				else if (m_CurrentLightingMode == Renderer::LightingMode::BRDF)
-				{
-					finalColor += brdf;
-				}
-				else if (m_CurrentLightingMode == LightingMode::Combined)
-				{
-					finalColor += radiance * brdf * illumination;
-				}
+				m_FrameBuffer.SetPixel(px, py, workerData.tileColors[((py - startY) * tileWidth) + (px - startX)]);
 			}
 		}
 	}
+}
 
-	//Update Color in Buffer
-	finalColor.MaxToOne();
+template<Renderer::LightingMode lightingMode>
+void Renderer::AddLight(const Light& light, const HitRecord& hitRecord, const ColorRGB& brdf, ColorRGB& color)
+{
+	if constexpr (lightingMode == LightingMode::BRDF)
+	{
+		color += brdf;
+	}
+	else if constexpr (lightingMode == LightingMode::Combined)
+	{
+		const float illumination{ LightUtils::GetObservedArea(light, hitRecord) };
+		const ColorRGB radiance = LightUtils::GetRadiance(light, hitRecord.origin);
+
+		color += radiance * brdf * illumination;
+	}
+}
+
+template<Renderer::LightingMode lightingMode>
+void Renderer::ShadeLitSamples(const Scene* pScene, WorkerData& workerData, const Light& light) const
+{
+	const std::vector<LitSample>& litSamples{ workerData.litSamples };
+	ColorRGB* pColors{ workerData.tileColors.data() };
+
+	if constexpr (lightingMode == LightingMode::Radiance)
+	{
+		for (const LitSample& sample : litSamples)
+		{
+			pColors[sample.pixelIndex] += LightUtils::GetRadiance(light, workerData.tileHits[sample.pixelIndex].origin);
+		}
+	}
+	else if constexpr (lightingMode == LightingMode::ObservedArea)
+	{
+		for (const LitSample& sample : litSamples)
+		{
+			const float illumination{ LightUtils::GetObservedArea(light, workerData.tileHits[sample.pixelIndex]) };
+			pColors[sample.pixelIndex] += ColorRGB(illumination, illumination, illumination);
+		}
+	}
+	else
+	{
+		const std::vector<MaterialData>& materialTable{ pScene->GetMaterialTable() };
+
+		if (!m_MaterialGroupingEnabled)
+		{
+			switch (m_BRDFMode)
+			{
+			case BRDFMode::Reference:
+				ShadeUnsortedSamples<lightingMode, BRDFMode::Reference>(workerData, materialTable, light, pColors);
+				break;
 
-	m_pBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBuffer->format,
-		static_cast<uint8_t>(finalColor.r * 255),
-		static_cast<uint8_t>(finalColor.g * 255),
-		static_cast<uint8_t>(finalColor.b * 255));
+			case BRDFMode::Fast:
+				ShadeUnsortedSamples<lightingMode, BRDFMode::Fast>(workerData, materialTable, light, pColors);
+				break;
+			}
+
+			return;
+		}
+
+		//Counting sort on the material type, every type is then shaded in one loop of its own
+		uint32_t typeStarts[MaterialData::typeCount + 1]{};
+		for (const LitSample& sample : litSamples)
+		{
+			++typeStarts[uint32_t(materialTable[workerData.tileHits[sample.pixelIndex].materialIndex].type) + 1];
+		}
+
+		for (uint32_t type{ 0 }; type < MaterialData::typeCount; ++type)
+		{
+			typeStarts[type + 1] += typeStarts[type];
+		}
+
+		uint32_t typeEnds[MaterialData::typeCount]{};
+		std::copy_n(typeStarts, MaterialData::typeCount, typeEnds);
+
+		LitSample* pSorted{ workerData.sortedLitSamples.data() };
+		for (const LitSample& sample : litSamples)
+		{
+			pSorted[typeEnds[uint32_t(materialTable[workerData.tileHits[sample.pixelIndex].materialIndex].type)]++] = sample;
+		}
+
+		switch (m_BRDFMode)
+		{
+		case BRDFMode::Reference:
+			ShadeSortedSamples<lightingMode, BRDFMode::Reference>(pSorted, typeStarts, workerData, materialTable, light, pColors);
+			break;
+
+		case BRDFMode::Fast:
+			ShadeSortedSamples<lightingMode, BRDFMode::Fast>(pSorted, typeStarts, workerData, materialTable, light, pColors);
+			break;
+		}
+	}
+}
+
+template<Renderer::LightingMode lightingMode, BRDFMode brdfMode>
+void Renderer::ShadeUnsortedSamples(const WorkerData& workerData, const std::vector<MaterialData>& materialTable, const Light& light, ColorRGB* pColors) const
+{
+	for (const LitSample& sample : workerData.litSamples)
+	{
+		const HitRecord& hitRecord{ workerData.tileHits[sample.pixelIndex] };
+		const Vector3& rayDirection{ workerData.tileRayDirections[sample.pixelIndex] };
+		const ColorRGB brdf{ MaterialShading::Shade<brdfMode>(materialTable[hitRecord.materialIndex], hitRecord, sample.directionToLight, -rayDirection) };
+
+		AddLight<lightingMode>(light, hitRecord, brdf, pColors[sample.pixelIndex]);
+	}
+}
+
+template<Renderer::LightingMode lightingMode, BRDFMode brdfMode>
+void Renderer::ShadeSortedSamples(const LitSample* pSorted, const uint32_t* pTypeStarts, const WorkerData& workerData, const std::vector<MaterialData>& materialTable, const Light& light, ColorRGB* pColors) const
+{
+	static_assert(MaterialData::typeCount == 4, "Every material type needs to be shaded here");
+
+	ShadeMaterialSamples<lightingMode, MaterialType::SolidColor, brdfMode>(pSorted + pTypeStarts[0], pSorted + pTypeStarts[1], workerData, materialTable, light, pColors);
+	ShadeMaterialSamples<lightingMode, MaterialType::Lambert, brdfMode>(pSorted + pTypeStarts[1], pSorted + pTypeStarts[2], workerData, materialTable, light, pColors);
+	ShadeMaterialSamples<lightingMode, MaterialType::LambertPhong, brdfMode>(pSorted + pTypeStarts[2], pSorted + pTypeStarts[3], workerData, materialTable, light, pColors);
+	ShadeMaterialSamples<lightingMode, MaterialType::CookTorrence, brdfMode>(pSorted + pTypeStarts[3], pSorted + pTypeStarts[4], workerData, materialTable, light, pColors);
+}
+
+template<Renderer::LightingMode lightingMode, MaterialType materialType, BRDFMode brdfMode>
+void Renderer::ShadeMaterialSamples(const LitSample* pBegin, const LitSample* pEnd, const WorkerData& workerData, const std::vector<MaterialData>& materialTable, const Light& light, ColorRGB* pColors) const
+{
+	//Cook-Torrence is by far the most expensive, outside of the reference mode it is shaded CookTorrenceBatch::laneCount samples at a time
+	if constexpr (materialType == MaterialType::CookTorrence && brdfMode != BRDFMode::Reference)
+	{
+		const bool useAVX2{ CpuFeatures::HasAVX2() };
+		CookTorrenceBatch batch{};
+
+		for (const LitSample* pFirst{ pBegin }; pFirst < pEnd; pFirst += CookTorrenceBatch::laneCount)
+		{
+			const uint32_t laneCount{ uint32_t(std::min<ptrdiff_t>(pEnd - pFirst, CookTorrenceBatch::laneCount)) };
+
+			for (uint32_t lane{ 0 }; lane < laneCount; ++lane)
+			{
+				const HitRecord& hitRecord{ workerData.tileHits[pFirst[lane].pixelIndex] };
+				const MaterialData& material{ materialTable[hitRecord.materialIndex] };
+
+				batch.SetLane(lane, hitRecord.normal, -workerData.tileRayDirections[pFirst[lane].pixelIndex], pFirst[lane].directionToLight,
+					material.color, material.f0.r, material.roughnessPow4, material.k, material.hasDiffuse ? 1.0f : 0.0f);
+			}
+
+			FastBRDF::ShadeCookTorrenceBatch(batch, laneCount, useAVX2);
+
+			for (uint32_t lane{ 0 }; lane < laneCount; ++lane)
+			{
+				const ColorRGB brdf{ batch.colorR[lane], batch.colorG[lane], batch.colorB[lane] };
+				AddLight<lightingMode>(light, workerData.tileHits[pFirst[lane].pixelIndex], brdf, pColors[pFirst[lane].pixelIndex]);
+			}
+		}
+	}
+	else
+	{
+		for (const LitSample* pSample{ pBegin }; pSample != pEnd; ++pSample)
+		{
+			const HitRecord& hitRecord{ workerData.tileHits[pSample->pixelIndex] };
+			const Vector3& rayDirection{ workerData.tileRayDirections[pSample->pixelIndex] };
+			const ColorRGB brdf{ MaterialShading::Shade<materialType, brdfMode>(materialTable[hitRecord.materialIndex], hitRecord, pSample->directionToLight, -rayDirection) };
+
+			AddLight<lightingMode>(light, hitRecord, brdf, pColors[pSample->pixelIndex]);
+		}
+	}
 }
@@ -1,32 +1,76 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
+#include <vector>
 
-struct SDL_Window;
-struct SDL_Surface;
+#include "DataTypes.h"
+#include "FrameBuffer.h"
 
 namespace dae
 {
 	class Scene;
+	class WorkerPool;
+	struct MaterialData;
+	enum class MaterialType : uint8_t;
+	enum class BRDFMode : uint8_t;
+
+	//Ray counts of the last rendered frame
+	struct RenderStatistics
+	{
+		uint64_t primaryRayCount{ 0 };
+		uint64_t shadowRayCount{ 0 };
+
+		//Shadow rays that had a cached occluder to test first, and those that were blocked by it without a full traversal
+		uint64_t occluderCacheTestCount{ 0 };
+		uint64_t occluderCacheHitCount{ 0 };
+
+		void Add(const RenderStatistics& other);
+	};
 
 	class Renderer final
 	{
 	public:
-		Renderer(SDL_Window* pWindow);
-		~Renderer() = default;
+		//Renders into its own FrameBuffer, presenting it (or not, when headless) is up to the caller.
+		//0 threads uses the amount of hardware threads
+		Renderer(uint32_t width, uint32_t height, uint32_t threadCount = 0, uint32_t tileSize = 16);
+		~Renderer();
 
 		Renderer(const Renderer&) = delete;
 		Renderer(Renderer&&) noexcept = delete;
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
-		void Render(Scene* pScene) const;
-		void RenderPixel(const Scene* pScene, const uint32_t pixelIndex, const float FOV, const float aspectRatio, const struct Matrix cameraToWorld, const struct Vector3 cameraOrigin) const;
-		bool SaveBufferToImage() const;
+		void Render(Scene* pScene);
+		bool SaveBufferToImage(const std::string& filename = "RayTracing_Buffer.bmp") const;
+
+		inline const FrameBuffer& GetFrameBuffer() const { return m_FrameBuffer; }
+		inline const RenderStatistics& GetFrameStatistics() const { return m_FrameStatistics; }
 
 		void CycleLightingMode();
 		void PrintCurrentLightingMode() const;
-		inline void ToggleShadows() { m_ShadowsEnabled = !m_ShadowsEnabled; }
+		inline void ToggleShadows() { m_ShadowsEnabled = !m_ShadowsEnabled; ResetAccumulation(); }
+		inline void SetPacketTracing(bool isEnabled) { m_PacketTracingEnabled = isEnabled; }
+		inline bool IsPacketTracingEnabled() const { return m_PacketTracingEnabled; }
+		inline void SetOccluderCache(bool isEnabled) { m_OccluderCacheEnabled = isEnabled; }
+		inline bool IsOccluderCacheEnabled() const { return m_OccluderCacheEnabled; }
+		inline void SetBRDFMode(BRDFMode brdfMode) { m_BRDFMode = brdfMode; ResetAccumulation(); }
+		inline BRDFMode GetBRDFMode() const { return m_BRDFMode; }
+		inline void SetMaterialGrouping(bool isEnabled) { m_MaterialGroupingEnabled = isEnabled; }
+		inline bool IsMaterialGroupingEnabled() const { return m_MaterialGroupingEnabled; }
+		inline void SetTileSize(uint32_t tileSize) { m_TileSize = tileSize > 0 ? tileSize : 1; }
+		inline uint32_t GetTileSize() const { return m_TileSize; }
+		uint32_t GetThreadCount() const;
+
+		//Progressive mode averages the frames rendered while the camera and the scene stay unchanged, each one with a different jittered sample per pixel.
+		//The first frame after a change looks exactly like a non progressive one, rendering stops once maxAccumulatedFrameCount frames are averaged.
+		void SetProgressive(bool isEnabled);
+		inline bool IsProgressiveEnabled() const { return m_ProgressiveEnabled; }
+		inline uint32_t GetAccumulatedFrameCount() const { return m_AccumulatedFrameCount; }
+		//Starts accumulating from scratch with the next frame, changes to the camera or the scene are detected without it
+		inline void ResetAccumulation() { m_AccumulatedFrameCount = 0; }
+
+		static constexpr uint32_t maxAccumulatedFrameCount{ 256 };
 
 	private:
 
@@ -40,13 +84,100 @@ namespace dae
 
 		LightingMode m_CurrentLightingMode{ LightingMode::Combined };
 		bool m_ShadowsEnabled{ true };
-		 
-		SDL_Window* m_pWindow{};
 
-		SDL_Surface* m_pBuffer{};
-		uint32_t* m_pBufferPixels{};
+		//Primary rays are traced in packets of RayPacket::width x RayPacket::width pixels, or one by one when disabled
+		bool m_PacketTracingEnabled{ true };
+
+		//Shadow rays test the occluder of the previous shadow ray towards the same light first
+		bool m_OccluderCacheEnabled{ true };
+
+		//Which BRDF implementations shade the hits, BRDFMode::Fast unless changed
+		BRDFMode m_BRDFMode;
+
+		//Sorts the lit samples of a tile by material type and shades every type in a loop of its own, Cook-Torrance in SIMD batches outside of BRDFMode::Reference.
+		//Off by default, the sort still costs more than it saves (RayTracer --batch --material-grouping to compare). Otherwise every sample
+		//goes through the material table on its own. The images are the same, apart from rounding in the Cook-Torrance batches
+		bool m_MaterialGroupingEnabled{ false };
+
+		FrameBuffer m_FrameBuffer;
+
+		//The accumulated frames are averaged in the float target of m_FrameBuffer, which only exists while progressive mode is enabled.
+		//The scene and the camera versions of the accumulated frames tell when they have to be thrown away.
+		bool m_ProgressiveEnabled{ false };
+		uint32_t m_AccumulatedFrameCount{ 0 };
+		const Scene* m_pAccumulatedScene{ nullptr };
+		uint64_t m_AccumulatedSceneVersion{ 0 };
+		uint64_t m_AccumulatedCameraVersion{ 0 };
+		//1 / the amount of accumulated frames once the current one is added
+		float m_AccumulationWeight{ 1.0f };
+
+		//Where in the pixel the primary ray of the current frame goes through, the defaults are the sample positions of a non progressive frame
+		float m_SampleOffsetX{ 0.5f };
+		float m_SampleOffsetY{ 0.0f };
 
 		int m_Width{};
 		int m_Height{};
+
+		//Square tiles of m_TileSize pixels are the unit of work handed to the worker pool
+		std::unique_ptr<WorkerPool> m_pWorkerPool{};
+		uint32_t m_TileSize{ 16 };
+
+		//A hit of the tile that the current light reaches, pixelIndex is relative to the tile
+		struct LitSample
+		{
+			uint32_t pixelIndex{};
+			Vector3 directionToLight{};
+		};
+
+		//Every worker counts into its own cache line, the totals are gathered after the frame.
+		//Neighbouring pixels are usually shadowed by the same primitive, so each worker remembers the last occluder per light.
+		//A tile is traced completely before it is shaded, the tile buffers hold m_TileSize * m_TileSize pixels and are only resized when that changes.
+		struct alignas(64) WorkerData
+		{
+			RenderStatistics statistics{};
+			std::vector<Occluder> lastOccluders{};
+
+			std::vector<HitRecord> tileHits{};
+			std::vector<Vector3> tileRayDirections{};
+			std::vector<ColorRGB> tileColors{};
+
+			//Lit samples of the current light, and the same samples grouped by material type
+			std::vector<LitSample> litSamples{};
+			std::vector<LitSample> sortedLitSamples{};
+		};
+
+		std::vector<WorkerData> m_WorkerData{};
+		RenderStatistics m_FrameStatistics{};
+
+		//The lighting mode and shadow toggle are template parameters of everything a tile runs, so Render picks one of the instantiations per frame
+		//and the per light loop has no mode branches left
+		template<LightingMode lightingMode, bool areShadowsEnabled>
+		void RenderTile(const Scene* pScene, const uint32_t workerIndex, const uint32_t startX, const uint32_t startY, const uint32_t endX, const uint32_t endY, const float FOV, const float aspectRatio, const struct Matrix& cameraToWorld, const struct Vector3& cameraOrigin);
+		void TracePixel(const Scene* pScene, WorkerData& workerData, const uint32_t tilePixelIndex, const uint32_t px, const uint32_t py, const float FOV, const float aspectRatio, const struct Matrix& cameraToWorld, const struct Vector3& cameraOrigin);
+		//Traces up to RayPacket::width x RayPacket::width pixels starting at (startX, startY) as one packet
+		void TracePacket(const Scene* pScene, WorkerData& workerData, const uint32_t tileStartX, const uint32_t tileStartY, const uint32_t tileWidth, const uint32_t startX, const uint32_t startY, const uint32_t endX, const uint32_t endY, const float FOV, const float aspectRatio, const struct Matrix& cameraToWorld, const struct Vector3& cameraOrigin);
+
+		using RenderTileFunction = void (Renderer::*)(const Scene*, const uint32_t, const uint32_t, const uint32_t, const uint32_t, const uint32_t, const float, const float, const struct Matrix&, const struct Vector3&);
+		RenderTileFunction GetRenderTileFunction() const;
+
+		struct Vector3 GetPrimaryRayDirection(const uint32_t px, const uint32_t py, const float FOV, const float aspectRatio, const struct Matrix& cameraToWorld) const;
+		//Lights the traced hits of the tile one light at a time and writes them to the FrameBuffer, pixels without a hit stay black.
+		//Only what lightingMode shows is computed, the debug modes skip the BRDF
+		template<LightingMode lightingMode, bool areShadowsEnabled>
+		void ShadeTile(const Scene* pScene, WorkerData& workerData, const uint32_t startX, const uint32_t startY, const uint32_t endX, const uint32_t endY);
+		//Adds what lightingMode shows of the light to the color of a lit sample
+		template<LightingMode lightingMode>
+		static void AddLight(const struct Light& light, const HitRecord& hitRecord, const ColorRGB& brdf, ColorRGB& color);
+		template<LightingMode lightingMode>
+		void ShadeLitSamples(const Scene* pScene, WorkerData& workerData, const struct Light& light) const;
+		//Shades the lit samples in the order they were found, every sample dispatches on its material type
+		template<LightingMode lightingMode, BRDFMode brdfMode>
+		void ShadeUnsortedSamples(const WorkerData& workerData, const std::vector<MaterialData>& materialTable, const struct Light& light, ColorRGB* pColors) const;
+		template<LightingMode lightingMode, BRDFMode brdfMode>
+		void ShadeSortedSamples(const LitSample* pSorted, const uint32_t* pTypeStarts, const WorkerData& workerData, const std::vector<MaterialData>& materialTable, const struct Light& light, ColorRGB* pColors) const;
+		//Adds the light of samples that all have a material of the given type, without any dispatch per sample
+		template<LightingMode lightingMode, MaterialType materialType, BRDFMode brdfMode>
+		void ShadeMaterialSamples(const LitSample* pBegin, const LitSample* pEnd, const WorkerData& workerData, const std::vector<MaterialData>& materialTable, const struct Light& light, ColorRGB* pColors) const;
+		bool IsInShadow(const Scene* pScene, WorkerData& workerData, const uint32_t lightIndex, const struct Ray& shadowRay) const;
 	};
 }
@@ -1,6 +1,7 @@
 #include "Scene.h"
 #include "Utils.h"
 #include "Material.h"
+#include "MeshCache.h"
 #include "Sphere.h"
 
 namespace dae {
@@ -13,7 +14,10 @@ namespace dae {
 		m_SphereGeometries.reserve(32);
 		m_PlaneGeometries.reserve(32);
 		m_TriangleMeshGeometries.reserve(32);
+		m_MeshInstances.reserve(32);
 		m_Lights.reserve(32);
+
+		m_MaterialTable.push_back(m_Materials[0]->GetData());
 	}
 
 	Scene::~Scene()
@@ -29,44 +33,110 @@ namespace dae {
 
 	bool dae::Scene::TryGetClosestHit(const Ray& ray, HitRecord& closestHit) const
 	{
-		float smallestHitDistance{ FLT_MAX };
+		assert(m_SphereBVH.GetPrimitiveIndices().size() == m_SphereGeometries.size() && "Sphere BVH is out of date");
+		assert(m_TopLevelBVH.GetPrimitiveIndices().size() == m_MeshInstances.size() && "Top level BVH is out of date");
+
+		//Every hit shortens the ray, so only closer hits are accepted afterwards
+		Ray closestRay{ ray };
+		bool didHit{ false };
 
-		for (const auto& sphere : m_SphereGeometries)
+		for (const auto& plane : m_PlaneGeometries)
 		{
 			HitRecord hit{ };
 
-			if (GeometryUtils::HitTest_Sphere(sphere, ray, hit) && hit.cameraToPointDistance <= smallestHitDistance)
+			if (GeometryUtils::HitTest_Plane(plane, closestRay, hit))
 			{
-				smallestHitDistance = hit.cameraToPointDistance;
+				closestRay.max = hit.cameraToPointDistance;
 				closestHit = hit;
+				didHit = true;
 			}
 		}
 
-		for (const auto& plane : m_PlaneGeometries)
-		{
-			HitRecord hit{ };
-
-			if (GeometryUtils::HitTest_Plane(plane, ray, hit) && hit.cameraToPointDistance <= smallestHitDistance)
+		didHit |= GeometryUtils::HitTest_BVHLeaves(m_SphereBVH, closestRay,
+			[&](uint32_t nodeIndex, const BVHNode& leaf, Ray& currentRay)
 			{
-				smallestHitDistance = hit.cameraToPointDistance;
+				const uint32_t firstBlock{ m_SphereLeafFirstBlocks[nodeIndex] };
+				const uint32_t blockCount{ (leaf.primitiveCount + SphereBlock::laneCount - 1) / SphereBlock::laneCount };
+				bool didHitLeaf{ false };
+
+				for (uint32_t block{ firstBlock }; block < firstBlock + blockCount; ++block)
+				{
+					if (GeometryUtils::HitTest_SphereBlock(m_SphereBlocks[block], currentRay, closestHit))
+					{
+						currentRay.max = closestHit.cameraToPointDistance;
+						didHitLeaf = true;
+					}
+				}
+
+				return didHitLeaf;
+			});
+
+		didHit |= GeometryUtils::HitTest_BVH(m_TopLevelBVH, closestRay,
+			[&](uint32_t instanceIndex, Ray& currentRay)
+			{
+				const MeshInstance& meshInstance{ m_MeshInstances[instanceIndex] };
+				HitRecord hit{ };
+
+				if (!GeometryUtils::HitTest_MeshInstance(meshInstance, m_TriangleMeshGeometries[meshInstance.meshIndex], currentRay, hit))
+					return false;
+
+				currentRay.max = hit.cameraToPointDistance;
 				closestHit = hit;
+				return true;
+			});
+
+		return didHit;
+	}
+
+
+	uint32_t Scene::TryGetClosestHits(const RayPacket& packet, HitRecord* pClosestHits) const
+	{
+		assert(m_SphereBVH.GetPrimitiveIndices().size() == m_SphereGeometries.size() && "Sphere BVH is out of date");
+		assert(m_TopLevelBVH.GetPrimitiveIndices().size() == m_MeshInstances.size() && "Top level BVH is out of date");
+
+		uint32_t hitMask{ 0 };
+
+		//Node culling needs all rays to point to the same side on every axis
+		if (!packet.isCoherent)
+		{
+			for (uint32_t rayIndex{ 0 }; rayIndex < RayPacket::rayCount; ++rayIndex)
+			{
+				if ((packet.activeMask & (1u << rayIndex)) != 0 && TryGetClosestHit(packet.GetRay(rayIndex), pClosestHits[rayIndex]))
+					hitMask |= 1u << rayIndex;
 			}
+
+			return hitMask;
 		}
 
-		for (const auto& triangleMesh : m_TriangleMeshGeometries)
+		//Every hit shortens its ray, so only closer hits are accepted afterwards
+		RayPacket closestPacket{ packet };
+
+		for (const auto& plane : m_PlaneGeometries)
 		{
-			HitRecord hit{ };
+			hitMask |= GeometryUtils::HitTest_Plane(plane, closestPacket, pClosestHits);
+		}
 
-			if (GeometryUtils::HitTest_TriangleMesh(triangleMesh, ray, hit) && hit.cameraToPointDistance <= smallestHitDistance)
+		GeometryUtils::HitTest_BVHLeaves(m_SphereBVH, closestPacket,
+			[&](uint32_t nodeIndex, const BVHNode& leaf, RayPacket& currentPacket)
 			{
-				smallestHitDistance = hit.cameraToPointDistance;
-				closestHit = hit;
-			}
-		}
+				const uint32_t firstBlock{ m_SphereLeafFirstBlocks[nodeIndex] };
 
-		return (smallestHitDistance != FLT_MAX);
-	}
+				for (uint32_t first{ 0 }; first < leaf.primitiveCount; first += SphereBlock::laneCount)
+				{
+					const uint32_t sphereCount{ std::min(leaf.primitiveCount - first, SphereBlock::laneCount) };
+					hitMask |= GeometryUtils::HitTest_SphereBlock(m_SphereBlocks[firstBlock + (first / SphereBlock::laneCount)], sphereCount, currentPacket, pClosestHits);
+				}
+			});
+
+		GeometryUtils::HitTest_BVH(m_TopLevelBVH, closestPacket,
+			[&](uint32_t instanceIndex, RayPacket& currentPacket)
+			{
+				const MeshInstance& meshInstance{ m_MeshInstances[instanceIndex] };
+				hitMask |= GeometryUtils::HitTest_MeshInstance(meshInstance, m_TriangleMeshGeometries[meshInstance.meshIndex], currentPacket, pClosestHits);
+			});
 
+		return hitMask;
+	}
 
 	void Scene::Update(dae::Timer* pTimer)
 	{
@@ -75,37 +145,96 @@ namespace dae {
 
 	bool Scene::DoesHit(const Ray& ray) const
 	{
-		for (const auto& sphere : m_SphereGeometries)
+		Occluder unusedOccluder{};
+		return DoesHit(ray, unusedOccluder);
+	}
+
+	bool Scene::DoesHit(const Ray& ray, Occluder& occluder) const
+	{
+		assert(m_SphereBVH.GetPrimitiveIndices().size() == m_SphereGeometries.size() && "Sphere BVH is out of date");
+		assert(m_TopLevelBVH.GetPrimitiveIndices().size() == m_MeshInstances.size() && "Top level BVH is out of date");
+
+		//Cheapest primitive classes first, so the expensive mesh traversal only runs when nothing else occludes
+		for (uint32_t planeIndex{ 0 }; planeIndex < m_PlaneGeometries.size(); ++planeIndex)
 		{
-			if (GeometryUtils::HitTest_Sphere(sphere, ray))
+			if (GeometryUtils::DoesHit_Plane(m_PlaneGeometries[planeIndex], ray))
 			{
+				occluder = { OccluderType::Plane, planeIndex };
 				return true;
 			}
 		}
 
-		for (const auto& plane : m_PlaneGeometries)
-		{
-			if (GeometryUtils::HitTest_Plane(plane, ray))
+		const bool doesHitSphere{ GeometryUtils::DoesHit_BVHLeaves(m_SphereBVH, ray,
+			[&](uint32_t nodeIndex, const BVHNode& leaf, const Ray& currentRay)
+			{
+				const uint32_t firstBlock{ m_SphereLeafFirstBlocks[nodeIndex] };
+				const uint32_t blockCount{ (leaf.primitiveCount + SphereBlock::laneCount - 1) / SphereBlock::laneCount };
+
+				for (uint32_t block{ firstBlock }; block < firstBlock + blockCount; ++block)
+				{
+					if (GeometryUtils::DoesHit_SphereBlock(m_SphereBlocks[block], currentRay))
+					{
+						occluder = { OccluderType::SphereBlock, block };
+						return true;
+					}
+				}
+
+				return false;
+			}) };
+
+		if (doesHitSphere)
+			return true;
+
+		const bool doesHitInstance{ GeometryUtils::DoesHit_BVH(m_TopLevelBVH, ray,
+			[&](uint32_t instanceIndex, const Ray& currentRay)
 			{
+				const MeshInstance& meshInstance{ m_MeshInstances[instanceIndex] };
+				uint32_t occludingBlock{};
+
+				if (!GeometryUtils::DoesHit_MeshInstance(meshInstance, m_TriangleMeshGeometries[meshInstance.meshIndex], currentRay, occludingBlock))
+					return false;
+
+				occluder = { OccluderType::TriangleBlock, occludingBlock, instanceIndex };
 				return true;
-			}
-		}
+			}) };
+
+		if (!doesHitInstance)
+			occluder = {};
+
+		return doesHitInstance;
+	}
 
-		for (const auto& triangleMesh : m_TriangleMeshGeometries)
+	bool Scene::DoesOccluderHit(const Occluder& occluder, const Ray& ray) const
+	{
+		switch (occluder.type)
 		{
-			if (GeometryUtils::HitTest_TriangleMesh(triangleMesh, ray))
-			{
-				return true;
-			}
+		case OccluderType::Plane:
+			return occluder.index < m_PlaneGeometries.size() && GeometryUtils::DoesHit_Plane(m_PlaneGeometries[occluder.index], ray);
+
+		case OccluderType::SphereBlock:
+			return occluder.index < m_SphereBlocks.size() && GeometryUtils::DoesHit_SphereBlock(m_SphereBlocks[occluder.index], ray);
+
+		case OccluderType::TriangleBlock:
+		{
+			if (occluder.instanceIndex >= m_MeshInstances.size())
+				return false;
+
+			const MeshInstance& meshInstance{ m_MeshInstances[occluder.instanceIndex] };
+			const TriangleMesh& mesh{ m_TriangleMeshGeometries[meshInstance.meshIndex] };
+
+			return occluder.index < mesh.triangleBlocks.size() &&
+				GeometryUtils::DoesHit_TriangleBlock(mesh.triangleBlocks[occluder.index], mesh.cullMode, GeometryUtils::GetObjectRay(meshInstance, ray));
 		}
 
-		return false;
+		default:
+			return false;
+		}
 	}
 
 #pragma region Scene Helpers
 	Sphere* Scene::AddSphere(const Vector3& origin, float radius, unsigned char materialIndex)
 	{
-		Sphere s{ origin, Vector3(1.0f, 1.0f, 1.0f), radius, materialIndex };
+		Sphere s{ origin, radius, materialIndex };
 
 		m_SphereGeometries.emplace_back(s);
 		return &m_SphereGeometries.back();
@@ -122,16 +251,40 @@ namespace dae {
 		return &m_PlaneGeometries.back();
 	}
 
-	TriangleMesh* Scene::AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex)
+	TriangleMesh* Scene::AddTriangleMesh(TriangleCullMode cullMode)
 	{
 		TriangleMesh m{};
 		m.cullMode = cullMode;
-		m.materialIndex = materialIndex;
 
 		m_TriangleMeshGeometries.emplace_back(m);
 		return &m_TriangleMeshGeometries.back();
 	}
 
+	TriangleMesh* Scene::AddTriangleMeshFromOBJ(const std::string& filename, TriangleCullMode cullMode)
+	{
+		TriangleMesh mesh{};
+		mesh.cullMode = cullMode;
+
+		if (!MeshCache::LoadOBJ(filename, mesh))
+			return nullptr;
+
+		m_TriangleMeshGeometries.emplace_back(std::move(mesh));
+		return &m_TriangleMeshGeometries.back();
+	}
+
+	MeshInstance* Scene::AddMeshInstance(const TriangleMesh* pTriangleMesh, unsigned char materialIndex, const Matrix& transform)
+	{
+		MeshInstance i{};
+		i.meshIndex = static_cast<uint32_t>(pTriangleMesh - m_TriangleMeshGeometries.data());
+		i.materialIndex = materialIndex;
+		i.SetTransform(transform);
+
+		assert(i.meshIndex < m_TriangleMeshGeometries.size());
+
+		m_MeshInstances.emplace_back(i);
+		return &m_MeshInstances.back();
+	}
+
 	Light* Scene::AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color)
 	{
 		Light l;
@@ -159,8 +312,51 @@ namespace dae {
 	unsigned char Scene::AddMaterial(Material* pMaterial)
 	{
 		m_Materials.push_back(pMaterial);
+		m_MaterialTable.push_back(pMaterial->GetData());
 		return static_cast<unsigned char>(m_Materials.size() - 1);
 	}
+
+	void Scene::UpdateAccelerationStructures()
+	{
+		//Overwritten in place, only reallocates when objects were added
+		m_ObjectBounds.resize(m_SphereGeometries.size());
+
+		for (size_t sphereIndex{ 0 }; sphereIndex < m_SphereGeometries.size(); ++sphereIndex)
+		{
+			const Sphere& sphere{ m_SphereGeometries[sphereIndex] };
+			const Vector3 extent{ sphere.GetRadius(), sphere.GetRadius(), sphere.GetRadius() };
+
+			AABB& bounds{ m_ObjectBounds[sphereIndex] };
+			bounds = AABB{};
+			bounds.Grow(sphere.GetCenter() - extent);
+			bounds.Grow(sphere.GetCenter() + extent);
+		}
+
+		m_SphereBVH.SetLeafBlockSize(SphereBlock::laneCount);
+		m_SphereBVH.Update(m_ObjectBounds);
+		PackLeafBlocks(m_SphereBVH, [this](uint32_t sphereIndex) -> const Sphere& { return m_SphereGeometries[sphereIndex]; }, m_SphereBlocks, m_SphereLeafFirstBlocks);
+
+		m_ObjectBounds.resize(m_MeshInstances.size());
+
+		for (size_t instanceIndex{ 0 }; instanceIndex < m_MeshInstances.size(); ++instanceIndex)
+		{
+			const MeshInstance& meshInstance{ m_MeshInstances[instanceIndex] };
+			const TriangleMesh& triangleMesh{ m_TriangleMeshGeometries[meshInstance.meshIndex] };
+			AABB& bounds{ m_ObjectBounds[instanceIndex] };
+
+			//Meshes without triangles get an empty box so the primitive indices still line up
+			if (triangleMesh.bvh.IsEmpty())
+			{
+				bounds = AABB{};
+				bounds.Grow(meshInstance.transform.GetTranslation());
+			}
+			else
+				bounds = triangleMesh.bvh.GetBounds().Transformed(meshInstance.transform);
+		}
+
+		m_TopLevelBVH.Update(m_ObjectBounds);
+		++m_Version;
+	}
 #pragma endregion
 #pragma endregion
 
@@ -185,6 +381,8 @@ namespace dae {
 		AddPlane({ 0.f, -75.f, 0.f }, { 0.f, 1.f,0.f }, matId_Solid_Yellow);
 		AddPlane({ 0.f, 75.f, 0.f }, { 0.f, -1.f,0.f }, matId_Solid_Yellow);
 		AddPlane({ 0.f, 0.f, 125.f }, { 0.f, 0.f,-1.f }, matId_Solid_Magenta);
+
+		UpdateAccelerationStructures();
 	}
 #pragma endregion
 
@@ -219,6 +417,8 @@ namespace dae {
 		AddPointLight(Vector3{ 0.f, 5.f, 5.f }, 50.f, ColorRGB{ 1.f, .61f, .45f }); //Backlight
 		AddPointLight(Vector3{ -2.5f, 5.f, -5.f }, 70.f, ColorRGB{ 1.f, .8f, .45f }); //Front Light Left
 		AddPointLight(Vector3{ 2.5f, 2.5f, -5.f }, 50.f, ColorRGB{ .34f, .47f, .68f });
+
+		UpdateAccelerationStructures();
 	}
 #pragma endregion
 
@@ -256,6 +456,8 @@ namespace dae {
 		AddPointLight(Vector3{ 0.f, 5.f, 5.f }, 50.f, ColorRGB{ 1.f, .61f, .45f }); //Backlight
 		AddPointLight(Vector3{ -2.5f, 5.f, -5.f }, 70.f, ColorRGB{ 1.f, .8f, .45f }); //Front Light Left
 		AddPointLight(Vector3{ 2.5f, 2.5f, -5.f }, 50.f, ColorRGB{ .34f, .47f, .68f });
+
+		UpdateAccelerationStructures();
 	}
 #pragma endregion
 
@@ -291,52 +493,100 @@ namespace dae {
 		//CW Winding Order!
 		const Triangle baseTriangle = { Vector3(-0.75f, 1.5f, 0.0f), Vector3(0.75f, 0.0f, 0.0f), Vector3(-0.75f, 0.0f, 0.0f) };
 
-		AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		m_TriangleMeshGeometries[0].AppendTriangle(baseTriangle, true);
-		m_TriangleMeshGeometries[0].CreateTriangles();
-		m_TriangleMeshGeometries[0].Translate({ -1.75f, 4.5f, 0.0f });
-		m_TriangleMeshGeometries[0].UpdateTransforms();
+		//Every mesh is stored once in object space and placed in the world through its instance
+		TriangleMesh* pBackFaceCulledMesh{ AddTriangleMesh(TriangleCullMode::BackFaceCulling) };
+		pBackFaceCulledMesh->AppendTriangle(baseTriangle, true);
+		pBackFaceCulledMesh->CreateTriangles();
+		AddMeshInstance(pBackFaceCulledMesh, matLambert_White, Matrix::CreateTranslation({ -1.75f, 4.5f, 0.0f }));
 
-		AddTriangleMesh(TriangleCullMode::FrontFaceCulling, matLambert_White);
-		m_TriangleMeshGeometries[1].AppendTriangle(baseTriangle, true);
-		m_TriangleMeshGeometries[1].CreateTriangles();
-		m_TriangleMeshGeometries[1].Translate({ 0.0f, 4.5f, 0.0f });
-		m_TriangleMeshGeometries[1].UpdateTransforms();
+		TriangleMesh* pFrontFaceCulledMesh{ AddTriangleMesh(TriangleCullMode::FrontFaceCulling) };
+		pFrontFaceCulledMesh->AppendTriangle(baseTriangle, true);
+		pFrontFaceCulledMesh->CreateTriangles();
+		AddMeshInstance(pFrontFaceCulledMesh, matLambert_White, Matrix::CreateTranslation({ 0.0f, 4.5f, 0.0f }));
 
-		AddTriangleMesh(TriangleCullMode::NoCulling, matLambert_White);
-		m_TriangleMeshGeometries[2].AppendTriangle(baseTriangle, true);
-		m_TriangleMeshGeometries[2].CreateTriangles();
-		m_TriangleMeshGeometries[2].Translate({ 1.75f, 4.5f, 0.0f });
-		m_TriangleMeshGeometries[2].UpdateTransforms();
+		TriangleMesh* pNotCulledMesh{ AddTriangleMesh(TriangleCullMode::NoCulling) };
+		pNotCulledMesh->AppendTriangle(baseTriangle, true);
+		pNotCulledMesh->CreateTriangles();
+		AddMeshInstance(pNotCulledMesh, matLambert_White, Matrix::CreateTranslation({ 1.75f, 4.5f, 0.0f }));
 
-		/*m_pBunnyMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		Utils::ParseOBJ("Resources/lowpoly_bunny.obj", m_pBunnyMesh->positions, m_pBunnyMesh->normals, m_pBunnyMesh->indices);
-
-		m_pBunnyMesh->CreateTriangles();
-		m_pBunnyMesh->Scale({ 2.0f, 2.0f, 2.0f });
-		m_pBunnyMesh->UpdateTransforms();*/
+		/*TriangleMesh* pBunnyMesh = AddTriangleMeshFromOBJ("Resources/lowpoly_bunny.obj", TriangleCullMode::BackFaceCulling);
+		m_pBunnyInstance = AddMeshInstance(pBunnyMesh, matLambert_White, Matrix::CreateScale({ 2.0f, 2.0f, 2.0f }));*/
 
 		AddPointLight(Vector3{ 0.f, 5.f, 5.f }, 50.f, ColorRGB{ 1.f, .61f, .45f }); //Backlight
 		AddPointLight(Vector3{ -2.5f, 5.f, -5.f }, 70.f, ColorRGB{ 1.f, .8f, .45f }); //Front Light Left
 		AddPointLight(Vector3{ 2.5f, 2.5f, -5.f }, 50.f, ColorRGB{ .34f, .47f, .68f });
+
+		UpdateAccelerationStructures();
 	}
 
 	void Scene_W4::Update(dae::Timer* pTimer)
 	{
 		Scene::Update(pTimer);
 
-		if(m_pBunnyMesh != nullptr)
+		//Animating an instance only costs a matrix update, the mesh itself is never touched
+		const Matrix rotation{ Matrix::CreateRotationY(10.0f * PI * pTimer->GetTotal()) };
+
+		for (auto& meshInstance : m_MeshInstances)
 		{
-			m_pBunnyMesh->RotateY(10.0f * PI * pTimer->GetTotal());
-			m_pBunnyMesh->UpdateTransforms();
+			meshInstance.SetTransform(rotation * Matrix::CreateTranslation(meshInstance.transform.GetTranslation()));
 		}
 
-		for (auto& triangleMesh : m_TriangleMeshGeometries)
+		if(m_pBunnyInstance != nullptr)
 		{
-			triangleMesh.RotateY(10.0f * PI * pTimer->GetTotal());
-			triangleMesh.UpdateTransforms();
+			m_pBunnyInstance->SetTransform(Matrix::CreateScale({ 2.0f, 2.0f, 2.0f }) * rotation);
 		}
+
+		UpdateAccelerationStructures();
 	}
 
 #pragma endregion
-}
+
+#pragma region SCENE FILE
+	Scene_File::Scene_File(const std::string& filename):
+		m_Filename{ filename }
+	{
+	}
+
+	Scene_File::Scene_File(const std::string& filename, std::string text):
+		m_Filename{ filename },
+		m_Text{ std::move(text) },
+		m_IsInMemory{ true }
+	{
+	}
+
+	void Scene_File::Initialize()
+	{
+		sceneName = m_Filename;
+
+		if (!m_IsInMemory)
+		{
+			LoadSceneFile(m_Filename, m_Error);
+			return;
+		}
+
+		LoadSceneText(m_Text.data(), m_Text.size(), m_Filename, m_Error);
+
+		//Not needed anymore once it is parsed
+		m_Text = std::string{};
+	}
+#pragma endregion
+
+#pragma region Scene Factory
+	std::unique_ptr<Scene> CreateScene(const std::string& name)
+	{
+		if (name.ends_with(".scene"))
+			return std::make_unique<Scene_File>(name);
+
+		if (name == "W1")
+			return std::make_unique<Scene_W1>();
+		if (name == "W2")
+			return std::make_unique<Scene_W2>();
+		if (name == "W3")
+			return std::make_unique<Scene_W3>();
+		if (name == "W4")
+			return std::make_unique<Scene_W4>();
+
+		return nullptr;
+	}
+#pragma endregion
+}
\ No newline at end of file
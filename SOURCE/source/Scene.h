@@ -1,4 +1,5 @@
 #pragma once
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -11,8 +12,10 @@ namespace dae
 	//Forward Declarations
 	class Timer;
 	class Material;
+	struct MaterialData;
 	struct Plane;
 	class Sphere;
+	struct SphereBlock;
 	struct Light;
 
 	//Scene Base Class
@@ -30,14 +33,29 @@ namespace dae
 		virtual void Initialize() = 0;
 		virtual void Update(dae::Timer* pTimer);
 
+		//Empty when Initialize succeeded, a scene that failed to initialize (e.g. a scene file that could not be loaded) must not be rendered
+		const std::string& GetError() const { return m_Error; }
+
 		Camera& GetCamera() { return m_Camera; }
+		//Changes whenever the acceleration structures were updated, which every change to the geometry goes through
+		uint64_t GetVersion() const { return m_Version; }
 		bool TryGetClosestHit(const Ray& ray, HitRecord& closestHit) const;
+
+		//Closest hits of all rays in the packet, traced together while the packet stays coherent and one by one otherwise.
+		//Returns the mask of the rays that hit something, only their hit records are written.
+		uint32_t TryGetClosestHits(const RayPacket& packet, HitRecord* pClosestHits) const;
 		bool DoesHit(const Ray& ray) const;
+		//Also returns what blocked the ray, or an occluder of type None when nothing did
+		bool DoesHit(const Ray& ray, Occluder& occluder) const;
+		//Only tests the given occluder, occluders that no longer exist never hit
+		bool DoesOccluderHit(const Occluder& occluder, const Ray& ray) const;
 
 		const std::vector<Plane>& GetPlaneGeometries() const { return m_PlaneGeometries; }
 		const std::vector<Sphere>& GetSphereGeometries() const { return m_SphereGeometries; }
 		const std::vector<Light>& GetLights() const { return m_Lights; }
-		const std::vector<Material*> GetMaterials() const { return m_Materials; }
+		const std::vector<Material*>& GetMaterials() const { return m_Materials; }
+		//One entry per material, indexed by materialIndex
+		const std::vector<MaterialData>& GetMaterialTable() const { return m_MaterialTable; }
 
 	protected:
 		std::string	sceneName;
@@ -46,18 +64,45 @@ namespace dae
 		std::vector<Sphere> m_SphereGeometries{};
 		std::vector<Triangle> m_Triangles{ };
 		std::vector<TriangleMesh> m_TriangleMeshGeometries{};
+		std::vector<MeshInstance> m_MeshInstances{};
 		std::vector<Light> m_Lights{};
 		std::vector<Material*> m_Materials{};
+		std::vector<MaterialData> m_MaterialTable{};
+
+		//Spheres get their own hierarchy with leaves packed into SIMD blocks, the top level one is built over the mesh instances.
+		//Planes are infinite and are tested separately.
+		BVH m_SphereBVH{};
+		std::vector<SphereBlock> m_SphereBlocks{};
+		std::vector<uint32_t> m_SphereLeafFirstBlocks{};
+		BVH m_TopLevelBVH{};
+
+		//Kept between updates so refitting every frame does not allocate
+		std::vector<AABB> m_ObjectBounds{};
 
 		Camera m_Camera{};
+		uint64_t m_Version{ 0 };
+		std::string m_Error{};
 
 		Sphere* AddSphere(const Vector3& origin, float radius, unsigned char materialIndex = 0);
 		Plane* AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex = 0);
-		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode);
+		//Uses the mesh cache next to the OBJ in place when it is up to date and writes it otherwise, see MeshCache::LoadOBJ.
+		//The triangles are created already, returns nullptr when the OBJ can not be loaded
+		TriangleMesh* AddTriangleMeshFromOBJ(const std::string& filename, TriangleCullMode cullMode);
+		MeshInstance* AddMeshInstance(const TriangleMesh* pTriangleMesh, unsigned char materialIndex = 0, const Matrix& transform = {});
 
 		Light* AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color);
 		Light* AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color);
 		unsigned char AddMaterial(Material* pMaterial);
+
+		//Needs to be called whenever spheres or mesh instances are added or moved, refits the existing hierarchies when possible
+		void UpdateAccelerationStructures();
+
+		//Adds everything a scene file describes (see Scene_File) and updates the acceleration structures.
+		//Returns false with the file name and line in error when the file can not be read or has a malformed statement
+		bool LoadSceneFile(const std::string& filename, std::string& error);
+		//Same as LoadSceneFile for scene text that is already in memory, filename is only used for the errors and to find OBJ files
+		bool LoadSceneText(const char* pData, size_t size, const std::string& filename, std::string& error);
 	};
 
 	//+++++++++++++++++++++++++++++++++++++++++
@@ -122,6 +167,43 @@ namespace dae
 		void Update(dae::Timer* pTimer) override;
 
 	private:
-		TriangleMesh* m_pBunnyMesh;
+		MeshInstance* m_pBunnyInstance{ nullptr };
+	};
+
+	//Scene described by a text file, so scenes can be made (or generated) without building the project again.
+	//One statement per line, '#' starts a comment. Names are single words, vectors and colors are three numbers:
+	//  camera <origin> <fov degrees>
+	//  material <name> solid_color <color> | lambert <color> <kd> | lambert_phong <color> <kd> <ks> <exponent> | cook_torrance <albedo> <metalness> <roughness>
+	//  sphere <center> <radius> <material>
+	//  plane <origin> <normal> <material>
+	//  point_light <origin> <intensity> <color>
+	//  directional_light <direction> <intensity> <color>
+	//  mesh <name> <back|front|none> [<obj file, relative to the scene file>]
+	//  triangle <mesh> <v0> <v1> <v2>                      (only for meshes without an OBJ file)
+	//  instance <mesh> <material> [translate <vector>] [scale <vector>] [rotate_x|rotate_y|rotate_z <degrees>] ...
+	//Materials and meshes have to be declared before they are used, the material "default" always exists.
+	//Instance transforms are applied in the order they are written.
+	class Scene_File final : public Scene
+	{
+	public:
+		explicit Scene_File(const std::string& filename);
+		//For scene text that is already in memory (e.g. made by SceneGenerator), filename is only used for the errors and to find OBJ files
+		Scene_File(const std::string& filename, std::string text);
+		~Scene_File() override = default;
+
+		Scene_File(const Scene_File&) = delete;
+		Scene_File(Scene_File&&) noexcept = delete;
+		Scene_File& operator=(const Scene_File&) = delete;
+		Scene_File& operator=(Scene_File&&) noexcept = delete;
+
+		void Initialize() override;
+
+	private:
+		std::string m_Filename{};
+		std::string m_Text{};
+		bool m_IsInMemory{ false };
 	};
+
+	//Creates (uninitialized) scenes by name ("W1" to "W4") or from a scene file (a name ending in ".scene"), returns nullptr for unknown names
+	std::unique_ptr<Scene> CreateScene(const std::string& name);
 }
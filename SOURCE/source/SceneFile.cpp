@@ -0,0 +1,392 @@
+#include "Scene.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+
+#include "MappedFile.h"
+#include "Material.h"
+#include "Sphere.h"
+#include "TextParsing.h"
+
+namespace dae
+{
+	namespace
+	{
+		using TextParsing::IsSpace;
+		using TextParsing::ParseFloat;
+
+		//Material indices are stored as unsigned char
+		constexpr size_t MAX_MATERIAL_COUNT{ 256 };
+
+		//Looks names up by string_view, so no string is created for every reference
+		struct NameHash
+		{
+			using is_transparent = void;
+
+			size_t operator()(std::string_view name) const
+			{
+				return std::hash<std::string_view>{}(name);
+			}
+		};
+
+		using NameTable = std::unordered_map<std::string, uint32_t, NameHash, std::equal_to<>>;
+
+		//How often every keyword appears, counted in a first pass so the containers of the Scene are allocated once
+		struct StatementCounts
+		{
+			size_t sphereCount{ 0 };
+			size_t planeCount{ 0 };
+			size_t meshCount{ 0 };
+			size_t instanceCount{ 0 };
+			size_t lightCount{ 0 };
+			size_t materialCount{ 0 };
+		};
+
+#pragma region Tokenizer
+		//Also treats a comment as the end of the line
+		inline bool IsEndOfLine(const char* pCurrent, const char* pEnd)
+		{
+			return pCurrent >= pEnd || *pCurrent == '\n' || *pCurrent == '\r' || *pCurrent == '#';
+		}
+
+		inline void SkipSpaces(const char*& pCurrent, const char* pEnd)
+		{
+			while (pCurrent < pEnd && IsSpace(*pCurrent))
+			{
+				++pCurrent;
+			}
+		}
+
+		inline void SkipLine(const char*& pCurrent, const char* pEnd)
+		{
+			pCurrent = std::find(pCurrent, pEnd, '\n');
+			if (pCurrent < pEnd)
+				++pCurrent;
+		}
+
+		//The next whitespace separated word of the line, empty at its end
+		std::string_view ParseWord(const char*& pCurrent, const char* pEnd)
+		{
+			SkipSpaces(pCurrent, pEnd);
+
+			const char* pWord{ pCurrent };
+			while (!IsEndOfLine(pCurrent, pEnd) && !IsSpace(*pCurrent))
+			{
+				++pCurrent;
+			}
+
+			return std::string_view{ pWord, size_t(pCurrent - pWord) };
+		}
+
+		bool ParseNumber(const char*& pCurrent, const char* pEnd, float& value)
+		{
+			SkipSpaces(pCurrent, pEnd);
+			return ParseFloat(pCurrent, pEnd, value) && (IsEndOfLine(pCurrent, pEnd) || IsSpace(*pCurrent));
+		}
+
+		bool ParseVector(const char*& pCurrent, const char* pEnd, Vector3& vector)
+		{
+			return ParseNumber(pCurrent, pEnd, vector.x) && ParseNumber(pCurrent, pEnd, vector.y) && ParseNumber(pCurrent, pEnd, vector.z);
+		}
+
+		bool ParseColor(const char*& pCurrent, const char* pEnd, ColorRGB& color)
+		{
+			return ParseNumber(pCurrent, pEnd, color.r) && ParseNumber(pCurrent, pEnd, color.g) && ParseNumber(pCurrent, pEnd, color.b);
+		}
+
+		//Vectors that are unit length already are kept as they are, Normalized is not exact for them
+		inline Vector3 ToUnitLength(const Vector3& vector)
+		{
+			return vector.SqrMagnitude() == 1.0f ? vector : vector.Normalized();
+		}
+
+		bool ParseCullMode(std::string_view name, TriangleCullMode& cullMode)
+		{
+			if (name == "back")
+				cullMode = TriangleCullMode::BackFaceCulling;
+			else if (name == "front")
+				cullMode = TriangleCullMode::FrontFaceCulling;
+			else if (name == "none")
+				cullMode = TriangleCullMode::NoCulling;
+			else
+				return false;
+
+			return true;
+		}
+
+		StatementCounts CountStatements(const char* pCurrent, const char* pEnd)
+		{
+			StatementCounts counts{};
+
+			while (pCurrent < pEnd)
+			{
+				const std::string_view keyword{ ParseWord(pCurrent, pEnd) };
+
+				if (keyword == "sphere")
+					++counts.sphereCount;
+				else if (keyword == "instance")
+					++counts.instanceCount;
+				else if (keyword == "plane")
+					++counts.planeCount;
+				else if (keyword == "point_light" || keyword == "directional_light")
+					++counts.lightCount;
+				else if (keyword == "material")
+					++counts.materialCount;
+				else if (keyword == "mesh")
+					++counts.meshCount;
+
+				SkipLine(pCurrent, pEnd);
+			}
+
+			return counts;
+		}
+#pragma endregion
+	}
+
+	bool Scene::LoadSceneFile(const std::string& filename, std::string& error)
+	{
+		MappedFile file{};
+		if (!file.Open(filename))
+		{
+			error = filename + ": can not be opened";
+			return false;
+		}
+
+		return LoadSceneText(file.GetData(), file.GetSize(), filename, error);
+	}
+
+	bool Scene::LoadSceneText(const char* pData, size_t size, const std::string& filename, std::string& error)
+	{
+		const char* pCurrent{ pData };
+		const char* pEnd{ pData + size };
+
+		const StatementCounts counts{ CountStatements(pCurrent, pEnd) };
+		m_SphereGeometries.reserve(m_SphereGeometries.size() + counts.sphereCount);
+		m_PlaneGeometries.reserve(m_PlaneGeometries.size() + counts.planeCount);
+		m_TriangleMeshGeometries.reserve(m_TriangleMeshGeometries.size() + counts.meshCount);
+		m_MeshInstances.reserve(m_MeshInstances.size() + counts.instanceCount);
+		m_Lights.reserve(m_Lights.size() + counts.lightCount);
+		m_Materials.reserve(m_Materials.size() + counts.materialCount);
+		m_MaterialTable.reserve(m_MaterialTable.size() + counts.materialCount);
+
+		NameTable materialIndices{};
+		materialIndices.reserve(counts.materialCount + 1);
+		materialIndices.emplace("default", 0);
+
+		//Indices into m_TriangleMeshGeometries, the meshes that are not loaded from an OBJ get their triangles from the file
+		NameTable meshIndices{};
+		meshIndices.reserve(counts.meshCount);
+		std::vector<uint32_t> triangleMeshIndices{};
+
+		//OBJ files are found relative to the scene file
+		const std::filesystem::path directory{ std::filesystem::path{ filename }.parent_path() };
+
+		uint32_t lineNumber{ 0 };
+		const auto Fail{ [&](std::string_view message)
+			{
+				error = filename + "(" + std::to_string(lineNumber) + "): " + std::string{ message };
+				return false;
+			} };
+
+		const auto ParseMaterialIndex{ [&](unsigned char& materialIndex)
+			{
+				const NameTable::const_iterator it{ materialIndices.find(ParseWord(pCurrent, pEnd)) };
+				if (it == materialIndices.end())
+					return false;
+
+				materialIndex = static_cast<unsigned char>(it->second);
+				return true;
+			} };
+
+		const auto ParseMeshIndex{ [&](uint32_t& meshIndex)
+			{
+				const NameTable::const_iterator it{ meshIndices.find(ParseWord(pCurrent, pEnd)) };
+				if (it == meshIndices.end())
+					return false;
+
+				meshIndex = it->second;
+				return true;
+			} };
+
+		while (pCurrent < pEnd)
+		{
+			++lineNumber;
+			const std::string_view keyword{ ParseWord(pCurrent, pEnd) };
+
+			//Ordered by how often they appear in large scenes
+			if (keyword.empty())
+			{
+			}
+			else if (keyword == "sphere")
+			{
+				Vector3 center{};
+				float radius{};
+				unsigned char materialIndex{};
+
+				if (!ParseVector(pCurrent, pEnd, center) || !ParseNumber(pCurrent, pEnd, radius) || radius <= 0.0f)
+					return Fail("sphere needs a center and a positive radius");
+				if (!ParseMaterialIndex(materialIndex))
+					return Fail("sphere refers to an unknown material");
+
+				AddSphere(center, radius, materialIndex);
+			}
+			else if (keyword == "instance")
+			{
+				uint32_t meshIndex{};
+				unsigned char materialIndex{};
+
+				if (!ParseMeshIndex(meshIndex))
+					return Fail("instance refers to an unknown mesh");
+				if (!ParseMaterialIndex(materialIndex))
+					return Fail("instance refers to an unknown material");
+
+				//Applied in the order they are written
+				Matrix transform{};
+				for (std::string_view operation{ ParseWord(pCurrent, pEnd) }; !operation.empty(); operation = ParseWord(pCurrent, pEnd))
+				{
+					Vector3 vector{};
+					float angle{};
+
+					if (operation == "translate" && ParseVector(pCurrent, pEnd, vector))
+						transform *= Matrix::CreateTranslation(vector);
+					else if (operation == "scale" && ParseVector(pCurrent, pEnd, vector))
+						transform *= Matrix::CreateScale(vector);
+					else if (operation == "rotate_x" && ParseNumber(pCurrent, pEnd, angle))
+						transform *= Matrix::CreateRotationX(angle * TO_RADIANS);
+					else if (operation == "rotate_y" && ParseNumber(pCurrent, pEnd, angle))
+						transform *= Matrix::CreateRotationY(angle * TO_RADIANS);
+					else if (operation == "rotate_z" && ParseNumber(pCurrent, pEnd, angle))
+						transform *= Matrix::CreateRotationZ(angle * TO_RADIANS);
+					else
+						return Fail("instance transforms are translate x y z, scale x y z or rotate_x/rotate_y/rotate_z degrees");
+				}
+
+				AddMeshInstance(&m_TriangleMeshGeometries[meshIndex], materialIndex, transform);
+			}
+			else if (keyword == "triangle")
+			{
+				uint32_t meshIndex{};
+				Vector3 vertices[3]{};
+
+				if (!ParseMeshIndex(meshIndex))
+					return Fail("triangle refers to an unknown mesh");
+				if (!ParseVector(pCurrent, pEnd, vertices[0]) || !ParseVector(pCurrent, pEnd, vertices[1]) || !ParseVector(pCurrent, pEnd, vertices[2]))
+					return Fail("triangle needs three vertices");
+
+				if (std::find(triangleMeshIndices.begin(), triangleMeshIndices.end(), meshIndex) == triangleMeshIndices.end())
+					return Fail("triangles can not be added to a mesh that is loaded from an OBJ file");
+
+				m_TriangleMeshGeometries[meshIndex].AppendTriangle(Triangle{ vertices[0], vertices[1], vertices[2] }, true);
+			}
+			else if (keyword == "plane")
+			{
+				Vector3 origin{};
+				Vector3 normal{};
+				unsigned char materialIndex{};
+
+				if (!ParseVector(pCurrent, pEnd, origin) || !ParseVector(pCurrent, pEnd, normal) || normal.SqrMagnitude() == 0.0f)
+					return Fail("plane needs an origin and a normal");
+				if (!ParseMaterialIndex(materialIndex))
+					return Fail("plane refers to an unknown material");
+
+				AddPlane(origin, ToUnitLength(normal), materialIndex);
+			}
+			else if (keyword == "point_light" || keyword == "directional_light")
+			{
+				Vector3 vector{};
+				float intensity{};
+				ColorRGB color{};
+
+				if (!ParseVector(pCurrent, pEnd, vector) || !ParseNumber(pCurrent, pEnd, intensity) || !ParseColor(pCurrent, pEnd, color))
+					return Fail("lights need a position or direction, an intensity and a color");
+
+				if (keyword == "point_light")
+					AddPointLight(vector, intensity, color);
+				else if (vector.SqrMagnitude() > 0.0f)
+					AddDirectionalLight(ToUnitLength(vector), intensity, color);
+				else
+					return Fail("directional light needs a direction");
+			}
+			else if (keyword == "material")
+			{
+				const std::string_view name{ ParseWord(pCurrent, pEnd) };
+				const std::string_view type{ ParseWord(pCurrent, pEnd) };
+				ColorRGB color{};
+				float parameters[3]{};
+
+				if (name.empty() || materialIndices.contains(name))
+					return Fail("material needs a name that is not used yet");
+				if (m_Materials.size() >= MAX_MATERIAL_COUNT)
+					return Fail("a scene has at most 256 materials, including the default one");
+
+				Material* pMaterial{ nullptr };
+				if (type == "solid_color" && ParseColor(pCurrent, pEnd, color))
+					pMaterial = new Material_SolidColor{ color };
+				else if (type == "lambert" && ParseColor(pCurrent, pEnd, color) && ParseNumber(pCurrent, pEnd, parameters[0]))
+					pMaterial = new Material_Lambert{ color, parameters[0] };
+				else if (type == "lambert_phong" && ParseColor(pCurrent, pEnd, color) && ParseNumber(pCurrent, pEnd, parameters[0])
+					&& ParseNumber(pCurrent, pEnd, parameters[1]) && ParseNumber(pCurrent, pEnd, parameters[2]))
+					pMaterial = new Material_LambertPhong{ color, parameters[0], parameters[1], parameters[2] };
+				else if (type == "cook_torrance" && ParseColor(pCurrent, pEnd, color) && ParseNumber(pCurrent, pEnd, parameters[0]) && ParseNumber(pCurrent, pEnd, parameters[1]))
+					pMaterial = new Material_CookTorrence{ color, parameters[0], parameters[1] };
+				else
+					return Fail("materials are solid_color r g b, lambert r g b kd, lambert_phong r g b kd ks exponent or cook_torrance r g b metalness roughness");
+
+				materialIndices.emplace(name, AddMaterial(pMaterial));
+			}
+			else if (keyword == "mesh")
+			{
+				const std::string_view name{ ParseWord(pCurrent, pEnd) };
+				TriangleCullMode cullMode{};
+
+				if (name.empty() || meshIndices.contains(name))
+					return Fail("mesh needs a name that is not used yet");
+				if (!ParseCullMode(ParseWord(pCurrent, pEnd), cullMode))
+					return Fail("mesh needs a cull mode: back, front or none");
+
+				const uint32_t meshIndex{ uint32_t(m_TriangleMeshGeometries.size()) };
+				const std::string_view objFilename{ ParseWord(pCurrent, pEnd) };
+
+				if (objFilename.empty())
+				{
+					AddTriangleMesh(cullMode);
+					triangleMeshIndices.push_back(meshIndex);
+				}
+				else if (AddTriangleMeshFromOBJ((directory / std::filesystem::path{ objFilename }).string(), cullMode) == nullptr)
+					return Fail("can not load " + std::string{ objFilename });
+
+				meshIndices.emplace(name, meshIndex);
+			}
+			else if (keyword == "camera")
+			{
+				Vector3 origin{};
+				float fovAngle{};
+
+				if (!ParseVector(pCurrent, pEnd, origin) || !ParseNumber(pCurrent, pEnd, fovAngle))
+					return Fail("camera needs an origin and a field of view in degrees");
+
+				m_Camera.SetOrigin(origin);
+				m_Camera.SetFOVAngle(fovAngle);
+			}
+			else
+				return Fail("unknown statement " + std::string{ keyword });
+
+			SkipSpaces(pCurrent, pEnd);
+			if (!IsEndOfLine(pCurrent, pEnd))
+				return Fail("unexpected " + std::string{ ParseWord(pCurrent, pEnd) });
+
+			SkipLine(pCurrent, pEnd);
+		}
+
+		for (const uint32_t meshIndex : triangleMeshIndices)
+		{
+			m_TriangleMeshGeometries[meshIndex].CreateTriangles();
+		}
+
+		UpdateAccelerationStructures();
+		return true;
+	}
+}
@@ -0,0 +1,200 @@
+#include "SceneGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
+
+#include "TextParsing.h"
+#include "Vector3.h"
+
+namespace dae
+{
+	namespace SceneGenerator
+	{
+		namespace
+		{
+			//Average distance between the centers of neighbouring objects
+			constexpr float OBJECT_SPACING{ 2.0f };
+
+			//Unit icosahedron, the vertices are scaled by (1 + sqrt(5)) / 2 on one axis before they are normalized
+			constexpr float ICOSAHEDRON_VERTICES[12][3]{
+				{ -1.0f, 1.618034f, 0.0f }, { 1.0f, 1.618034f, 0.0f }, { -1.0f, -1.618034f, 0.0f }, { 1.0f, -1.618034f, 0.0f },
+				{ 0.0f, -1.0f, 1.618034f }, { 0.0f, 1.0f, 1.618034f }, { 0.0f, -1.0f, -1.618034f }, { 0.0f, 1.0f, -1.618034f },
+				{ 1.618034f, 0.0f, -1.0f }, { 1.618034f, 0.0f, 1.0f }, { -1.618034f, 0.0f, -1.0f }, { -1.618034f, 0.0f, 1.0f } };
+
+			constexpr int ICOSAHEDRON_FACES[MESH_TRIANGLE_COUNT][3]{
+				{ 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+				{ 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+				{ 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+				{ 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 } };
+
+			//std::mt19937 gives the same numbers everywhere, the standard distributions do not, so the values are made from its bits directly.
+			//Values are drawn in separate statements, compilers evaluate function arguments in different orders
+			class Random final
+			{
+			public:
+				explicit Random(uint32_t seed):
+					m_Generator{ seed }
+				{
+				}
+
+				//In [min, max)
+				float Get(float min, float max)
+				{
+					return min + ((max - min) * (float(m_Generator() >> 8) * (1.0f / 16777216.0f)));
+				}
+
+				//In [0, count)
+				uint32_t GetIndex(uint32_t count)
+				{
+					return uint32_t((uint64_t(m_Generator()) * count) >> 32);
+				}
+
+				Vector3 GetPoint(float halfSize)
+				{
+					const float x{ Get(-halfSize, halfSize) };
+					const float y{ Get(-halfSize, halfSize) };
+					const float z{ Get(-halfSize, halfSize) };
+					return { x, y, z };
+				}
+
+			private:
+				std::mt19937 m_Generator;
+			};
+
+			void AppendMaterial(std::string& text, Random& random, uint32_t materialIndex)
+			{
+				const float r{ random.Get(0.2f, 1.0f) };
+				const float g{ random.Get(0.2f, 1.0f) };
+				const float b{ random.Get(0.2f, 1.0f) };
+
+				//Mostly the materials that are actually shaded, solid colors only now and then
+				switch (random.GetIndex(8))
+				{
+				case 0:
+					TextParsing::AppendLine(text, "material m%u solid_color %.3f %.3f %.3f\n", materialIndex, r, g, b);
+					break;
+				case 1:
+				case 2:
+					TextParsing::AppendLine(text, "material m%u lambert %.3f %.3f %.3f 1\n", materialIndex, r, g, b);
+					break;
+				case 3:
+				case 4:
+				{
+					const float specularReflectance{ random.Get(0.2f, 1.0f) };
+					const float phongExponent{ random.Get(5.0f, 60.0f) };
+					TextParsing::AppendLine(text, "material m%u lambert_phong %.3f %.3f %.3f 1 %.3f %.1f\n", materialIndex, r, g, b, specularReflectance, phongExponent);
+					break;
+				}
+				default:
+				{
+					const uint32_t metalness{ random.GetIndex(2) };
+					const float roughness{ random.Get(0.1f, 1.0f) };
+					TextParsing::AppendLine(text, "material m%u cook_torrance %.3f %.3f %.3f %u %.3f\n", materialIndex, r, g, b, metalness, roughness);
+					break;
+				}
+				}
+			}
+
+			//An icosahedron with every vertex moved in or out, so the meshes differ
+			void AppendMesh(std::string& text, Random& random, uint32_t meshIndex)
+			{
+				Vector3 vertices[12]{};
+				for (int vertex{ 0 }; vertex < 12; ++vertex)
+				{
+					const Vector3 direction{ ICOSAHEDRON_VERTICES[vertex][0], ICOSAHEDRON_VERTICES[vertex][1], ICOSAHEDRON_VERTICES[vertex][2] };
+					vertices[vertex] = direction * (random.Get(0.7f, 1.3f) / direction.Magnitude());
+				}
+
+				TextParsing::AppendLine(text, "mesh mesh%u none\n", meshIndex);
+
+				for (const auto& face : ICOSAHEDRON_FACES)
+				{
+					const Vector3& v0{ vertices[face[0]] };
+					const Vector3& v1{ vertices[face[1]] };
+					const Vector3& v2{ vertices[face[2]] };
+					TextParsing::AppendLine(text, "triangle mesh%u %.4f %.4f %.4f %.4f %.4f %.4f %.4f %.4f %.4f\n", meshIndex, v0.x, v0.y, v0.z, v1.x, v1.y, v1.z, v2.x, v2.y, v2.z);
+				}
+			}
+		}
+
+		std::string Generate(const Settings& settings)
+		{
+			Random random{ settings.seed };
+
+			const uint32_t materialCount{ std::clamp(settings.materialCount, 1u, MAX_MATERIAL_COUNT) };
+			const uint32_t meshCount{ std::min(settings.meshInstanceCount, MESH_COUNT) };
+			const uint32_t lightCount{ std::max(settings.lightCount, 1u) };
+
+			//The cube holds every object in about OBJECT_SPACING^3
+			const uint64_t objectCount{ uint64_t(settings.sphereCount) + settings.meshInstanceCount };
+			const float halfSize{ std::max(0.5f * OBJECT_SPACING * std::cbrt(float(objectCount)), OBJECT_SPACING) };
+
+			std::string text{};
+			//About 50 bytes per line
+			text.reserve(size_t(64) * (objectCount + materialCount + lightCount + (meshCount * 21) + 8));
+
+			TextParsing::AppendLine(text, "# SceneGenerator seed=%u spheres=%u instances=%u lights=%u materials=%u\n",
+				settings.seed, settings.sphereCount, settings.meshInstanceCount, lightCount, materialCount);
+			TextParsing::AppendLine(text, "camera 0 %.3f %.3f 60\n", 0.25f * halfSize, -2.5f * halfSize);
+
+			for (uint32_t materialIndex{ 0 }; materialIndex < materialCount; ++materialIndex)
+			{
+				AppendMaterial(text, random, materialIndex);
+			}
+
+			for (uint32_t meshIndex{ 0 }; meshIndex < meshCount; ++meshIndex)
+			{
+				AppendMesh(text, random, meshIndex);
+			}
+
+			TextParsing::AppendLine(text, "plane 0 %.3f 0 0 1 0 m0\n", -halfSize - OBJECT_SPACING);
+
+			for (uint32_t sphere{ 0 }; sphere < settings.sphereCount; ++sphere)
+			{
+				const Vector3 center{ random.GetPoint(halfSize) };
+				const float radius{ random.Get(0.25f, 0.75f) * 0.5f * OBJECT_SPACING };
+				const uint32_t materialIndex{ random.GetIndex(materialCount) };
+				TextParsing::AppendLine(text, "sphere %.3f %.3f %.3f %.3f m%u\n", center.x, center.y, center.z, radius, materialIndex);
+			}
+
+			for (uint32_t instance{ 0 }; instance < settings.meshInstanceCount; ++instance)
+			{
+				const uint32_t meshIndex{ random.GetIndex(meshCount) };
+				const uint32_t materialIndex{ random.GetIndex(materialCount) };
+				const float scale{ random.Get(0.25f, 0.75f) * 0.5f * OBJECT_SPACING };
+				const float angle{ random.Get(0.0f, 360.0f) };
+				const Vector3 position{ random.GetPoint(halfSize) };
+
+				TextParsing::AppendLine(text, "instance mesh%u m%u scale %.3f %.3f %.3f rotate_y %.1f translate %.3f %.3f %.3f\n",
+					meshIndex, materialIndex, scale, scale, scale, angle, position.x, position.y, position.z);
+			}
+
+			//Above the cube, the total intensity does not depend on the amount of lights so the image stays about as bright
+			const float intensity{ 40.0f * halfSize * halfSize / float(lightCount) };
+			for (uint32_t light{ 0 }; light < lightCount; ++light)
+			{
+				const float x{ random.Get(-2.0f, 2.0f) * halfSize };
+				const float y{ random.Get(1.5f, 2.5f) * halfSize };
+				const float z{ random.Get(-2.0f, 1.0f) * halfSize };
+				const float lightIntensity{ intensity * random.Get(0.5f, 1.5f) };
+				const float r{ random.Get(0.7f, 1.0f) };
+				const float g{ random.Get(0.7f, 1.0f) };
+				const float b{ random.Get(0.7f, 1.0f) };
+
+				TextParsing::AppendLine(text, "point_light %.3f %.3f %.3f %.3f %.3f %.3f %.3f\n", x, y, z, lightIntensity, r, g, b);
+			}
+
+			return text;
+		}
+
+		bool Write(const std::string& filename, const Settings& settings)
+		{
+			const std::string text{ Generate(settings) };
+
+			std::ofstream file{ filename, std::ios::binary | std::ios::trunc };
+			return bool(file.write(text.data(), std::streamsize(text.size())));
+		}
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace dae
+{
+	//Procedural stress scenes for the scaling benchmarks. The same settings give the same scene on every platform.
+	//Spheres and instances of a few randomly deformed icosahedra are spread over a cube that grows with their count, so the density stays the same,
+	//and the lights are placed above it. The result is scene file text (see Scene_File), so a generated scene can be saved and loaded like any other.
+	namespace SceneGenerator
+	{
+		//Material indices are stored as unsigned char and index 0 is the default material of every Scene
+		constexpr uint32_t MAX_MATERIAL_COUNT{ 255 };
+		//Meshes the instances are spread over
+		constexpr uint32_t MESH_COUNT{ 4 };
+		constexpr uint32_t MESH_TRIANGLE_COUNT{ 20 };
+
+		struct Settings
+		{
+			uint32_t seed{ 1337 };
+			uint32_t sphereCount{ 900 };
+			uint32_t meshInstanceCount{ 100 };
+			uint32_t lightCount{ 4 };
+			//1 to MAX_MATERIAL_COUNT
+			uint32_t materialCount{ 16 };
+		};
+
+		std::string Generate(const Settings& settings);
+
+		//Returns false when the file can not be written
+		bool Write(const std::string& filename, const Settings& settings);
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+//Vector3::Normalized, the Matrix product and the Matrix transforms use SSE4.1 when the compiler targets it:
+//-msse4.1 or higher on GCC and Clang, /arch:AVX or higher on MSVC. MSVC has no SSE4.1 switch, so the ReleaseAVX2 configuration of the project builds with /arch:AVX2
+//for CPUs that have it, while Debug and Release target SSE2, keep the scalar versions and run on every x64 CPU.
+//These are inlined everywhere, too small to dispatch at runtime like the kernels in CpuFeatures.h.
+//Defining SCALAR_MATH keeps the scalar versions. Apart from Normalized, which uses rsqrt, both give exactly the same results.
+//RayTracer --microbenchmark math compares every operation with its scalar version.
+#if !defined(SCALAR_MATH) && (defined(__SSE4_1__) || defined(__AVX__))
+#define SIMD_MATH_ENABLED
+#include <smmintrin.h>
+#endif
+
+//The Matrix product computes two rows at once when AVX2 is targeted as well
+#if defined(SIMD_MATH_ENABLED) && defined(__AVX2__)
+#define SIMD_MATH_AVX2_ENABLED
+#include <immintrin.h>
+#endif
+
+#ifdef SIMD_MATH_ENABLED
+namespace dae
+{
+	namespace SimdMath
+	{
+		//Three consecutive floats in the first three lanes and 0 in the last one, only reads those 12 bytes
+		inline __m128 LoadFloat3(const float* pData)
+		{
+			const __m128 xy{ _mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pData))) };
+			return _mm_insert_ps(xy, _mm_load_ss(pData + 2), 0x20);
+		}
+
+		inline void StoreFloat3(float* pData, __m128 value)
+		{
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(pData), _mm_castps_si128(value));
+			_mm_store_ss(pData + 2, _mm_movehl_ps(value, value));
+		}
+
+		//a.x * b.x + a.y * b.y + a.z * b.z in every lane, summed in the same order as the scalar Dot
+		inline __m128 Dot3(__m128 a, __m128 b)
+		{
+			return _mm_dp_ps(a, b, 0x7F);
+		}
+
+		//1 / sqrt(value) per lane, the rsqrt estimate is refined with one Newton-Raphson step to about 22 bits
+		inline __m128 InverseSqrt(__m128 value)
+		{
+			const __m128 estimate{ _mm_rsqrt_ps(value) };
+			const __m128 halfValue{ _mm_mul_ps(_mm_set1_ps(0.5f), value) };
+			return _mm_mul_ps(estimate, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(halfValue, _mm_mul_ps(estimate, estimate))));
+		}
+
+		//Cross product of the first three lanes, the last lane is 0
+		inline __m128 Cross3(__m128 a, __m128 b)
+		{
+			const __m128 aYZX{ _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)) };
+			const __m128 aZXY{ _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2)) };
+			const __m128 bYZX{ _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1)) };
+			const __m128 bZXY{ _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2)) };
+
+			return _mm_sub_ps(_mm_mul_ps(aYZX, bZXY), _mm_mul_ps(aZXY, bYZX));
+		}
+
+		template<int lane>
+		inline __m128 Broadcast(__m128 value)
+		{
+			return _mm_shuffle_ps(value, value, _MM_SHUFFLE(lane, lane, lane, lane));
+		}
+	}
+}
+#endif
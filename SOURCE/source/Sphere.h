@@ -1,20 +1,45 @@
 #pragma once
+#include <cstdint>
+
 #include "Vector3.h"
 namespace dae
 {
 	class Sphere
 	{
 	public:
-		Sphere(Vector3 center, Vector3 color, float radius, int materialIndex);
+		Sphere(Vector3 center, float radius, int materialIndex);
 		inline Vector3 GetCenter() const { return m_Center; }
-		inline Vector3 GetColor() const { return m_Color; }
 		inline float GetRadius() const { return m_Radius; }
 		inline int GetMaterialIndex() const { return m_MaterialIndex; }
 	private:
 		Vector3 m_Center;
-		Vector3 m_Color;
 		float m_Radius;
 		int m_MaterialIndex;
 	};
 
+	//Eight spheres in structure of arrays layout, tested against one ray at once with AVX2 (or twice four with SSE).
+	//Unused lanes have a radius of 0 and can never be hit.
+	struct alignas(32) SphereBlock
+	{
+		static constexpr uint32_t laneCount{ 8 };
+
+		float centerX[laneCount]{};
+		float centerY[laneCount]{};
+		float centerZ[laneCount]{};
+		float radiusSquared[laneCount]{};
+
+		//Only needed for the normal of the nearest hit
+		float radius[laneCount]{};
+		unsigned char materialIndices[laneCount]{};
+
+		void SetLane(uint32_t lane, const Sphere& sphere)
+		{
+			centerX[lane] = sphere.GetCenter().x;
+			centerY[lane] = sphere.GetCenter().y;
+			centerZ[lane] = sphere.GetCenter().z;
+			radiusSquared[lane] = sphere.GetRadius() * sphere.GetRadius();
+			radius[lane] = sphere.GetRadius();
+			materialIndices[lane] = static_cast<unsigned char>(sphere.GetMaterialIndex());
+		}
+	};
 }
@@ -0,0 +1,191 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace dae
+{
+	//Number parsing shared by the text formats (OBJ files, scene files). Every function reads from pCurrent up to pEnd,
+	//only advances pCurrent past what it parsed when it succeeds and never needs a null terminator, so memory mapped files are parsed in place.
+	//AppendLine is the other direction, for the code that writes them.
+	namespace TextParsing
+	{
+		inline bool IsSpace(char character)
+		{
+			return character == ' ' || character == '\t';
+		}
+
+		inline bool IsDigit(char character)
+		{
+			return static_cast<unsigned char>(character - '0') < 10;
+		}
+
+		inline bool ParseInt(const char*& pCurrent, const char* pEnd, int& value)
+		{
+			const char* pNumber{ pCurrent };
+			const bool isNegative{ pNumber < pEnd && *pNumber == '-' };
+			if (pNumber < pEnd && (*pNumber == '-' || *pNumber == '+'))
+				++pNumber;
+
+			if (pNumber >= pEnd || !IsDigit(*pNumber))
+				return false;
+
+			int64_t magnitude{ 0 };
+			while (pNumber < pEnd && IsDigit(*pNumber))
+			{
+				//-2147483648 has no positive counterpart
+				magnitude = (magnitude * 10) + (*pNumber - '0');
+				if (magnitude > int64_t(INT32_MAX) + (isNegative ? 1 : 0))
+					return false;
+
+				++pNumber;
+			}
+
+			value = int(isNegative ? -magnitude : magnitude);
+			pCurrent = pNumber;
+			return true;
+		}
+
+		//Exact in float up to 1e10 and in double up to 1e22
+		inline constexpr float FLOAT_POWERS_OF_TEN[]{ 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+		inline constexpr double DOUBLE_POWERS_OF_TEN[]{ 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+		//Decimal digits, an optional fraction and exponent. Values that have at most 7 significant digits and a small exponent,
+		//which is nearly everything exporters write, are one float multiplication or division of two exact values and so correctly rounded.
+		//Longer mantissas go through double, anything else (huge exponents, inf, nan) through std::from_chars.
+		inline bool ParseFloat(const char*& pCurrent, const char* pEnd, float& value)
+		{
+			const char* pNumber{ pCurrent };
+			const bool isNegative{ pNumber < pEnd && *pNumber == '-' };
+			if (pNumber < pEnd && (*pNumber == '-' || *pNumber == '+'))
+				++pNumber;
+
+			uint64_t mantissa{ 0 };
+			int exponent{ 0 };
+			int significantDigitCount{ 0 };
+			int digitCount{ 0 };
+
+			while (pNumber < pEnd && IsDigit(*pNumber))
+			{
+				if (mantissa != 0 || *pNumber != '0')
+				{
+					if (significantDigitCount < 19)
+						mantissa = (mantissa * 10) + uint64_t(*pNumber - '0');
+					else
+						++exponent;
+
+					++significantDigitCount;
+				}
+
+				++digitCount;
+				++pNumber;
+			}
+
+			if (pNumber < pEnd && *pNumber == '.')
+			{
+				++pNumber;
+
+				while (pNumber < pEnd && IsDigit(*pNumber))
+				{
+					if (mantissa != 0 || *pNumber != '0')
+					{
+						if (significantDigitCount < 19)
+						{
+							mantissa = (mantissa * 10) + uint64_t(*pNumber - '0');
+							--exponent;
+						}
+
+						++significantDigitCount;
+					}
+					else
+						--exponent;
+
+					++digitCount;
+					++pNumber;
+				}
+			}
+
+			if (digitCount == 0)
+			{
+				//inf, nan and their variants
+				const char* pToken{ pCurrent };
+				const std::from_chars_result result{ std::from_chars(pToken + ((pToken < pEnd && *pToken == '+') ? 1 : 0), pEnd, value) };
+				if (result.ec != std::errc{})
+					return false;
+
+				pCurrent = result.ptr;
+				return true;
+			}
+
+			if (pNumber < pEnd && (*pNumber == 'e' || *pNumber == 'E'))
+			{
+				++pNumber;
+
+				int exponentValue{ 0 };
+				if (!ParseInt(pNumber, pEnd, exponentValue))
+					return false;
+
+				//Anything this large over- or underflows anyway, the clamp keeps the sum from overflowing
+				exponent += std::clamp(exponentValue, -100000, 100000);
+			}
+
+			if (mantissa == 0)
+				value = 0.0f;
+			else if (mantissa < (uint64_t(1) << 24) && exponent >= -10 && exponent <= 10)
+				value = exponent < 0 ? float(mantissa) / FLOAT_POWERS_OF_TEN[-exponent] : float(mantissa) * FLOAT_POWERS_OF_TEN[exponent];
+			else if (mantissa < (uint64_t(1) << 53) && significantDigitCount <= 19 && exponent >= -22 && exponent <= 22)
+				value = float(exponent < 0 ? double(mantissa) / DOUBLE_POWERS_OF_TEN[-exponent] : double(mantissa) * DOUBLE_POWERS_OF_TEN[exponent]);
+			else
+			{
+				//Takes the sign into account itself
+				const char* pToken{ pCurrent + ((*pCurrent == '+') ? 1 : 0) };
+				const std::from_chars_result result{ std::from_chars(pToken, pNumber, value) };
+
+				if (result.ec == std::errc::result_out_of_range)
+					value = exponent > 0 ? HUGE_VALF : 0.0f;
+				else if (result.ec != std::errc{})
+					return false;
+
+				if (result.ec == std::errc::result_out_of_range && isNegative)
+					value = -value;
+
+				pCurrent = pNumber;
+				return true;
+			}
+
+			if (isNegative)
+				value = -value;
+
+			pCurrent = pNumber;
+			return true;
+		}
+
+		//Appends the printf formatted text, lines too long for the buffer are formatted a second time straight into text
+		template<typename... Values>
+		void AppendLine(std::string& text, const char* pFormat, Values... values)
+		{
+			char line[256];
+			const int length{ std::snprintf(line, sizeof(line), pFormat, values...) };
+
+			//Only a format that does not match its values fails
+			assert(length >= 0 && "Invalid format");
+			if (length < 0)
+				return;
+
+			if (size_t(length) < sizeof(line))
+			{
+				text.append(line, size_t(length));
+				return;
+			}
+
+			const size_t start{ text.size() };
+			text.resize(start + size_t(length));
+			std::snprintf(text.data() + start, size_t(length) + 1, pFormat, values...);
+		}
+	}
+}
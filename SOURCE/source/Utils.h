@@ -1,8 +1,10 @@
 #pragma once
 #include <cassert>
-#include <fstream>
 #include <cmath>
+#include <algorithm>
+#include <immintrin.h>
 #include "Math.h"
+#include "CpuFeatures.h"
 #include "DataTypes.h"
 #include "Sphere.h"
 
@@ -12,7 +14,7 @@ namespace dae
 	{
 #pragma region Sphere HitTest
 		//SPHERE HIT-TESTS
-		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray, HitRecord& hitRecord)
 		{
 			const Vector3 rayToSphere{ sphere.GetCenter() - ray.origin };
 			const float distanceToClosestPoint{ Vector3::Dot(rayToSphere, ray.direction) };
@@ -27,18 +29,15 @@ namespace dae
 			if (pointToCenterDistanceSqrd < (sphere.GetRadius() * sphere.GetRadius()))
 			{
 				const float bSqrd{ (sphere.GetRadius() * sphere.GetRadius()) - pointToCenterDistanceSqrd };
-				const float rayToPointDistance{ distanceToClosestPoint - sqrt(bSqrd) };
+				const float rayToPointDistance{ distanceToClosestPoint - std::sqrt(bSqrd) };
 
 				if (rayToPointDistance < ray.max && rayToPointDistance > ray.min)
 				{
-					if (!ignoreHitRecord)
-					{
-						hitRecord.didHit = true;
-						hitRecord.cameraToPointDistance = rayToPointDistance;
-						hitRecord.origin = ray.origin + (rayToPointDistance * ray.direction);
-						hitRecord.materialIndex = sphere.GetMaterialIndex();
-						hitRecord.normal = (hitRecord.origin - sphere.GetCenter()) / sphere.GetRadius();
-					}
+					hitRecord.didHit = true;
+					hitRecord.cameraToPointDistance = rayToPointDistance;
+					hitRecord.origin = ray.origin + (rayToPointDistance * ray.direction);
+					hitRecord.materialIndex = sphere.GetMaterialIndex();
+					hitRecord.normal = (hitRecord.origin - sphere.GetCenter()) / sphere.GetRadius();
 					return true;
 				}
 			}
@@ -46,16 +45,172 @@ namespace dae
 			return false;
 		}
 
-		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray)
+		//The same operations as HitTest_Sphere on four lanes of a SphereBlock, returns the hit mask and writes the distance of every lane
+		inline int HitTest_SphereLanes_SSE(const SphereBlock& block, uint32_t firstLane, const Ray& ray, float* pDistances)
+		{
+			const __m128 originX{ _mm_set1_ps(ray.origin.x) };
+			const __m128 originY{ _mm_set1_ps(ray.origin.y) };
+			const __m128 originZ{ _mm_set1_ps(ray.origin.z) };
+			const __m128 directionX{ _mm_set1_ps(ray.direction.x) };
+			const __m128 directionY{ _mm_set1_ps(ray.direction.y) };
+			const __m128 directionZ{ _mm_set1_ps(ray.direction.z) };
+
+			const __m128 centerX{ _mm_load_ps(block.centerX + firstLane) };
+			const __m128 centerY{ _mm_load_ps(block.centerY + firstLane) };
+			const __m128 centerZ{ _mm_load_ps(block.centerZ + firstLane) };
+			const __m128 radiusSquared{ _mm_load_ps(block.radiusSquared + firstLane) };
+
+			const __m128 distanceToClosestPoint{ _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_sub_ps(centerX, originX), directionX),
+				_mm_mul_ps(_mm_sub_ps(centerY, originY), directionY)),
+				_mm_mul_ps(_mm_sub_ps(centerZ, originZ), directionZ)) };
+
+			const __m128 closestToCenterX{ _mm_sub_ps(_mm_add_ps(originX, _mm_mul_ps(directionX, distanceToClosestPoint)), centerX) };
+			const __m128 closestToCenterY{ _mm_sub_ps(_mm_add_ps(originY, _mm_mul_ps(directionY, distanceToClosestPoint)), centerY) };
+			const __m128 closestToCenterZ{ _mm_sub_ps(_mm_add_ps(originZ, _mm_mul_ps(directionZ, distanceToClosestPoint)), centerZ) };
+
+			const __m128 pointToCenterDistanceSqrd{ _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(closestToCenterX, closestToCenterX),
+				_mm_mul_ps(closestToCenterY, closestToCenterY)),
+				_mm_mul_ps(closestToCenterZ, closestToCenterZ)) };
+
+			//Lanes that miss take the square root of a negative number, they are masked out anyway
+			const __m128 distance{ _mm_sub_ps(distanceToClosestPoint, _mm_sqrt_ps(_mm_sub_ps(radiusSquared, pointToCenterDistanceSqrd))) };
+
+			__m128 mask{ _mm_cmpge_ps(distanceToClosestPoint, _mm_setzero_ps()) };
+			mask = _mm_and_ps(mask, _mm_cmplt_ps(pointToCenterDistanceSqrd, radiusSquared));
+			mask = _mm_and_ps(mask, _mm_cmplt_ps(distance, _mm_set1_ps(ray.max)));
+			mask = _mm_and_ps(mask, _mm_cmpgt_ps(distance, _mm_set1_ps(ray.min)));
+
+			_mm_storeu_ps(pDistances, distance);
+			return _mm_movemask_ps(mask);
+		}
+
+		//All eight lanes of a SphereBlock at once, only call this when the CPU supports AVX2
+		TARGET_AVX2 inline int HitTest_SphereLanes_AVX2(const SphereBlock& block, const Ray& ray, float* pDistances)
+		{
+			const __m256 originX{ _mm256_set1_ps(ray.origin.x) };
+			const __m256 originY{ _mm256_set1_ps(ray.origin.y) };
+			const __m256 originZ{ _mm256_set1_ps(ray.origin.z) };
+			const __m256 directionX{ _mm256_set1_ps(ray.direction.x) };
+			const __m256 directionY{ _mm256_set1_ps(ray.direction.y) };
+			const __m256 directionZ{ _mm256_set1_ps(ray.direction.z) };
+
+			const __m256 centerX{ _mm256_load_ps(block.centerX) };
+			const __m256 centerY{ _mm256_load_ps(block.centerY) };
+			const __m256 centerZ{ _mm256_load_ps(block.centerZ) };
+			const __m256 radiusSquared{ _mm256_load_ps(block.radiusSquared) };
+
+			//No FMA on purpose, the results have to match the scalar and SSE versions exactly
+			const __m256 distanceToClosestPoint{ _mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(_mm256_sub_ps(centerX, originX), directionX),
+				_mm256_mul_ps(_mm256_sub_ps(centerY, originY), directionY)),
+				_mm256_mul_ps(_mm256_sub_ps(centerZ, originZ), directionZ)) };
+
+			const __m256 closestToCenterX{ _mm256_sub_ps(_mm256_add_ps(originX, _mm256_mul_ps(directionX, distanceToClosestPoint)), centerX) };
+			const __m256 closestToCenterY{ _mm256_sub_ps(_mm256_add_ps(originY, _mm256_mul_ps(directionY, distanceToClosestPoint)), centerY) };
+			const __m256 closestToCenterZ{ _mm256_sub_ps(_mm256_add_ps(originZ, _mm256_mul_ps(directionZ, distanceToClosestPoint)), centerZ) };
+
+			const __m256 pointToCenterDistanceSqrd{ _mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(closestToCenterX, closestToCenterX),
+				_mm256_mul_ps(closestToCenterY, closestToCenterY)),
+				_mm256_mul_ps(closestToCenterZ, closestToCenterZ)) };
+
+			const __m256 distance{ _mm256_sub_ps(distanceToClosestPoint, _mm256_sqrt_ps(_mm256_sub_ps(radiusSquared, pointToCenterDistanceSqrd))) };
+
+			__m256 mask{ _mm256_cmp_ps(distanceToClosestPoint, _mm256_setzero_ps(), _CMP_GE_OQ) };
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(pointToCenterDistanceSqrd, radiusSquared, _CMP_LT_OQ));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(distance, _mm256_set1_ps(ray.max), _CMP_LT_OQ));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(distance, _mm256_set1_ps(ray.min), _CMP_GT_OQ));
+
+			_mm256_storeu_ps(pDistances, distance);
+			return _mm256_movemask_ps(mask);
+		}
+
+		//Nearest hit over all lanes of a SphereBlock, ties go to the lowest lane
+		inline bool HitTest_SphereBlock(const SphereBlock& block, const Ray& ray, HitRecord& hitRecord, bool useAVX2)
+		{
+			float distances[SphereBlock::laneCount];
+			int hitMask{ 0 };
+
+			if (useAVX2)
+			{
+				hitMask = HitTest_SphereLanes_AVX2(block, ray, distances);
+			}
+			else
+			{
+				hitMask = HitTest_SphereLanes_SSE(block, 0, ray, distances);
+				hitMask |= HitTest_SphereLanes_SSE(block, 4, ray, distances + 4) << 4;
+			}
+
+			if (hitMask == 0)
+				return false;
+
+			uint32_t nearestLane{ SphereBlock::laneCount };
+			for (uint32_t lane{ 0 }; lane < SphereBlock::laneCount; ++lane)
+			{
+				if ((hitMask & (1 << lane)) && (nearestLane == SphereBlock::laneCount || distances[lane] < distances[nearestLane]))
+					nearestLane = lane;
+			}
+
+			const float distance{ distances[nearestLane] };
+			const Vector3 center{ block.centerX[nearestLane], block.centerY[nearestLane], block.centerZ[nearestLane] };
+
+			hitRecord.didHit = true;
+			hitRecord.cameraToPointDistance = distance;
+			hitRecord.origin = ray.origin + (distance * ray.direction);
+			hitRecord.materialIndex = block.materialIndices[nearestLane];
+			hitRecord.normal = (hitRecord.origin - center) / block.radius[nearestLane];
+			return true;
+		}
+
+		//Uses AVX2 when the CPU has it and SSE otherwise
+		inline bool HitTest_SphereBlock(const SphereBlock& block, const Ray& ray, HitRecord& hitRecord)
+		{
+			return HitTest_SphereBlock(block, ray, hitRecord, CpuFeatures::HasAVX2());
+		}
+
+		//ANY-HIT TESTS
+		//The DoesHit family only answers whether anything lies between ray.min and ray.max (shadow rays).
+		//It never writes a HitRecord and returns on the first hit it finds.
+		inline bool DoesHit_Sphere(const Sphere& sphere, const Ray& ray)
+		{
+			const Vector3 rayToSphere{ sphere.GetCenter() - ray.origin };
+			const float distanceToClosestPoint{ Vector3::Dot(rayToSphere, ray.direction) };
+			if (distanceToClosestPoint < 0.0f)
+				return false;
+
+			const Vector3 closestPointOnRay{ (ray.origin + (ray.direction * distanceToClosestPoint)) };
+			const float pointToCenterDistanceSqrd{ (closestPointOnRay - sphere.GetCenter()).SqrMagnitude() };
+			const float radiusSquared{ sphere.GetRadius() * sphere.GetRadius() };
+
+			if (pointToCenterDistanceSqrd >= radiusSquared)
+				return false;
+
+			const float rayToPointDistance{ distanceToClosestPoint - std::sqrt(radiusSquared - pointToCenterDistanceSqrd) };
+			return rayToPointDistance < ray.max && rayToPointDistance > ray.min;
+		}
+
+		inline bool DoesHit_SphereBlock(const SphereBlock& block, const Ray& ray, bool useAVX2)
 		{
-			HitRecord temp{};
-			return HitTest_Sphere(sphere, ray, temp, true);
+			float distances[SphereBlock::laneCount];
+
+			if (useAVX2)
+				return HitTest_SphereLanes_AVX2(block, ray, distances) != 0;
+
+			//The second half is only needed when the first one misses
+			return HitTest_SphereLanes_SSE(block, 0, ray, distances) != 0 || HitTest_SphereLanes_SSE(block, 4, ray, distances + 4) != 0;
+		}
+
+		inline bool DoesHit_SphereBlock(const SphereBlock& block, const Ray& ray)
+		{
+			return DoesHit_SphereBlock(block, ray, CpuFeatures::HasAVX2());
 		}
 #pragma endregion
 
 #pragma region Plane HitTest
 		//PLANE HIT-TESTS
-		inline bool HitTest_Plane(const Plane& plane, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		inline bool HitTest_Plane(const Plane& plane, const Ray& ray, HitRecord& hitRecord)
 		{
 			const Vector3 planeToRayOrigin{ ray.origin - plane.origin };
 			const float distanceFromPlaneToRay{ Vector3::Dot(planeToRayOrigin, plane.normal) }; //perpendicular to plane
@@ -67,215 +222,984 @@ namespace dae
 
 				if (rayToPointDistance < ray.max && rayToPointDistance > ray.min)
 				{
-					if (!ignoreHitRecord)
-					{
-						hitRecord.didHit = true;
-						hitRecord.cameraToPointDistance = rayToPointDistance;
-						hitRecord.origin = ray.origin + (rayToPointDistance * ray.direction);
-						hitRecord.materialIndex = plane.materialIndex;
-						hitRecord.normal = plane.normal;
-					}
+					hitRecord.didHit = true;
+					hitRecord.cameraToPointDistance = rayToPointDistance;
+					hitRecord.origin = ray.origin + (rayToPointDistance * ray.direction);
+					hitRecord.materialIndex = plane.materialIndex;
+					hitRecord.normal = plane.normal;
 					return true;
 				}
 			}
 			return false;
 		}
 
-		inline bool HitTest_Plane(const Plane& plane, const Ray& ray)
+		inline bool DoesHit_Plane(const Plane& plane, const Ray& ray)
 		{
-			HitRecord temp{};
-			return HitTest_Plane(plane, ray, temp, true);
+			const float rayDotNegNormal{ Vector3::Dot(ray.direction, -plane.normal) };
+			if (!(rayDotNegNormal > 0.0f))
+				return false;
+
+			const float rayToPointDistance{ Vector3::Dot(ray.origin - plane.origin, plane.normal) / rayDotNegNormal };
+			return rayToPointDistance < ray.max && rayToPointDistance > ray.min;
 		}
 #pragma endregion
 #pragma region Triangle HitTest
 		//TRIANGLE HIT-TESTS
-		inline bool IsPointInTriangleEdge(const Vector3& vertex1, const Vector3& vertex2, const Vector3& point, const Vector3& normal)
+		//Moller-Trumbore, solves for the distance and the barycentric coordinates at once using the precomputed edges
+		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord)
+		{
+			const Vector3 directionCrossEdge{ Vector3::Cross(ray.direction, triangle.edgeV0V2) };
+
+			//The determinant is positive when the ray hits the front face (against the normal), zero when it is parallel
+			const float determinant{ Vector3::Dot(triangle.edgeV0V1, directionCrossEdge) };
+
+			if ((triangle.cullMode == TriangleCullMode::BackFaceCulling && determinant <= 0.0f) ||
+				(triangle.cullMode == TriangleCullMode::FrontFaceCulling && determinant >= 0.0f) ||
+				determinant == 0.0f)
+				return false;
+
+			const float inverseDeterminant{ 1.0f / determinant };
+			const Vector3 v0ToOrigin{ ray.origin - triangle.v0 };
+
+			const float u{ Vector3::Dot(v0ToOrigin, directionCrossEdge) * inverseDeterminant };
+			if (u < 0.0f || u > 1.0f)
+				return false;
+
+			const Vector3 originCrossEdge{ Vector3::Cross(v0ToOrigin, triangle.edgeV0V1) };
+
+			const float v{ Vector3::Dot(ray.direction, originCrossEdge) * inverseDeterminant };
+			if (v < 0.0f || u + v > 1.0f)
+				return false;
+
+			const float cameraToPointDistance{ Vector3::Dot(triangle.edgeV0V2, originCrossEdge) * inverseDeterminant };
+			if (cameraToPointDistance <= ray.min || cameraToPointDistance >= ray.max)
+				return false;
+
+			hitRecord.didHit = true;
+			hitRecord.cameraToPointDistance = cameraToPointDistance;
+			hitRecord.origin = ray.origin + (ray.direction * cameraToPointDistance);
+			hitRecord.materialIndex = triangle.materialIndex;
+			hitRecord.normal = triangle.normal;
+			hitRecord.u = u;
+			hitRecord.v = v;
+			return true;
+		}
+
+		//Moller-Trumbore on all lanes of a TriangleBlock at once, the operations are the same as in HitTest_Triangle so both give identical results.
+		//The whole block shares one cull mode. Returns the hit mask, the distances and barycentric coordinates are only meaningful for the lanes in it.
+		inline int HitTest_TriangleLanes(const TriangleBlock& block, TriangleCullMode cullMode, const Ray& ray, __m128& distance, __m128& u, __m128& v)
+		{
+			const __m128 zero{ _mm_setzero_ps() };
+			const __m128 one{ _mm_set1_ps(1.0f) };
+
+			const __m128 directionX{ _mm_set1_ps(ray.direction.x) };
+			const __m128 directionY{ _mm_set1_ps(ray.direction.y) };
+			const __m128 directionZ{ _mm_set1_ps(ray.direction.z) };
+
+			const __m128 edgeV0V1X{ _mm_load_ps(block.edgeV0V1X) };
+			const __m128 edgeV0V1Y{ _mm_load_ps(block.edgeV0V1Y) };
+			const __m128 edgeV0V1Z{ _mm_load_ps(block.edgeV0V1Z) };
+			const __m128 edgeV0V2X{ _mm_load_ps(block.edgeV0V2X) };
+			const __m128 edgeV0V2Y{ _mm_load_ps(block.edgeV0V2Y) };
+			const __m128 edgeV0V2Z{ _mm_load_ps(block.edgeV0V2Z) };
+
+			//directionCrossEdge = Cross(direction, edgeV0V2)
+			const __m128 crossX{ _mm_sub_ps(_mm_mul_ps(directionY, edgeV0V2Z), _mm_mul_ps(directionZ, edgeV0V2Y)) };
+			const __m128 crossY{ _mm_sub_ps(_mm_mul_ps(directionZ, edgeV0V2X), _mm_mul_ps(directionX, edgeV0V2Z)) };
+			const __m128 crossZ{ _mm_sub_ps(_mm_mul_ps(directionX, edgeV0V2Y), _mm_mul_ps(directionY, edgeV0V2X)) };
+
+			const __m128 determinant{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(edgeV0V1X, crossX), _mm_mul_ps(edgeV0V1Y, crossY)), _mm_mul_ps(edgeV0V1Z, crossZ)) };
+
+			__m128 mask{};
+			switch (cullMode)
+			{
+			case TriangleCullMode::BackFaceCulling:
+				mask = _mm_cmpgt_ps(determinant, zero);
+				break;
+			case TriangleCullMode::FrontFaceCulling:
+				mask = _mm_cmplt_ps(determinant, zero);
+				break;
+			default:
+				mask = _mm_cmpneq_ps(determinant, zero);
+				break;
+			}
+
+			if (_mm_movemask_ps(mask) == 0)
+				return 0;
+
+			const __m128 inverseDeterminant{ _mm_div_ps(one, determinant) };
+
+			const __m128 v0ToOriginX{ _mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_load_ps(block.v0X)) };
+			const __m128 v0ToOriginY{ _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_load_ps(block.v0Y)) };
+			const __m128 v0ToOriginZ{ _mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_load_ps(block.v0Z)) };
+
+			u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(v0ToOriginX, crossX), _mm_mul_ps(v0ToOriginY, crossY)), _mm_mul_ps(v0ToOriginZ, crossZ)), inverseDeterminant);
+			mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+
+			//originCrossEdge = Cross(v0ToOrigin, edgeV0V1)
+			const __m128 originCrossX{ _mm_sub_ps(_mm_mul_ps(v0ToOriginY, edgeV0V1Z), _mm_mul_ps(v0ToOriginZ, edgeV0V1Y)) };
+			const __m128 originCrossY{ _mm_sub_ps(_mm_mul_ps(v0ToOriginZ, edgeV0V1X), _mm_mul_ps(v0ToOriginX, edgeV0V1Z)) };
+			const __m128 originCrossZ{ _mm_sub_ps(_mm_mul_ps(v0ToOriginX, edgeV0V1Y), _mm_mul_ps(v0ToOriginY, edgeV0V1X)) };
+
+			v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(directionX, originCrossX), _mm_mul_ps(directionY, originCrossY)), _mm_mul_ps(directionZ, originCrossZ)), inverseDeterminant);
+			mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+
+			distance = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edgeV0V2X, originCrossX), _mm_mul_ps(edgeV0V2Y, originCrossY)), _mm_mul_ps(edgeV0V2Z, originCrossZ)), inverseDeterminant);
+			mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpgt_ps(distance, _mm_set1_ps(ray.min)), _mm_cmplt_ps(distance, _mm_set1_ps(ray.max))));
+
+			return _mm_movemask_ps(mask);
+		}
+
+		//Nearest hit over all lanes of a TriangleBlock, ties go to the lowest lane
+		inline bool HitTest_TriangleBlock(const TriangleBlock& block, TriangleCullMode cullMode, const Ray& ray, HitRecord& hitRecord)
 		{
-			const Vector3 edge{ vertex2 - vertex1 };
-			const Vector3 vertexToPoint{ point - vertex1 };
+			__m128 distance{};
+			__m128 u{};
+			__m128 v{};
+
+			const int hitMask{ HitTest_TriangleLanes(block, cullMode, ray, distance, u, v) };
+			if (hitMask == 0)
+				return false;
 
-			return Vector3::Dot(Vector3::Cross(edge, vertexToPoint), normal) >= 0.0f;
+			alignas(16) float distances[TriangleBlock::laneCount];
+			_mm_store_ps(distances, distance);
+
+			uint32_t nearestLane{ TriangleBlock::laneCount };
+			for (uint32_t lane{ 0 }; lane < TriangleBlock::laneCount; ++lane)
+			{
+				if ((hitMask & (1 << lane)) && (nearestLane == TriangleBlock::laneCount || distances[lane] < distances[nearestLane]))
+					nearestLane = lane;
+			}
+
+			alignas(16) float us[TriangleBlock::laneCount];
+			alignas(16) float vs[TriangleBlock::laneCount];
+			_mm_store_ps(us, u);
+			_mm_store_ps(vs, v);
+
+			hitRecord.didHit = true;
+			hitRecord.cameraToPointDistance = distances[nearestLane];
+			hitRecord.origin = ray.origin + (ray.direction * distances[nearestLane]);
+			hitRecord.normal = { block.normalX[nearestLane], block.normalY[nearestLane], block.normalZ[nearestLane] };
+			hitRecord.u = us[nearestLane];
+			hitRecord.v = vs[nearestLane];
+			return true;
 		}
 
-		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		inline bool DoesHit_Triangle(const Triangle& triangle, const Ray& ray)
 		{
-			const float rayDotNormal{ Vector3::Dot(ray.direction, triangle.normal) };
+			const Vector3 directionCrossEdge{ Vector3::Cross(ray.direction, triangle.edgeV0V2) };
+			const float determinant{ Vector3::Dot(triangle.edgeV0V1, directionCrossEdge) };
 
-			if  (AreEqual(rayDotNormal, 0.0f) ||
-				(triangle.cullMode == TriangleCullMode::BackFaceCulling && rayDotNormal > 0.0f) ||
-				(triangle.cullMode == TriangleCullMode::FrontFaceCulling && rayDotNormal < 0.0f))
+			if ((triangle.cullMode == TriangleCullMode::BackFaceCulling && determinant <= 0.0f) ||
+				(triangle.cullMode == TriangleCullMode::FrontFaceCulling && determinant >= 0.0f) ||
+				determinant == 0.0f)
 				return false;
 
-			const Vector3 rayToTriangle{ triangle.v0 - ray.origin };
-			const float cameraToPointDistance = Vector3::Dot(rayToTriangle, triangle.normal) / rayDotNormal;
+			const float inverseDeterminant{ 1.0f / determinant };
+			const Vector3 v0ToOrigin{ ray.origin - triangle.v0 };
 
-			if (cameraToPointDistance <= ray.min || cameraToPointDistance >= ray.max)
+			const float u{ Vector3::Dot(v0ToOrigin, directionCrossEdge) * inverseDeterminant };
+			if (u < 0.0f || u > 1.0f)
+				return false;
+
+			const Vector3 originCrossEdge{ Vector3::Cross(v0ToOrigin, triangle.edgeV0V1) };
+
+			const float v{ Vector3::Dot(ray.direction, originCrossEdge) * inverseDeterminant };
+			if (v < 0.0f || u + v > 1.0f)
 				return false;
 
-			const Vector3 hitPoint{ ray.origin + (ray.direction * cameraToPointDistance) };
+			const float cameraToPointDistance{ Vector3::Dot(triangle.edgeV0V2, originCrossEdge) * inverseDeterminant };
+			return cameraToPointDistance > ray.min && cameraToPointDistance < ray.max;
+		}
+
+		inline bool DoesHit_TriangleBlock(const TriangleBlock& block, TriangleCullMode cullMode, const Ray& ray)
+		{
+			__m128 distance{};
+			__m128 u{};
+			__m128 v{};
+
+			return HitTest_TriangleLanes(block, cullMode, ray, distance, u, v) != 0;
+		}
+#pragma endregion
+#pragma region BVH HitTest
+		//AABB HIT-TEST
+		//Returns the distance at which the ray enters the bounds, FLT_MAX if it misses them
+		inline float HitTest_AABB(const AABB& bounds, const Ray& ray, const Vector3& inverseDirection)
+		{
+			const float tx1{ (bounds.min.x - ray.origin.x) * inverseDirection.x };
+			const float tx2{ (bounds.max.x - ray.origin.x) * inverseDirection.x };
+			const float ty1{ (bounds.min.y - ray.origin.y) * inverseDirection.y };
+			const float ty2{ (bounds.max.y - ray.origin.y) * inverseDirection.y };
+			const float tz1{ (bounds.min.z - ray.origin.z) * inverseDirection.z };
+			const float tz2{ (bounds.max.z - ray.origin.z) * inverseDirection.z };
+
+			const float tMin{ std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::min(tz1, tz2)) };
+			const float tMax{ std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::max(tz1, tz2)) };
 
-			if (IsPointInTriangleEdge(triangle.v0, triangle.v1, hitPoint, triangle.normal) &&
-				IsPointInTriangleEdge(triangle.v1, triangle.v2, hitPoint, triangle.normal) &&
-				IsPointInTriangleEdge(triangle.v2, triangle.v0, hitPoint, triangle.normal))
+			if (tMax >= tMin && tMin < ray.max && tMax > ray.min)
+				return tMin;
+
+			return FLT_MAX;
+		}
+
+		/**
+		 * \brief Walks the BVH front to back and calls leafHitTest for every leaf the ray reaches
+		 * \param bvh hierarchy to traverse
+		 * \param ray ray to test, leafHitTest is expected to shorten ray.max when it finds a closer hit
+		 * \param leafHitTest callable bool(uint32_t nodeIndex, const BVHNode& leaf, Ray& ray)
+		 * \return whether any leaf reported a hit
+		 */
+		template<typename LeafHitTest>
+		inline bool HitTest_BVHLeaves(const BVH& bvh, Ray& ray, LeafHitTest&& leafHitTest)
+		{
+			if (bvh.IsEmpty())
+				return false;
+
+			const std::vector<BVHNode>& nodes{ bvh.GetNodes() };
+			const Vector3 inverseDirection{ 1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z };
+
+			struct StackEntry
+			{
+				uint32_t nodeIndex;
+				float distance;
+			};
+
+			//Bounded by the build depth limit, see BVH::TRAVERSAL_STACK_SIZE
+			StackEntry stack[BVH::TRAVERSAL_STACK_SIZE];
+			uint32_t stackSize{ 0 };
+
+			const float rootDistance{ HitTest_AABB(nodes[0].bounds, ray, inverseDirection) };
+			if (rootDistance == FLT_MAX)
+				return false;
+
+			stack[stackSize++] = { 0, rootDistance };
+			bool didHit{ false };
+
+			while (stackSize > 0)
 			{
-				if (!ignoreHitRecord)
+				const StackEntry entry{ stack[--stackSize] };
+
+				//A closer hit may have been found since this node was pushed
+				if (entry.distance >= ray.max)
+					continue;
+
+				const BVHNode& node{ nodes[entry.nodeIndex] };
+
+				if (node.IsLeaf())
 				{
-					hitRecord.didHit = true;
-					hitRecord.cameraToPointDistance = cameraToPointDistance;
-					hitRecord.origin = hitPoint;
-					hitRecord.materialIndex = triangle.materialIndex;
-					hitRecord.normal = triangle.normal;
+					didHit |= leafHitTest(entry.nodeIndex, node, ray);
+					continue;
 				}
-				return true;
+
+				StackEntry nearChild{ node.leftFirst, HitTest_AABB(nodes[node.leftFirst].bounds, ray, inverseDirection) };
+				StackEntry farChild{ node.leftFirst + 1, HitTest_AABB(nodes[node.leftFirst + 1].bounds, ray, inverseDirection) };
+
+				if (nearChild.distance > farChild.distance)
+					std::swap(nearChild, farChild);
+
+				//Push the far child first so the near one is visited next
+				assert(stackSize + 2 <= BVH::TRAVERSAL_STACK_SIZE);
+
+				if (farChild.distance != FLT_MAX)
+					stack[stackSize++] = farChild;
+
+				if (nearChild.distance != FLT_MAX)
+					stack[stackSize++] = nearChild;
 			}
 
-			return false;
+			return didHit;
 		}
 
-		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray)
+		/**
+		 * \brief Walks the BVH front to back and calls hitTest for every primitive in the leaves the ray reaches
+		 * \param hitTest callable bool(uint32_t primitiveIndex, Ray& ray), expected to shorten ray.max when it finds a closer hit
+		 * \return whether any primitive reported a hit
+		 */
+		template<typename PrimitiveHitTest>
+		inline bool HitTest_BVH(const BVH& bvh, Ray& ray, PrimitiveHitTest&& hitTest)
 		{
-			HitRecord temp{};
-			return HitTest_Triangle(triangle, ray, temp, true);
+			const std::vector<uint32_t>& primitiveIndices{ bvh.GetPrimitiveIndices() };
+
+			return HitTest_BVHLeaves(bvh, ray,
+				[&](uint32_t, const BVHNode& leaf, Ray& currentRay)
+				{
+					bool didHit{ false };
+
+					for (uint32_t i{ 0 }; i < leaf.primitiveCount; ++i)
+					{
+						didHit |= hitTest(primitiveIndices[leaf.leftFirst + i], currentRay);
+					}
+
+					return didHit;
+				});
 		}
-#pragma endregion
-#pragma region TriangeMesh HitTest
-		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+
+		/**
+		 * \brief Any-hit traversal for shadow rays, returns as soon as leafHitTest reports a hit.
+		 * Any occluder will do, so the children are not sorted and no distances are kept.
+		 * \param leafHitTest callable bool(uint32_t nodeIndex, const BVHNode& leaf, const Ray& ray)
+		 */
+		template<typename LeafHitTest>
+		inline bool DoesHit_BVHLeaves(const BVH& bvh, const Ray& ray, LeafHitTest&& leafHitTest)
 		{
-			float nearestTriangle{ FLT_MAX };
+			if (bvh.IsEmpty())
+				return false;
+
+			const std::vector<BVHNode>& nodes{ bvh.GetNodes() };
+			const Vector3 inverseDirection{ 1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z };
+
+			if (HitTest_AABB(nodes[0].bounds, ray, inverseDirection) == FLT_MAX)
+				return false;
+
+			//Bounded by the build depth limit, see BVH::TRAVERSAL_STACK_SIZE
+			uint32_t stack[BVH::TRAVERSAL_STACK_SIZE];
+			uint32_t stackSize{ 0 };
 
-			for (const auto& triangle : mesh.triangles)
+			stack[stackSize++] = 0;
+
+			while (stackSize > 0)
 			{
-				HitRecord currentHitRecord;
-				if (HitTest_Triangle(triangle, ray, currentHitRecord, ignoreHitRecord))
+				const uint32_t nodeIndex{ stack[--stackSize] };
+				const BVHNode& node{ nodes[nodeIndex] };
+
+				if (node.IsLeaf())
 				{
-					if (ignoreHitRecord)
+					if (leafHitTest(nodeIndex, node, ray))
 						return true;
 
-					if (currentHitRecord.cameraToPointDistance < nearestTriangle)
-					{
-						nearestTriangle = currentHitRecord.cameraToPointDistance;
-						hitRecord = currentHitRecord;
-					}
+					continue;
+				}
+
+				assert(stackSize + 2 <= BVH::TRAVERSAL_STACK_SIZE);
+
+				for (uint32_t child{ node.leftFirst }; child < node.leftFirst + 2; ++child)
+				{
+					if (HitTest_AABB(nodes[child].bounds, ray, inverseDirection) != FLT_MAX)
+						stack[stackSize++] = child;
 				}
 			}
 
-			return !ignoreHitRecord && hitRecord.didHit;
+			return false;
 		}
 
-		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
+		/**
+		 * \brief Any-hit version of HitTest_BVH
+		 * \param hitTest callable bool(uint32_t primitiveIndex, const Ray& ray)
+		 */
+		template<typename PrimitiveHitTest>
+		inline bool DoesHit_BVH(const BVH& bvh, const Ray& ray, PrimitiveHitTest&& hitTest)
 		{
-			HitRecord temp{};
-			return HitTest_TriangleMesh(mesh, ray, temp, true);
+			const std::vector<uint32_t>& primitiveIndices{ bvh.GetPrimitiveIndices() };
+
+			return DoesHit_BVHLeaves(bvh, ray,
+				[&](uint32_t, const BVHNode& leaf, const Ray& currentRay)
+				{
+					for (uint32_t i{ 0 }; i < leaf.primitiveCount; ++i)
+					{
+						if (hitTest(primitiveIndices[leaf.leftFirst + i], currentRay))
+							return true;
+					}
+
+					return false;
+				});
 		}
 #pragma endregion
-	}
-
-	namespace LightUtils
-	{
-		//Direction from target to light
-		inline Vector3 GetDirectionToLight(const Light& light, const Vector3 origin)
+#pragma region TriangeMesh HitTest
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord)
 		{
-			return (origin - light.origin).Normalized();
+			Ray meshRay{ ray };
+
+			const bool didHit{ HitTest_BVHLeaves(mesh.bvh, meshRay,
+				[&](uint32_t nodeIndex, const BVHNode& leaf, Ray& currentRay)
+				{
+					const uint32_t firstBlock{ mesh.leafFirstBlocks[nodeIndex] };
+					const uint32_t blockCount{ (leaf.primitiveCount + TriangleBlock::laneCount - 1) / TriangleBlock::laneCount };
+					bool didHitLeaf{ false };
+
+					for (uint32_t block{ firstBlock }; block < firstBlock + blockCount; ++block)
+					{
+						if (!HitTest_TriangleBlock(mesh.triangleBlocks[block], mesh.cullMode, currentRay, hitRecord))
+							continue;
+
+						currentRay.max = hitRecord.cameraToPointDistance;
+						didHitLeaf = true;
+					}
+
+					return didHitLeaf;
+				}) };
+
+			return didHit;
 		}
 
-		inline ColorRGB GetRadiance(const Light& light, const Vector3& target)
+		//Also returns the triangle block the occluder is in
+		inline bool DoesHit_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, uint32_t& occludingBlock)
 		{
-			switch (light.type)
-			{
-			case LightType::Directional:
-				return light.color * light.intensity;
-			case LightType::Point:
-				return light.color * (light.intensity / ((light.origin - target).SqrMagnitude()));
-			}
+			return DoesHit_BVHLeaves(mesh.bvh, ray,
+				[&](uint32_t nodeIndex, const BVHNode& leaf, const Ray& currentRay)
+				{
+					const uint32_t firstBlock{ mesh.leafFirstBlocks[nodeIndex] };
+					const uint32_t blockCount{ (leaf.primitiveCount + TriangleBlock::laneCount - 1) / TriangleBlock::laneCount };
 
-			return ColorRGB(0.0f, 0.0f, 0.0f);
+					for (uint32_t block{ firstBlock }; block < firstBlock + blockCount; ++block)
+					{
+						if (DoesHit_TriangleBlock(mesh.triangleBlocks[block], mesh.cullMode, currentRay))
+						{
+							occludingBlock = block;
+							return true;
+						}
+					}
+
+					return false;
+				});
 		}
 
-		inline float GetObservedArea(const Light& light, const HitRecord& hitRecord)
+		inline bool DoesHit_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
 		{
-			const Vector3 direction{ GetDirectionToLight(light, hitRecord.origin) };
-			const float dot{ -Vector3::Dot(direction, hitRecord.normal) };
-			return std::fmax(dot, 0.0f);
+			uint32_t occludingBlock{};
+			return DoesHit_TriangleMesh(mesh, ray, occludingBlock);
+		}
+#pragma endregion
+#pragma region MeshInstance HitTest
+		inline Ray GetObjectRay(const MeshInstance& instance, const Ray& ray)
+		{
+			//The direction is not normalized again, so distances along the object space ray are the same as in world space
+			return Ray{
+				instance.inverseTransform.TransformPoint(ray.origin),
+				instance.inverseTransform.TransformVector(ray.direction),
+				ray.min,
+				ray.max };
 		}
-	}
 
-	namespace Utils
-	{
-		//Just parses vertices and indices
-#pragma warning(push)
-#pragma warning(disable : 4505) //Warning unreferenced local function
-		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices)
+		inline bool HitTest_MeshInstance(const MeshInstance& instance, const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord)
 		{
-			std::ifstream file(filename);
-			if (!file)
+			const Ray objectRay{ GetObjectRay(instance, ray) };
+
+			HitRecord objectHitRecord{};
+			if (!HitTest_TriangleMesh(mesh, objectRay, objectHitRecord))
 				return false;
 
-			std::string sCommand;
-			// start a while iteration ending when the end of file is reached (ios::eof)
-			while (!file.eof())
+			//Normals are transformed by the inverse transpose to stay perpendicular under non-uniform scaling
+			const Matrix& inverse{ instance.inverseTransform };
+			const Vector3& objectNormal{ objectHitRecord.normal };
+
+			hitRecord = objectHitRecord;
+			hitRecord.origin = ray.origin + (ray.direction * objectHitRecord.cameraToPointDistance);
+			hitRecord.normal = Vector3{
+				Vector3::Dot(inverse.GetAxisX(), objectNormal),
+				Vector3::Dot(inverse.GetAxisY(), objectNormal),
+				Vector3::Dot(inverse.GetAxisZ(), objectNormal) }.Normalized();
+			hitRecord.materialIndex = instance.materialIndex;
+			return true;
+		}
+
+		//Also returns the triangle block of the mesh the occluder is in
+		inline bool DoesHit_MeshInstance(const MeshInstance& instance, const TriangleMesh& mesh, const Ray& ray, uint32_t& occludingBlock)
+		{
+			return DoesHit_TriangleMesh(mesh, GetObjectRay(instance, ray), occludingBlock);
+		}
+
+		inline bool DoesHit_MeshInstance(const MeshInstance& instance, const TriangleMesh& mesh, const Ray& ray)
+		{
+			return DoesHit_TriangleMesh(mesh, GetObjectRay(instance, ray));
+		}
+#pragma endregion
+#pragma region RayPacket HitTest
+		//RAY PACKET HIT-TESTS
+		//One primitive against four rays of the packet at a time, with the same operations per ray as the single ray hit tests so both give identical hits.
+		//They shorten the max of every ray they hit, write its hit record and return the mask of those rays.
+		inline bool HasActiveRays(const RayPacket& packet, uint32_t firstRay)
+		{
+			return ((packet.activeMask >> firstRay) & ((1u << RayPacket::laneCount) - 1)) != 0;
+		}
+
+		inline uint32_t HitTest_Plane(const Plane& plane, RayPacket& packet, HitRecord* pHitRecords)
+		{
+			//The origin is shared, only the direction term differs per ray
+			const float distanceFromPlaneToRay{ Vector3::Dot(packet.origin - plane.origin, plane.normal) };
+			const Vector3 negativeNormal{ -plane.normal };
+
+			const __m128 zero{ _mm_setzero_ps() };
+			const __m128 distanceFromPlane{ _mm_set1_ps(distanceFromPlaneToRay) };
+			const __m128 rayMin{ _mm_set1_ps(packet.min) };
+			uint32_t hitMask{ 0 };
+
+			for (uint32_t firstRay{ 0 }; firstRay < RayPacket::rayCount; firstRay += RayPacket::laneCount)
 			{
-				//read the first word of the string, use the >> operator (istream::operator>>) 
-				sCommand = "EOF";
-				file >> sCommand;
+				if (!HasActiveRays(packet, firstRay))
+					continue;
+
+				const __m128 rayDotNegNormal{ _mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(_mm_load_ps(packet.directionX + firstRay), _mm_set1_ps(negativeNormal.x)),
+					_mm_mul_ps(_mm_load_ps(packet.directionY + firstRay), _mm_set1_ps(negativeNormal.y))),
+					_mm_mul_ps(_mm_load_ps(packet.directionZ + firstRay), _mm_set1_ps(negativeNormal.z))) };
+
+				const __m128 distance{ _mm_div_ps(distanceFromPlane, rayDotNegNormal) };
+
+				__m128 mask{ _mm_cmpgt_ps(rayDotNegNormal, zero) };
+				mask = _mm_and_ps(mask, _mm_cmplt_ps(distance, _mm_load_ps(packet.max + firstRay)));
+				mask = _mm_and_ps(mask, _mm_cmpgt_ps(distance, rayMin));
+
+				const int laneMask{ _mm_movemask_ps(mask) };
+				if (laneMask == 0)
+					continue;
 
-				if (sCommand == "EOF")
-					break;
+				alignas(16) float distances[RayPacket::laneCount];
+				_mm_store_ps(distances, distance);
 
-				//use conditional statements to process the different commands
-				if (sCommand == "#")
+				for (uint32_t lane{ 0 }; lane < RayPacket::laneCount; ++lane)
 				{
-					// Ignore Comment
+					if ((laneMask & (1 << lane)) == 0)
+						continue;
+
+					const uint32_t rayIndex{ firstRay + lane };
+					HitRecord& hitRecord{ pHitRecords[rayIndex] };
+
+					hitRecord = {};
+					hitRecord.didHit = true;
+					hitRecord.cameraToPointDistance = distances[lane];
+					hitRecord.origin = packet.origin + (distances[lane] * packet.GetDirection(rayIndex));
+					hitRecord.materialIndex = plane.materialIndex;
+					hitRecord.normal = plane.normal;
+					packet.max[rayIndex] = distances[lane];
 				}
-				else if (sCommand == "v")
+
+				hitMask |= uint32_t(laneMask) << firstRay;
+			}
+
+			return hitMask;
+		}
+
+		//The first sphereCount lanes of the block one after the other, ties go to the lowest lane like in HitTest_SphereBlock
+		inline uint32_t HitTest_SphereBlock(const SphereBlock& block, uint32_t sphereCount, RayPacket& packet, HitRecord* pHitRecords)
+		{
+			const __m128 zero{ _mm_setzero_ps() };
+			const __m128 originX{ _mm_set1_ps(packet.origin.x) };
+			const __m128 originY{ _mm_set1_ps(packet.origin.y) };
+			const __m128 originZ{ _mm_set1_ps(packet.origin.z) };
+			const __m128 rayMin{ _mm_set1_ps(packet.min) };
+			uint32_t hitMask{ 0 };
+
+			for (uint32_t sphere{ 0 }; sphere < sphereCount; ++sphere)
+			{
+				const __m128 centerX{ _mm_set1_ps(block.centerX[sphere]) };
+				const __m128 centerY{ _mm_set1_ps(block.centerY[sphere]) };
+				const __m128 centerZ{ _mm_set1_ps(block.centerZ[sphere]) };
+				const __m128 radiusSquared{ _mm_set1_ps(block.radiusSquared[sphere]) };
+
+				const __m128 originToCenterX{ _mm_sub_ps(centerX, originX) };
+				const __m128 originToCenterY{ _mm_sub_ps(centerY, originY) };
+				const __m128 originToCenterZ{ _mm_sub_ps(centerZ, originZ) };
+
+				for (uint32_t firstRay{ 0 }; firstRay < RayPacket::rayCount; firstRay += RayPacket::laneCount)
 				{
-					//Vertex
-					float x, y, z;
-					file >> x >> y >> z;
-					positions.push_back({ x, y, z });
+					if (!HasActiveRays(packet, firstRay))
+						continue;
+
+					const __m128 directionX{ _mm_load_ps(packet.directionX + firstRay) };
+					const __m128 directionY{ _mm_load_ps(packet.directionY + firstRay) };
+					const __m128 directionZ{ _mm_load_ps(packet.directionZ + firstRay) };
+
+					const __m128 distanceToClosestPoint{ _mm_add_ps(_mm_add_ps(
+						_mm_mul_ps(originToCenterX, directionX),
+						_mm_mul_ps(originToCenterY, directionY)),
+						_mm_mul_ps(originToCenterZ, directionZ)) };
+
+					const __m128 closestToCenterX{ _mm_sub_ps(_mm_add_ps(originX, _mm_mul_ps(directionX, distanceToClosestPoint)), centerX) };
+					const __m128 closestToCenterY{ _mm_sub_ps(_mm_add_ps(originY, _mm_mul_ps(directionY, distanceToClosestPoint)), centerY) };
+					const __m128 closestToCenterZ{ _mm_sub_ps(_mm_add_ps(originZ, _mm_mul_ps(directionZ, distanceToClosestPoint)), centerZ) };
+
+					const __m128 pointToCenterDistanceSqrd{ _mm_add_ps(_mm_add_ps(
+						_mm_mul_ps(closestToCenterX, closestToCenterX),
+						_mm_mul_ps(closestToCenterY, closestToCenterY)),
+						_mm_mul_ps(closestToCenterZ, closestToCenterZ)) };
+
+					//Rays that miss take the square root of a negative number, they are masked out anyway
+					const __m128 distance{ _mm_sub_ps(distanceToClosestPoint, _mm_sqrt_ps(_mm_sub_ps(radiusSquared, pointToCenterDistanceSqrd))) };
+
+					__m128 mask{ _mm_cmpge_ps(distanceToClosestPoint, zero) };
+					mask = _mm_and_ps(mask, _mm_cmplt_ps(pointToCenterDistanceSqrd, radiusSquared));
+					mask = _mm_and_ps(mask, _mm_cmplt_ps(distance, _mm_load_ps(packet.max + firstRay)));
+					mask = _mm_and_ps(mask, _mm_cmpgt_ps(distance, rayMin));
+
+					const int laneMask{ _mm_movemask_ps(mask) };
+					if (laneMask == 0)
+						continue;
+
+					alignas(16) float distances[RayPacket::laneCount];
+					_mm_store_ps(distances, distance);
+
+					const Vector3 center{ block.centerX[sphere], block.centerY[sphere], block.centerZ[sphere] };
+
+					for (uint32_t lane{ 0 }; lane < RayPacket::laneCount; ++lane)
+					{
+						if ((laneMask & (1 << lane)) == 0)
+							continue;
+
+						const uint32_t rayIndex{ firstRay + lane };
+						HitRecord& hitRecord{ pHitRecords[rayIndex] };
+
+						hitRecord.didHit = true;
+						hitRecord.cameraToPointDistance = distances[lane];
+						hitRecord.origin = packet.origin + (distances[lane] * packet.GetDirection(rayIndex));
+						hitRecord.materialIndex = block.materialIndices[sphere];
+						hitRecord.normal = (hitRecord.origin - center) / block.radius[sphere];
+						packet.max[rayIndex] = distances[lane];
+					}
+
+					hitMask |= uint32_t(laneMask) << firstRay;
 				}
-				else if (sCommand == "f")
+			}
+
+			return hitMask;
+		}
+
+		//The first triangleCount lanes of the block one after the other, ties go to the lowest lane like in HitTest_TriangleBlock
+		inline uint32_t HitTest_TriangleBlock(const TriangleBlock& block, uint32_t triangleCount, TriangleCullMode cullMode, RayPacket& packet, HitRecord* pHitRecords)
+		{
+			const __m128 zero{ _mm_setzero_ps() };
+			const __m128 one{ _mm_set1_ps(1.0f) };
+			const __m128 rayMin{ _mm_set1_ps(packet.min) };
+			uint32_t hitMask{ 0 };
+
+			for (uint32_t triangle{ 0 }; triangle < triangleCount; ++triangle)
+			{
+				const Vector3 v0{ block.v0X[triangle], block.v0Y[triangle], block.v0Z[triangle] };
+				const Vector3 edgeV0V1{ block.edgeV0V1X[triangle], block.edgeV0V1Y[triangle], block.edgeV0V1Z[triangle] };
+				const Vector3 edgeV0V2{ block.edgeV0V2X[triangle], block.edgeV0V2Y[triangle], block.edgeV0V2Z[triangle] };
+
+				//These only depend on the shared origin
+				const Vector3 v0ToOrigin{ packet.origin - v0 };
+				const Vector3 originCrossEdge{ Vector3::Cross(v0ToOrigin, edgeV0V1) };
+				const __m128 distanceNumerator{ _mm_set1_ps(Vector3::Dot(edgeV0V2, originCrossEdge)) };
+
+				const __m128 edgeV0V1X{ _mm_set1_ps(edgeV0V1.x) };
+				const __m128 edgeV0V1Y{ _mm_set1_ps(edgeV0V1.y) };
+				const __m128 edgeV0V1Z{ _mm_set1_ps(edgeV0V1.z) };
+				const __m128 edgeV0V2X{ _mm_set1_ps(edgeV0V2.x) };
+				const __m128 edgeV0V2Y{ _mm_set1_ps(edgeV0V2.y) };
+				const __m128 edgeV0V2Z{ _mm_set1_ps(edgeV0V2.z) };
+
+				for (uint32_t firstRay{ 0 }; firstRay < RayPacket::rayCount; firstRay += RayPacket::laneCount)
 				{
-					float i0, i1, i2;
-					file >> i0 >> i1 >> i2;
+					if (!HasActiveRays(packet, firstRay))
+						continue;
+
+					const __m128 directionX{ _mm_load_ps(packet.directionX + firstRay) };
+					const __m128 directionY{ _mm_load_ps(packet.directionY + firstRay) };
+					const __m128 directionZ{ _mm_load_ps(packet.directionZ + firstRay) };
+
+					//directionCrossEdge = Cross(direction, edgeV0V2)
+					const __m128 crossX{ _mm_sub_ps(_mm_mul_ps(directionY, edgeV0V2Z), _mm_mul_ps(directionZ, edgeV0V2Y)) };
+					const __m128 crossY{ _mm_sub_ps(_mm_mul_ps(directionZ, edgeV0V2X), _mm_mul_ps(directionX, edgeV0V2Z)) };
+					const __m128 crossZ{ _mm_sub_ps(_mm_mul_ps(directionX, edgeV0V2Y), _mm_mul_ps(directionY, edgeV0V2X)) };
+
+					const __m128 determinant{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(edgeV0V1X, crossX), _mm_mul_ps(edgeV0V1Y, crossY)), _mm_mul_ps(edgeV0V1Z, crossZ)) };
+
+					__m128 mask{};
+					switch (cullMode)
+					{
+					case TriangleCullMode::BackFaceCulling:
+						mask = _mm_cmpgt_ps(determinant, zero);
+						break;
+					case TriangleCullMode::FrontFaceCulling:
+						mask = _mm_cmplt_ps(determinant, zero);
+						break;
+					default:
+						mask = _mm_cmpneq_ps(determinant, zero);
+						break;
+					}
+
+					if (_mm_movemask_ps(mask) == 0)
+						continue;
+
+					const __m128 inverseDeterminant{ _mm_div_ps(one, determinant) };
+
+					const __m128 u{ _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+						_mm_mul_ps(_mm_set1_ps(v0ToOrigin.x), crossX),
+						_mm_mul_ps(_mm_set1_ps(v0ToOrigin.y), crossY)),
+						_mm_mul_ps(_mm_set1_ps(v0ToOrigin.z), crossZ)), inverseDeterminant) };
+					mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+
+					const __m128 v{ _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+						_mm_mul_ps(directionX, _mm_set1_ps(originCrossEdge.x)),
+						_mm_mul_ps(directionY, _mm_set1_ps(originCrossEdge.y))),
+						_mm_mul_ps(directionZ, _mm_set1_ps(originCrossEdge.z))), inverseDeterminant) };
+					mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
 
-					indices.push_back((int)i0 - 1);
-					indices.push_back((int)i1 - 1);
-					indices.push_back((int)i2 - 1);
+					const __m128 distance{ _mm_mul_ps(distanceNumerator, inverseDeterminant) };
+					mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpgt_ps(distance, rayMin), _mm_cmplt_ps(distance, _mm_load_ps(packet.max + firstRay))));
+
+					const int laneMask{ _mm_movemask_ps(mask) };
+					if (laneMask == 0)
+						continue;
+
+					alignas(16) float distances[RayPacket::laneCount];
+					alignas(16) float us[RayPacket::laneCount];
+					alignas(16) float vs[RayPacket::laneCount];
+					_mm_store_ps(distances, distance);
+					_mm_store_ps(us, u);
+					_mm_store_ps(vs, v);
+
+					for (uint32_t lane{ 0 }; lane < RayPacket::laneCount; ++lane)
+					{
+						if ((laneMask & (1 << lane)) == 0)
+							continue;
+
+						const uint32_t rayIndex{ firstRay + lane };
+						HitRecord& hitRecord{ pHitRecords[rayIndex] };
+
+						hitRecord.didHit = true;
+						hitRecord.cameraToPointDistance = distances[lane];
+						hitRecord.origin = packet.origin + (packet.GetDirection(rayIndex) * distances[lane]);
+						hitRecord.normal = { block.normalX[triangle], block.normalY[triangle], block.normalZ[triangle] };
+						hitRecord.u = us[lane];
+						hitRecord.v = vs[lane];
+						packet.max[rayIndex] = distances[lane];
+					}
+
+					hitMask |= uint32_t(laneMask) << firstRay;
 				}
-				//read till end of line and ignore all remaining chars
-				file.ignore(1000, '\n');
+			}
+
+			return hitMask;
+		}
 
-				if (file.eof())
-					break;
+		//Entry distance of the whole packet into the bounds from interval arithmetic on its inverse directions, FLT_MAX if none of its rays can hit them.
+		//Conservative: it may let through bounds that every single ray misses, never the other way around. The packet has to be coherent.
+		inline float HitTest_AABB(const AABB& bounds, const RayPacket& packet, float packetMax)
+		{
+			float entry{ -FLT_MAX };
+			float exit{ FLT_MAX };
+
+			for (int axis{ 0 }; axis < 3; ++axis)
+			{
+				//With one sign per axis every ray enters through the same slab plane
+				const bool isPositive{ packet.inverseDirectionMin[axis] > 0.0f };
+				const float toNear{ (isPositive ? bounds.min[axis] : bounds.max[axis]) - packet.origin[axis] };
+				const float toFar{ (isPositive ? bounds.max[axis] : bounds.min[axis]) - packet.origin[axis] };
+
+				const float inverseMin{ packet.inverseDirectionMin[axis] };
+				const float inverseMax{ packet.inverseDirectionMax[axis] };
+
+				entry = std::max(entry, std::min(toNear * inverseMin, toNear * inverseMax));
+				exit = std::min(exit, std::max(toFar * inverseMin, toFar * inverseMax));
+			}
+
+			if (exit >= entry && entry < packetMax && exit > packet.min)
+				return entry;
+
+			return FLT_MAX;
+		}
+
+		//Largest max over the rays of the packet, the unused ones have a max of 0
+		inline float GetMaxDistance(const RayPacket& packet)
+		{
+			__m128 maxDistance{ _mm_load_ps(packet.max) };
+
+			for (uint32_t firstRay{ RayPacket::laneCount }; firstRay < RayPacket::rayCount; firstRay += RayPacket::laneCount)
+			{
+				maxDistance = _mm_max_ps(maxDistance, _mm_load_ps(packet.max + firstRay));
 			}
 
-			//Precompute normals
-			for (uint64_t index = 0; index < indices.size(); index += 3)
+			alignas(16) float lanes[RayPacket::laneCount];
+			_mm_store_ps(lanes, maxDistance);
+			return std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+		}
+
+		/**
+		 * \brief Walks the BVH front to back with a coherent packet and calls leafHitTest for every leaf any of its rays can reach.
+		 * Nodes are culled for all rays at once with HitTest_AABB on the packet.
+		 * \param leafHitTest callable void(uint32_t nodeIndex, const BVHNode& leaf, RayPacket& packet), expected to shorten the max of the rays it hits
+		 */
+		template<typename LeafHitTest>
+		inline void HitTest_BVHLeaves(const BVH& bvh, RayPacket& packet, LeafHitTest&& leafHitTest)
+		{
+			assert(packet.isCoherent && "Incoherent packets have to be traced ray by ray");
+
+			if (bvh.IsEmpty())
+				return;
+
+			const std::vector<BVHNode>& nodes{ bvh.GetNodes() };
+
+			struct StackEntry
+			{
+				uint32_t nodeIndex;
+				float distance;
+			};
+
+			//Bounded by the build depth limit, see BVH::TRAVERSAL_STACK_SIZE
+			StackEntry stack[BVH::TRAVERSAL_STACK_SIZE];
+			uint32_t stackSize{ 0 };
+
+			float packetMax{ GetMaxDistance(packet) };
+
+			const float rootDistance{ HitTest_AABB(nodes[0].bounds, packet, packetMax) };
+			if (rootDistance == FLT_MAX)
+				return;
+
+			stack[stackSize++] = { 0, rootDistance };
+
+			while (stackSize > 0)
 			{
-				uint32_t i0 = indices[index];
-				uint32_t i1 = indices[index + 1];
-				uint32_t i2 = indices[index + 2];
+				const StackEntry entry{ stack[--stackSize] };
 
-				Vector3 edgeV0V1 = positions[i1] - positions[i0];
-				Vector3 edgeV0V2 = positions[i2] - positions[i0];
-				Vector3 normal = Vector3::Cross(edgeV0V1, edgeV0V2);
+				//Hits found since this node was pushed may have brought every ray closer
+				if (entry.distance >= packetMax)
+					continue;
 
-				if(isnan(normal.x))
+				const BVHNode& node{ nodes[entry.nodeIndex] };
+
+				if (node.IsLeaf())
 				{
-					int k = 0;
+					leafHitTest(entry.nodeIndex, node, packet);
+					packetMax = GetMaxDistance(packet);
+					continue;
 				}
 
-				normal.Normalize();
-				if (isnan(normal.x))
+				StackEntry nearChild{ node.leftFirst, HitTest_AABB(nodes[node.leftFirst].bounds, packet, packetMax) };
+				StackEntry farChild{ node.leftFirst + 1, HitTest_AABB(nodes[node.leftFirst + 1].bounds, packet, packetMax) };
+
+				if (nearChild.distance > farChild.distance)
+					std::swap(nearChild, farChild);
+
+				//Push the far child first so the near one is visited next
+				assert(stackSize + 2 <= BVH::TRAVERSAL_STACK_SIZE);
+
+				if (farChild.distance != FLT_MAX)
+					stack[stackSize++] = farChild;
+
+				if (nearChild.distance != FLT_MAX)
+					stack[stackSize++] = nearChild;
+			}
+		}
+
+		/**
+		 * \brief Packet version of HitTest_BVH, calls hitTest for every primitive in the leaves any ray of the packet can reach
+		 * \param hitTest callable void(uint32_t primitiveIndex, RayPacket& packet)
+		 */
+		template<typename PrimitiveHitTest>
+		inline void HitTest_BVH(const BVH& bvh, RayPacket& packet, PrimitiveHitTest&& hitTest)
+		{
+			const std::vector<uint32_t>& primitiveIndices{ bvh.GetPrimitiveIndices() };
+
+			HitTest_BVHLeaves(bvh, packet,
+				[&](uint32_t, const BVHNode& leaf, RayPacket& currentPacket)
+				{
+					for (uint32_t i{ 0 }; i < leaf.primitiveCount; ++i)
+					{
+						hitTest(primitiveIndices[leaf.leftFirst + i], currentPacket);
+					}
+				});
+		}
+
+		//Falls back to tracing the rays one by one when the packet is not coherent
+		inline uint32_t HitTest_TriangleMesh(const TriangleMesh& mesh, RayPacket& packet, HitRecord* pHitRecords)
+		{
+			uint32_t hitMask{ 0 };
+
+			if (!packet.isCoherent)
+			{
+				for (uint32_t rayIndex{ 0 }; rayIndex < RayPacket::rayCount; ++rayIndex)
 				{
-					int k = 0;
+					if ((packet.activeMask & (1u << rayIndex)) == 0)
+						continue;
+
+					if (HitTest_TriangleMesh(mesh, packet.GetRay(rayIndex), pHitRecords[rayIndex]))
+					{
+						packet.max[rayIndex] = pHitRecords[rayIndex].cameraToPointDistance;
+						hitMask |= 1u << rayIndex;
+					}
 				}
 
-				normals.push_back(normal);
+				return hitMask;
 			}
 
-			return true;
+			HitTest_BVHLeaves(mesh.bvh, packet,
+				[&](uint32_t nodeIndex, const BVHNode& leaf, RayPacket& currentPacket)
+				{
+					const uint32_t firstBlock{ mesh.leafFirstBlocks[nodeIndex] };
+
+					for (uint32_t first{ 0 }; first < leaf.primitiveCount; first += TriangleBlock::laneCount)
+					{
+						const uint32_t triangleCount{ std::min(leaf.primitiveCount - first, TriangleBlock::laneCount) };
+						hitMask |= HitTest_TriangleBlock(mesh.triangleBlocks[firstBlock + (first / TriangleBlock::laneCount)], triangleCount, mesh.cullMode, currentPacket, pHitRecords);
+					}
+				});
+
+			return hitMask;
+		}
+
+		inline uint32_t HitTest_MeshInstance(const MeshInstance& instance, const TriangleMesh& mesh, RayPacket& packet, HitRecord* pHitRecords)
+		{
+			//Transforming the directions keeps the packet coherent unless the instance is rotated across one of the axes of the rays
+			RayPacket objectPacket{};
+			objectPacket.origin = instance.inverseTransform.TransformPoint(packet.origin);
+			objectPacket.min = packet.min;
+
+			for (uint32_t rayIndex{ 0 }; rayIndex < RayPacket::rayCount; ++rayIndex)
+			{
+				if ((packet.activeMask & (1u << rayIndex)) != 0)
+					objectPacket.SetRay(rayIndex, instance.inverseTransform.TransformVector(packet.GetDirection(rayIndex)), packet.max[rayIndex]);
+			}
+
+			objectPacket.UpdateInverseDirectionBounds();
+
+			HitRecord objectHitRecords[RayPacket::rayCount]{};
+			const uint32_t hitMask{ HitTest_TriangleMesh(mesh, objectPacket, objectHitRecords) };
+
+			//Normals are transformed by the inverse transpose to stay perpendicular under non-uniform scaling
+			const Matrix& inverse{ instance.inverseTransform };
+
+			for (uint32_t rayIndex{ 0 }; rayIndex < RayPacket::rayCount; ++rayIndex)
+			{
+				if ((hitMask & (1u << rayIndex)) == 0)
+					continue;
+
+				const HitRecord& objectHitRecord{ objectHitRecords[rayIndex] };
+				const Vector3& objectNormal{ objectHitRecord.normal };
+				HitRecord& hitRecord{ pHitRecords[rayIndex] };
+
+				hitRecord = objectHitRecord;
+				hitRecord.origin = packet.origin + (packet.GetDirection(rayIndex) * objectHitRecord.cameraToPointDistance);
+				hitRecord.normal = Vector3{
+					Vector3::Dot(inverse.GetAxisX(), objectNormal),
+					Vector3::Dot(inverse.GetAxisY(), objectNormal),
+					Vector3::Dot(inverse.GetAxisZ(), objectNormal) }.Normalized();
+				hitRecord.materialIndex = instance.materialIndex;
+				packet.max[rayIndex] = objectHitRecord.cameraToPointDistance;
+			}
+
+			return hitMask;
+		}
+#pragma endregion
+	}
+
+	namespace LightUtils
+	{
+		//Direction from target to light
+		inline Vector3 GetDirectionToLight(const Light& light, const Vector3 origin)
+		{
+			return (origin - light.origin).Normalized();
+		}
+
+		inline ColorRGB GetRadiance(const Light& light, const Vector3& target)
+		{
+			switch (light.type)
+			{
+			case LightType::Directional:
+				return light.color * light.intensity;
+			case LightType::Point:
+				return light.color * (light.intensity / ((light.origin - target).SqrMagnitude()));
+			}
+
+			return ColorRGB(0.0f, 0.0f, 0.0f);
+		}
+
+		inline float GetObservedArea(const Light& light, const HitRecord& hitRecord)
+		{
+			const Vector3 direction{ GetDirectionToLight(light, hitRecord.origin) };
+			const float dot{ -Vector3::Dot(direction, hitRecord.normal) };
+			return std::fmax(dot, 0.0f);
 		}
-#pragma warning(pop)
 	}
 }
\ No newline at end of file
@@ -1,4 +1,8 @@
 #pragma once
+#include <cassert>
+#include <cmath>
+
+#include "SimdMath.h"
 
 namespace dae
 {
@@ -10,7 +14,7 @@ namespace dae
 		float z{};
 
 		Vector3() = default;
-		Vector3(float _x, float _y, float _z);
+		constexpr Vector3(float _x, float _y, float _z);
 		Vector3(const Vector3& from, const Vector3& to);
 		Vector3(const Vector4& v);
 
@@ -29,6 +33,12 @@ namespace dae
 		Vector4 ToPoint4() const;
 		Vector4 ToVector4() const;
 
+#ifdef SIMD_MATH_ENABLED
+		//x, y and z in the first three lanes of a register, 0 in the last one
+		__m128 ToRegister() const;
+		static Vector3 FromRegister(__m128 v);
+#endif
+
 		//Member Operators
 		Vector3 operator*(float scale) const;
 		Vector3 operator/(float scale) const;
@@ -55,4 +65,181 @@ namespace dae
 	{
 		return { v.x * scale, v.y * scale, v.z * scale };
 	}
+
+	//Everything is defined in the header so it can be inlined into every translation unit
+	inline const Vector3 Vector3::UnitX = Vector3{ 1, 0, 0 };
+	inline const Vector3 Vector3::UnitY = Vector3{ 0, 1, 0 };
+	inline const Vector3 Vector3::UnitZ = Vector3{ 0, 0, 1 };
+	inline const Vector3 Vector3::Zero = Vector3{ 0, 0, 0 };
+
+	constexpr Vector3::Vector3(float _x, float _y, float _z) : x(_x), y(_y), z(_z){}
+
+	inline Vector3::Vector3(const Vector3& from, const Vector3& to) : x(to.x - from.x), y(to.y - from.y), z(to.z - from.z){}
+
+	inline float Vector3::Magnitude() const
+	{
+		return sqrtf(x * x + y * y + z * z);
+	}
+
+	inline float Vector3::SqrMagnitude() const
+	{
+		return x * x + y * y + z * z;
+	}
+
+	inline float Vector3::Normalize()
+	{
+		const float m = Magnitude();
+		x /= m;
+		y /= m;
+		z /= m;
+
+		return m;
+	}
+
+	inline Vector3 Vector3::Normalized() const
+	{
+#ifdef SIMD_MATH_ENABLED
+		const __m128 v{ ToRegister() };
+		return FromRegister(_mm_mul_ps(v, SimdMath::InverseSqrt(SimdMath::Dot3(v, v))));
+#else
+		const float m = Magnitude();
+		return { x / m, y / m, z / m };
+#endif
+	}
+
+	//Dot and Cross stay scalar, loading the 12 byte vectors into registers costs more than the SIMD versions save.
+	//Code that already holds its vectors in registers can use SimdMath::Dot3 and SimdMath::Cross3
+	inline float Vector3::Dot(const Vector3& v1, const Vector3& v2)
+	{
+		return ((v1.x * v2.x) + (v1.y * v2.y) + (v1.z * v2.z));
+	}
+
+	inline Vector3 Vector3::Cross(const Vector3& v1, const Vector3& v2)
+	{
+		const Vector3 crossProduct{ ((v1.y * v2.z) - (v1.z * v2.y)),
+									((v1.z * v2.x) - (v1.x * v2.z)),
+									((v1.x * v2.y) - (v1.y * v2.x)) };
+
+		return crossProduct;
+	}
+
+	inline Vector3 Vector3::Project(const Vector3& v1, const Vector3& v2)
+	{
+		return (v2 * (Dot(v1, v2) / Dot(v2, v2)));
+	}
+
+	inline Vector3 Vector3::Reject(const Vector3& v1, const Vector3& v2)
+	{
+		return (v1 - v2 * (Dot(v1, v2) / Dot(v2, v2)));
+	}
+
+	inline Vector3 Vector3::Reflect(const Vector3& v1, const Vector3& v2)
+	{
+		return v1 - (2.f * Vector3::Dot(v1, v2) * v2);
+	}
+
+#ifdef SIMD_MATH_ENABLED
+	inline __m128 Vector3::ToRegister() const
+	{
+		return SimdMath::LoadFloat3(&x);
+	}
+
+	inline Vector3 Vector3::FromRegister(__m128 v)
+	{
+		Vector3 result;
+		SimdMath::StoreFloat3(&result.x, v);
+		return result;
+	}
+#endif
+
+#pragma region Operator Overloads
+	inline Vector3 Vector3::operator*(float scale) const
+	{
+		return { x * scale, y * scale, z * scale };
+	}
+
+	inline Vector3 Vector3::operator/(float scale) const
+	{
+		return { x / scale, y / scale, z / scale };
+	}
+
+	inline Vector3 Vector3::operator+(const Vector3& v) const
+	{
+		return { x + v.x, y + v.y, z + v.z };
+	}
+
+	inline Vector3 Vector3::operator-(const Vector3& v) const
+	{
+		return { x - v.x, y - v.y, z - v.z };
+	}
+
+	inline Vector3 Vector3::operator-() const
+	{
+		return { -x ,-y,-z };
+	}
+
+	inline Vector3& Vector3::operator*=(float scale)
+	{
+		x *= scale;
+		y *= scale;
+		z *= scale;
+		return *this;
+	}
+
+	inline Vector3& Vector3::operator/=(float scale)
+	{
+		x /= scale;
+		y /= scale;
+		z /= scale;
+		return *this;
+	}
+
+	inline Vector3& Vector3::operator-=(const Vector3& v)
+	{
+		x -= v.x;
+		y -= v.y;
+		z -= v.z;
+		return *this;
+	}
+
+	inline Vector3& Vector3::operator+=(const Vector3& v)
+	{
+		x += v.x;
+		y += v.y;
+		z += v.z;
+		return *this;
+	}
+
+	inline float& Vector3::operator[](int index)
+	{
+		assert(index <= 2 && index >= 0);
+
+		if (index == 0) return x;
+		if (index == 1) return y;
+		return z;
+	}
+
+	inline float Vector3::operator[](int index) const
+	{
+		assert(index <= 2 && index >= 0);
+
+		if (index == 0) return x;
+		if (index == 1) return y;
+		return z;
+	}
+
+	inline bool Vector3::operator!=(const Vector3& v) const
+	{
+		if (x == v.x && y == v.y && z == v.z)
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+#pragma endregion
 }
+
+//The conversions between Vector3 and Vector4 are defined there
+#include "Vector4.h"
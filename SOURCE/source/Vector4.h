@@ -1,8 +1,11 @@
 #pragma once
+#include <cassert>
+#include <cmath>
+
+#include "Vector3.h"
 
 namespace dae
 {
-	struct Vector3;
 	struct Vector4
 	{
 		float x;
@@ -29,4 +32,99 @@ namespace dae
 		float& operator[](int index);
 		float operator[](int index) const;
 	};
+
+	inline Vector4::Vector4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+	inline Vector4::Vector4(const Vector3& v, float _w) : x(v.x), y(v.y), z(v.z), w(_w) {}
+
+	inline float Vector4::Magnitude() const
+	{
+		return sqrtf(x * x + y * y + z * z + w * w);
+	}
+
+	inline float Vector4::SqrMagnitude() const
+	{
+		return x * x + y * y + z * z + w * w;
+	}
+
+	inline float Vector4::Normalize()
+	{
+		const float m = Magnitude();
+		x /= m;
+		y /= m;
+		z /= m;
+		w /= m;
+
+		return m;
+	}
+
+	inline Vector4 Vector4::Normalized() const
+	{
+		const float m = Magnitude();
+		return { x / m, y / m, z / m, w / m };
+	}
+
+	inline float Vector4::Dot(const Vector4& v1, const Vector4& v2)
+	{
+		return ((v1.x * v2.x) + (v1.y * v2.y) + (v1.z * v2.z) + (v1.w * v2.w));
+	}
+
+#pragma region Operator Overloads
+	inline Vector4 Vector4::operator*(float scale) const
+	{
+		return { x * scale, y * scale, z * scale, w * scale };
+	}
+
+	inline Vector4 Vector4::operator+(const Vector4& v) const
+	{
+		return { x + v.x, y + v.y, z + v.z, w + v.w };
+	}
+
+	inline Vector4 Vector4::operator-(const Vector4& v) const
+	{
+		return { x - v.x, y - v.y, z - v.z, w - v.w };
+	}
+
+	inline Vector4& Vector4::operator+=(const Vector4& v)
+	{
+		x += v.x;
+		y += v.y;
+		z += v.z;
+		w += v.w;
+		return *this;
+	}
+
+	inline float& Vector4::operator[](int index)
+	{
+		assert(index <= 3 && index >= 0);
+
+		if (index == 0)return x;
+		if (index == 1)return y;
+		if (index == 2)return z;
+		return w;
+	}
+
+	inline float Vector4::operator[](int index) const
+	{
+		assert(index <= 3 && index >= 0);
+
+		if (index == 0)return x;
+		if (index == 1)return y;
+		if (index == 2)return z;
+		return w;
+	}
+#pragma endregion
+
+#pragma region Vector3 Conversions
+	inline Vector3::Vector3(const Vector4& v) : x(v.x), y(v.y), z(v.z){}
+
+	inline Vector4 Vector3::ToPoint4() const
+	{
+		return { x, y, z, 1 };
+	}
+
+	inline Vector4 Vector3::ToVector4() const
+	{
+		return { x, y, z, 0 };
+	}
+#pragma endregion
 }
@@ -0,0 +1,35 @@
+//External includes
+#include "SDL.h"
+#include "SDL_surface.h"
+
+//Project includes
+#include "WindowPresenter.h"
+#include "FrameBuffer.h"
+
+using namespace dae;
+
+WindowPresenter::WindowPresenter(SDL_Window* pWindow) :
+	m_pWindow(pWindow)
+{
+}
+
+void WindowPresenter::Present(const FrameBuffer& frameBuffer) const
+{
+	SDL_Surface* pSurface{ SDL_GetWindowSurface(m_pWindow) };
+	if (pSurface == nullptr)
+		return;
+
+	if (SDL_MUSTLOCK(pSurface))
+		SDL_LockSurface(pSurface);
+
+	//One bulk conversion instead of mapping every pixel to the surface format
+	SDL_ConvertPixels(
+		static_cast<int>(frameBuffer.GetWidth()), static_cast<int>(frameBuffer.GetHeight()),
+		SDL_PIXELFORMAT_RGBA32, frameBuffer.GetPixels(), static_cast<int>(frameBuffer.GetPitch()),
+		pSurface->format->format, pSurface->pixels, pSurface->pitch);
+
+	if (SDL_MUSTLOCK(pSurface))
+		SDL_UnlockSurface(pSurface);
+
+	SDL_UpdateWindowSurface(m_pWindow);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+struct SDL_Window;
+
+namespace dae
+{
+	class FrameBuffer;
+
+	//Copies a finished FrameBuffer to the surface of an SDL window
+	class WindowPresenter final
+	{
+	public:
+		WindowPresenter(SDL_Window* pWindow);
+		~WindowPresenter() = default;
+
+		WindowPresenter(const WindowPresenter&) = delete;
+		WindowPresenter(WindowPresenter&&) noexcept = delete;
+		WindowPresenter& operator=(const WindowPresenter&) = delete;
+		WindowPresenter& operator=(WindowPresenter&&) noexcept = delete;
+
+		void Present(const FrameBuffer& frameBuffer) const;
+
+	private:
+		SDL_Window* m_pWindow{};
+	};
+}
@@ -0,0 +1,93 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+namespace dae
+{
+	WorkerPool::WorkerPool(uint32_t threadCount)
+	{
+		if (threadCount == 0)
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+		m_Threads.reserve(threadCount - 1);
+
+		for (uint32_t workerIndex{ 1 }; workerIndex < threadCount; ++workerIndex)
+		{
+			m_Threads.emplace_back(&WorkerPool::WorkerLoop, this, workerIndex);
+		}
+	}
+
+	WorkerPool::~WorkerPool()
+	{
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_IsShuttingDown = true;
+		}
+		m_WorkAvailable.notify_all();
+
+		for (std::thread& thread : m_Threads)
+		{
+			thread.join();
+		}
+	}
+
+	void WorkerPool::Dispatch(uint32_t taskCount, TaskFunction pTaskFunction, void* pTask)
+	{
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_TaskCount = taskCount;
+			m_pTaskFunction = pTaskFunction;
+			m_pTask = pTask;
+			m_NextTask.store(0, std::memory_order_relaxed);
+			m_BusyWorkers = uint32_t(m_Threads.size());
+			++m_Generation;
+		}
+		m_WorkAvailable.notify_all();
+
+		ProcessTasks(0);
+
+		std::unique_lock lock{ m_Mutex };
+		m_WorkFinished.wait(lock, [this]() { return m_BusyWorkers == 0; });
+	}
+
+	void WorkerPool::WorkerLoop(uint32_t workerIndex)
+	{
+		uint64_t lastGeneration{ 0 };
+
+		while (true)
+		{
+			{
+				std::unique_lock lock{ m_Mutex };
+				m_WorkAvailable.wait(lock, [&]() { return m_IsShuttingDown || m_Generation != lastGeneration; });
+
+				if (m_IsShuttingDown)
+					return;
+
+				lastGeneration = m_Generation;
+			}
+
+			ProcessTasks(workerIndex);
+
+			bool isLastWorker{ false };
+			{
+				std::lock_guard lock{ m_Mutex };
+				isLastWorker = (--m_BusyWorkers == 0);
+			}
+
+			if (isLastWorker)
+				m_WorkFinished.notify_one();
+		}
+	}
+
+	void WorkerPool::ProcessTasks(uint32_t workerIndex)
+	{
+		while (true)
+		{
+			const uint32_t taskIndex{ m_NextTask.fetch_add(1, std::memory_order_relaxed) };
+			if (taskIndex >= m_TaskCount)
+				return;
+
+			m_pTaskFunction(m_pTask, taskIndex, workerIndex);
+		}
+	}
+}
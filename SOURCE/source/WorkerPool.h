@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	//Persistent pool of threads that pull task indices from a shared atomic counter.
+	//The calling thread takes part in the work, so a pool of N threads only spawns N - 1.
+	class WorkerPool final
+	{
+	public:
+		//0 threads uses the amount of hardware threads
+		explicit WorkerPool(uint32_t threadCount = 0);
+		~WorkerPool();
+
+		WorkerPool(const WorkerPool&) = delete;
+		WorkerPool(WorkerPool&&) noexcept = delete;
+		WorkerPool& operator=(const WorkerPool&) = delete;
+		WorkerPool& operator=(WorkerPool&&) noexcept = delete;
+
+		/**
+		 * \brief Runs task(taskIndex, workerIndex) for every index in [0, taskCount) and returns once all of them are done
+		 * \param taskCount amount of tasks
+		 * \param task callable, kept by reference so dispatching never allocates
+		 */
+		template<typename Task>
+		void Run(uint32_t taskCount, Task& task)
+		{
+			Dispatch(taskCount, &InvokeTask<Task>, &task);
+		}
+
+		inline uint32_t GetThreadCount() const { return uint32_t(m_Threads.size()) + 1; }
+
+	private:
+		using TaskFunction = void(*)(void* pTask, uint32_t taskIndex, uint32_t workerIndex);
+
+		template<typename Task>
+		static void InvokeTask(void* pTask, uint32_t taskIndex, uint32_t workerIndex)
+		{
+			(*static_cast<Task*>(pTask))(taskIndex, workerIndex);
+		}
+
+		void Dispatch(uint32_t taskCount, TaskFunction pTaskFunction, void* pTask);
+		void WorkerLoop(uint32_t workerIndex);
+		void ProcessTasks(uint32_t workerIndex);
+
+		std::vector<std::thread> m_Threads{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_WorkAvailable{};
+		std::condition_variable m_WorkFinished{};
+
+		std::atomic<uint32_t> m_NextTask{ 0 };
+		uint32_t m_TaskCount{ 0 };
+		TaskFunction m_pTaskFunction{ nullptr };
+		void* m_pTask{ nullptr };
+
+		uint64_t m_Generation{ 0 };
+		uint32_t m_BusyWorkers{ 0 };
+		bool m_IsShuttingDown{ false };
+	};
+}
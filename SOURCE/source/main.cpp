@@ -6,12 +6,17 @@
 
 //Standard includes
 #include <iostream>
+#include <memory>
+#include <string>
 
 //Project includes
 #include "Timer.h"
+#include "Benchmark.h"
 #include "Renderer.h"
+#include "WindowPresenter.h"
 #include "Scene.h"
 #include "Sphere.h"
+#include "Material.h"
 
 using namespace dae;
 
@@ -23,9 +28,31 @@ void ShutDown(SDL_Window* pWindow)
 
 int main(int argc, char* args[])
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
+	//Headless batch mode, never opens a window
+	if (Benchmark::IsBatchMode(argc, args))
+	{
+		Benchmark::Settings settings{};
+		if (!Benchmark::ParseArguments(argc, args, settings))
+			return 1;
+
+		return Benchmark::Run(settings);
+	}
+
+	//The scene to show can be given as the first argument, "W1" to "W4" or a scene file (see Scene_File), W4 otherwise
+	const std::string sceneName{ argc > 1 ? args[1] : "W4" };
+	const std::unique_ptr<Scene> pScene{ CreateScene(sceneName) };
+	if (!pScene)
+	{
+		std::cout << "Unknown scene " << sceneName << std::endl;
+		return 1;
+	}
+
+	pScene->Initialize();
+	if (!pScene->GetError().empty())
+	{
+		std::cout << "Could not load scene " << pScene->GetError() << std::endl;
+		return 1;
+	}
 
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
@@ -44,12 +71,10 @@ int main(int argc, char* args[])
 
 	//Initialize "framework"
 	const auto pTimer = new Timer();
-	const auto pRenderer = new Renderer(pWindow);
+	const auto pRenderer = new Renderer(width, height);
+	const auto pPresenter = new WindowPresenter(pWindow);
 	pRenderer->PrintCurrentLightingMode();
 
-	const auto pScene = new Scene_W4();
-	pScene->Initialize();
-
 	//Start loop
 	pTimer->Start();
 
@@ -82,6 +107,18 @@ int main(int argc, char* args[])
 				if(e.key.keysym.scancode == SDL_SCANCODE_F3)
 					pRenderer->CycleLightingMode();
 
+				if (e.key.keysym.scancode == SDL_SCANCODE_F4)
+				{
+					pRenderer->SetPacketTracing(!pRenderer->IsPacketTracingEnabled());
+					std::cout << "\nPacket Tracing: " << (pRenderer->IsPacketTracingEnabled() ? "On" : "Off") << "\n";
+				}
+
+				if (e.key.keysym.scancode == SDL_SCANCODE_F5)
+				{
+					pRenderer->SetProgressive(!pRenderer->IsProgressiveEnabled());
+					std::cout << "\nProgressive Rendering: " << (pRenderer->IsProgressiveEnabled() ? "On" : "Off") << "\n";
+				}
+
 				if (e.key.keysym.scancode == SDL_SCANCODE_F6)
 					benchmarkOn = !benchmarkOn;
 				break;
@@ -92,7 +129,8 @@ int main(int argc, char* args[])
 		pScene->Update(pTimer);
 
 		//--------- Render ---------
-		pRenderer->Render(pScene);
+		pRenderer->Render(pScene.get());
+		pPresenter->Present(pRenderer->GetFrameBuffer());
 
 		//--------- Timer ---------
 		pTimer->Update();
@@ -110,7 +148,7 @@ int main(int argc, char* args[])
 		//Save screenshot after full render
 		if (takeScreenshot)
 		{
-			if (!pRenderer->SaveBufferToImage())
+			if (pRenderer->SaveBufferToImage())
 				std::cout << "Screenshot saved!" << std::endl;
 			else
 				std::cout << "Something went wrong. Screenshot not saved!" << std::endl;
@@ -120,7 +158,7 @@ int main(int argc, char* args[])
 	pTimer->Stop();
 
 	//Shutdown "framework"
-	delete pScene;
+	delete pPresenter;
 	delete pRenderer;
 	delete pTimer;
 